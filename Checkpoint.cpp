@@ -0,0 +1,307 @@
+#include "Checkpoint.h"
+
+#include <algorithm>
+
+#define CHECKPOINT_HEADER "LineCounterCheckpoint 2 "
+// A record is formatted only when at least this much space is left in the batch. Paths are at most PATH_MAX
+#define CHECKPOINT_RECORD_RESERVE 256
+#define CHECKPOINT_PATH_RESERVE (CORE_KB * 8)
+#define CHECKPOINT_DONE_NUMBER_COUNT 9
+
+// ------------------------------------------------------------------------------------------------------------
+
+static bool StartsWith(const char*& pointer, const char* prefix) {
+	size_t size = strlen(prefix);
+	if (strncmp(pointer, prefix, size) == 0) {
+		pointer += size;
+		return true;
+	}
+	return false;
+}
+
+// The numbers are separated by a single space and the last one ends the line
+static bool ParseNumbers(const char* pointer, const char* line_end, size_t* values, size_t count) {
+	for (size_t index = 0; index < count; index++) {
+		if (pointer == line_end || *pointer < '0' || *pointer > '9') {
+			return false;
+		}
+		values[index] = 0;
+		while (pointer < line_end && *pointer >= '0' && *pointer <= '9') {
+			values[index] = values[index] * 10 + (*pointer - '0');
+			pointer++;
+		}
+		if (index < count - 1) {
+			if (pointer == line_end || *pointer != ' ') {
+				return false;
+			}
+			pointer++;
+		}
+	}
+	return pointer == line_end;
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+CheckpointLog::CheckpointLog(unsigned int _thread_count) : thread_count(_thread_count) {
+	listed_files = { nullptr, 0 };
+	listed_roots = { nullptr, 0 };
+	files = { nullptr, 0 };
+	restored_count = 0;
+	file = -1;
+	is_open = false;
+	is_restored = false;
+	valid_size = 0;
+	stop_writer = false;
+
+	thread_batches = (CapacityStream<char>*)malloc(sizeof(CapacityStream<char>) * thread_count);
+	thread_batch_timers = new Timer[thread_count];
+	for (unsigned int index = 0; index < thread_count; index++) {
+		thread_batches[index] = { nullptr, 0, 0 };
+	}
+}
+
+CheckpointLog::~CheckpointLog() {
+	End();
+	for (unsigned int index = 0; index < thread_count; index++) {
+		free(thread_batches[index].buffer);
+	}
+	for (unsigned int index = 0; index < free_batches.size; index++) {
+		free(free_batches[index].buffer);
+	}
+	free(thread_batches);
+	delete[] thread_batch_timers;
+	free_batches.FreeBuffer();
+	pending_batches.FreeBuffer();
+	free(listed_files.buffer);
+	free(listed_roots.buffer);
+	free(files.buffer);
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+void CheckpointLog::Discard() {
+	arena.Clear();
+	free(listed_files.buffer);
+	free(listed_roots.buffer);
+	free(files.buffer);
+	listed_files = { nullptr, 0 };
+	listed_roots = { nullptr, 0 };
+	files = { nullptr, 0 };
+	restored_count = 0;
+	is_restored = false;
+	valid_size = 0;
+}
+
+bool CheckpointLog::Restore(Stream<char> path, uint64_t fingerprint) {
+	Discard();
+
+	Stream<char> content = ReadWholeFileText(path);
+	if (content.buffer == nullptr) {
+		return false;
+	}
+
+	const char* line = content.buffer;
+	const char* end = content.buffer + content.size;
+	ResizableStream<Stream<char>> paths;
+	ResizableStream<unsigned int> roots;
+	bool is_listed = false;
+	// Only the complete lines are read, a torn record at the end is left out
+	while (line < end) {
+		const char* line_end = (const char*)memchr(line, '\n', end - line);
+		if (line_end == nullptr) {
+			break;
+		}
+
+		const char* pointer = line;
+		size_t values[CHECKPOINT_DONE_NUMBER_COUNT];
+		bool is_valid = false;
+		if (line == content.buffer) {
+			is_valid = StartsWith(pointer, CHECKPOINT_HEADER) && ParseNumbers(pointer, line_end, values, 1) && values[0] == fingerprint;
+		}
+		else if (!is_listed && StartsWith(pointer, "file ")) {
+			// The root index is followed by the path
+			const char* path_start = (const char*)memchr(pointer, ' ', line_end - pointer);
+			is_valid = path_start != nullptr && ParseNumbers(pointer, path_start, values, 1);
+			if (is_valid) {
+				roots.Add((unsigned int)values[0]);
+				paths.Add(arena.StringCopy({ path_start + 1, (size_t)(line_end - path_start - 1) }));
+			}
+		}
+		else if (!is_listed && StartsWith(pointer, "listed ")) {
+			is_valid = ParseNumbers(pointer, line_end, values, 1) && values[0] == paths.size;
+			if (is_valid) {
+				is_listed = true;
+				files = { calloc(std::max(paths.size, 1u), sizeof(CheckpointFile)), paths.size };
+			}
+		}
+		else if (is_listed && StartsWith(pointer, "done ")) {
+			is_valid = ParseNumbers(pointer, line_end, values, CHECKPOINT_DONE_NUMBER_COUNT) && values[0] < files.size;
+			if (is_valid) {
+				CheckpointFile* finished = files.buffer + values[0];
+				finished->counts = { values[2], values[3], values[4], values[5], values[6], values[7], values[8] };
+				finished->error = (unsigned char)values[1];
+				restored_count += finished->done ? 0 : 1;
+				finished->done = true;
+			}
+		}
+
+		if (!is_valid) {
+			break;
+		}
+		line = line_end + 1;
+	}
+	valid_size = line - content.buffer;
+	free(content.buffer);
+
+	if (!is_listed) {
+		paths.FreeBuffer();
+		roots.FreeBuffer();
+		Discard();
+		return false;
+	}
+
+	// The buffer of the resizable stream is handed over
+	listed_files = { paths.buffer, paths.size };
+	listed_roots = { roots.buffer, roots.size };
+	is_restored = true;
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+// The batch is replaced with an empty one
+static void SubmitBatch(CheckpointLog* log, CapacityStream<char>* batch) {
+	{
+		std::lock_guard<std::mutex> guard(log->lock);
+		log->pending_batches.Add(*batch);
+		if (log->free_batches.size > 0) {
+			*batch = log->free_batches[--log->free_batches.size];
+		}
+		else {
+			*batch = { malloc(CHECKPOINT_BATCH_CAPACITY), 0, CHECKPOINT_BATCH_CAPACITY };
+		}
+	}
+	log->condition.notify_one();
+}
+
+bool CheckpointLog::Begin(Stream<char> path, uint64_t fingerprint, Stream<Stream<char>> discovered_files, const unsigned int* discovered_roots) {
+	End();
+
+	bool success = true;
+	if (is_restored) {
+		success = OpenFile(path, &file, FILE_ACCESS_WRITE_ONLY | FILE_ACCESS_APPEND) == FILE_STATUS_OK;
+		success = success && ResizeFile(file, valid_size);
+	}
+	else {
+		Discard();
+		success = FileCreate(path, &file, FILE_ACCESS_WRITE_ONLY | FILE_ACCESS_TRUNCATE_FILE) == FILE_STATUS_OK;
+	}
+	if (!success) {
+		if (file != -1) {
+			CloseFile(file);
+			file = -1;
+		}
+		return false;
+	}
+
+	for (unsigned int index = 0; index < thread_count; index++) {
+		if (thread_batches[index].buffer == nullptr) {
+			thread_batches[index] = { malloc(CHECKPOINT_BATCH_CAPACITY), 0, CHECKPOINT_BATCH_CAPACITY };
+		}
+		thread_batches[index].size = 0;
+		thread_batch_timers[index].SetMarker();
+	}
+	stop_writer = false;
+	writer = std::thread([this]() {
+		WriterLoop();
+	});
+	is_open = true;
+
+	if (!is_restored) {
+		// The discovery is handed to the writer as well, the counting doesn't wait for it. The batches are written
+		// in order, so the file list is complete before the first finished file
+		CapacityStream<char> batch = { malloc(CHECKPOINT_BATCH_CAPACITY), 0, CHECKPOINT_BATCH_CAPACITY };
+		CORE_FORMAT_STRING(batch, CHECKPOINT_HEADER "{#}\n", fingerprint);
+		for (size_t index = 0; index < discovered_files.size; index++) {
+			CORE_FORMAT_STRING(batch, "file {#} {#}\n", discovered_roots[index], discovered_files[index]);
+			if (batch.capacity - batch.size < CHECKPOINT_PATH_RESERVE) {
+				SubmitBatch(this, &batch);
+			}
+		}
+		CORE_FORMAT_STRING(batch, "listed {#}\n", discovered_files.size);
+		SubmitBatch(this, &batch);
+		free(batch.buffer);
+	}
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+void CheckpointLog::Record(unsigned int thread_id, unsigned int file_index, const FileCounts& counts, unsigned char error) {
+	CapacityStream<char>* batch = thread_batches + thread_id;
+	CORE_FORMAT_STRING(*batch, "done {#} {#} {#} {#} {#} {#} {#} {#} {#}\n", file_index, (unsigned int)error, counts.code_lines, counts.comment_lines,
+		counts.blank_lines, counts.total_lines, counts.logical_lines, counts.token_count, counts.code_bytes);
+	if (batch->capacity - batch->size < CHECKPOINT_RECORD_RESERVE
+		|| thread_batch_timers[thread_id].GetDurationSinceMarker(TIMER_DURATION_MS) >= CHECKPOINT_FLUSH_INTERVAL_MS) {
+		SubmitBatch(this, batch);
+		thread_batch_timers[thread_id].SetMarker();
+	}
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+void CheckpointLog::End() {
+	if (!is_open) {
+		return;
+	}
+
+	// The counting threads are done, their batches can be taken from here
+	for (unsigned int index = 0; index < thread_count; index++) {
+		if (thread_batches[index].size > 0) {
+			SubmitBatch(this, thread_batches + index);
+		}
+	}
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stop_writer = true;
+	}
+	condition.notify_one();
+	writer.join();
+
+	CloseFile(file);
+	file = -1;
+	is_open = false;
+}
+
+void CheckpointLog::WriterLoop() {
+	ResizableStream<CapacityStream<char>> writing;
+	std::unique_lock<std::mutex> guard(lock);
+	while (true) {
+		condition.wait(guard, [this]() {
+			return pending_batches.size > 0 || stop_writer;
+		});
+		if (pending_batches.size == 0) {
+			break;
+		}
+		for (unsigned int index = 0; index < pending_batches.size; index++) {
+			writing.Add(pending_batches[index]);
+		}
+		pending_batches.size = 0;
+
+		// The log is written and flushed outside the lock, the counting threads keep going. A record
+		// that doesn't make it to the log only means that the file is counted again on resume
+		guard.unlock();
+		for (unsigned int index = 0; index < writing.size; index++) {
+			WriteFile(file, writing[index]);
+		}
+		FlushFileToDisk(file);
+		guard.lock();
+
+		for (unsigned int index = 0; index < writing.size; index++) {
+			writing[index].size = 0;
+			free_batches.Add(writing[index]);
+		}
+		writing.size = 0;
+	}
+	writing.FreeBuffer();
+}
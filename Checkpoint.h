@@ -0,0 +1,77 @@
+#pragma once
+#include "Core/Core.h"
+#include "Kernel/CountingKernel.h"
+
+using namespace Core;
+
+// A thread hands its batch to the writer when it is nearly full or when it was started this long ago
+#define CHECKPOINT_BATCH_CAPACITY (CORE_KB * 64)
+#define CHECKPOINT_FLUSH_INTERVAL_MS 2000
+
+// A file that was finished before the restart
+struct CheckpointFile {
+	FileCounts counts;
+	// A LINE_COUNTER_FILE_ERROR. Only the files that were counted are logged, so this is a warning at most
+	unsigned char error;
+	bool done;
+};
+
+// Append-only log of a long count, such that a restart can skip the work that was finished. The log starts
+// with a fingerprint of the options and the discovered files, then the counted files are appended in batches.
+// The counting threads only format the records into their own batch; a writer thread does the writes and
+// the flushes to disk. A torn record at the end, left by a killed process, is cut away when resuming
+struct CheckpointLog {
+	CheckpointLog(unsigned int thread_count);
+	~CheckpointLog();
+
+	CheckpointLog(const CheckpointLog& other) = delete;
+	CheckpointLog& operator = (const CheckpointLog& other) = delete;
+
+	// Reads the log of a previous run. Returns false if there is none, if it was written with other options
+	// or if it ended before the discovery finished. Only then are the listed files and the finished files empty
+	bool Restore(Stream<char> path, uint64_t fingerprint);
+
+	// Forgets the restored files, the next Begin starts a new log
+	void Discard();
+
+	// If nothing was restored, a new log is started with the discovered files, otherwise the restored log is
+	// continued. Returns false if the log could not be opened, in which case nothing is recorded
+	bool Begin(Stream<char> path, uint64_t fingerprint, Stream<Stream<char>> discovered_files, const unsigned int* discovered_roots);
+
+	// Can be called concurrently with different thread ids
+	void Record(unsigned int thread_id, unsigned int file_index, const FileCounts& counts, unsigned char error);
+
+	// Hands over the remaining batches and waits until they are on disk
+	void End();
+
+	bool IsDone(unsigned int file_index) const {
+		return file_index < files.size && files[file_index].done;
+	}
+
+	void WriterLoop();
+
+	// Filled by Restore, they are valid until the next Restore
+	Stream<Stream<char>> listed_files;
+	// The search path index of each listed file
+	Stream<unsigned int> listed_roots;
+	Stream<CheckpointFile> files;
+	size_t restored_count;
+
+	Arena arena;
+	FILE_HANDLE file;
+	bool is_open;
+	bool is_restored;
+	// The bytes of the restored log up to the last complete record
+	size_t valid_size;
+
+	unsigned int thread_count;
+	CapacityStream<char>* thread_batches;
+	Timer* thread_batch_timers;
+
+	std::thread writer;
+	std::mutex lock;
+	std::condition_variable condition;
+	ResizableStream<CapacityStream<char>> pending_batches;
+	ResizableStream<CapacityStream<char>> free_batches;
+	bool stop_writer;
+};
@@ -0,0 +1,620 @@
+#include "CompileCommands.h"
+#include "IncludeGraph.h"
+
+#include <algorithm>
+
+#define COMPILE_COMMANDS_PATH_CAPACITY 4096
+#define COMPILE_COMMANDS_INITIAL_INDEX_CAPACITY 1024
+
+struct JsonReader {
+	char* pointer;
+	char* end;
+};
+
+struct CompileCommandsIncludeFlag {
+	const char* flag;
+	COMPILE_COMMANDS_DIRECTORY_KIND kind;
+};
+
+// The directory can be joined to the flag or given as the next argument
+static const CompileCommandsIncludeFlag COMPILE_COMMANDS_INCLUDE_FLAGS[] = {
+	{ "-I", COMPILE_COMMANDS_DIRECTORY_ANGLED },
+	{ "-iquote", COMPILE_COMMANDS_DIRECTORY_QUOTE },
+	{ "-isystem", COMPILE_COMMANDS_DIRECTORY_SYSTEM },
+	{ "-idirafter", COMPILE_COMMANDS_DIRECTORY_AFTER }
+};
+
+// ------------------------------------------------------------------------------------------------------------
+
+static bool IsJsonWhitespace(char character) {
+	return character == ' ' || character == '\t' || character == '\n' || character == '\r';
+}
+
+static void SkipJsonWhitespace(JsonReader& reader) {
+	while (reader.pointer < reader.end && IsJsonWhitespace(*reader.pointer)) {
+		reader.pointer++;
+	}
+}
+
+// Skips the whitespace and consumes the character if it comes next
+static bool ReadJsonCharacter(JsonReader& reader, char character) {
+	SkipJsonWhitespace(reader);
+	if (reader.pointer < reader.end && *reader.pointer == character) {
+		reader.pointer++;
+		return true;
+	}
+	return false;
+}
+
+static bool IsJsonNext(JsonReader& reader, char character) {
+	SkipJsonWhitespace(reader);
+	return reader.pointer < reader.end && *reader.pointer == character;
+}
+
+// Returns -1 if the 4 characters are not hexadecimal digits
+static int ReadJsonHexDigits(const char* pointer) {
+	int value = 0;
+	for (int index = 0; index < 4; index++) {
+		char character = pointer[index];
+		int digit = -1;
+		if (character >= '0' && character <= '9') {
+			digit = character - '0';
+		}
+		else if (character >= 'a' && character <= 'f') {
+			digit = character - 'a' + 10;
+		}
+		else if (character >= 'A' && character <= 'F') {
+			digit = character - 'A' + 10;
+		}
+		if (digit < 0) {
+			return -1;
+		}
+		value = value * 16 + digit;
+	}
+	return value;
+}
+
+// Returns the number of bytes written
+static unsigned int EncodeUtf8(unsigned int code_point, char* destination) {
+	if (code_point < 0x80) {
+		destination[0] = (char)code_point;
+		return 1;
+	}
+	if (code_point < 0x800) {
+		destination[0] = (char)(0xC0 | (code_point >> 6));
+		destination[1] = (char)(0x80 | (code_point & 0x3F));
+		return 2;
+	}
+	if (code_point < 0x10000) {
+		destination[0] = (char)(0xE0 | (code_point >> 12));
+		destination[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+		destination[2] = (char)(0x80 | (code_point & 0x3F));
+		return 3;
+	}
+	destination[0] = (char)(0xF0 | (code_point >> 18));
+	destination[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+	destination[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+	destination[3] = (char)(0x80 | (code_point & 0x3F));
+	return 4;
+}
+
+// The reader must be at the opening quote. The escapes are decoded in place, a decoded escape is never longer than
+// its spelling, and the string is null terminated at the latest over its closing quote
+static bool ReadJsonString(JsonReader& reader, Stream<char>& string) {
+	char* write = ++reader.pointer;
+	string.buffer = write;
+	while (reader.pointer < reader.end) {
+		// The runs without escapes are moved at once, they stay where they are until the first escape
+		char* special = reader.pointer;
+		while (special < reader.end && *special != '"' && *special != '\\') {
+			special++;
+		}
+		size_t run_size = special - reader.pointer;
+		if (write != reader.pointer) {
+			memmove(write, reader.pointer, run_size);
+		}
+		write += run_size;
+		reader.pointer = special;
+		if (special == reader.end) {
+			return false;
+		}
+
+		if (*special == '"') {
+			reader.pointer++;
+			*write = '\0';
+			string.size = write - string.buffer;
+			return true;
+		}
+
+		if (reader.end - special < 2) {
+			return false;
+		}
+		char escaped = special[1];
+		reader.pointer = special + 2;
+		switch (escaped) {
+		case '"':
+		case '\\':
+		case '/':
+			*write++ = escaped;
+			break;
+		case 'b':
+			*write++ = '\b';
+			break;
+		case 'f':
+			*write++ = '\f';
+			break;
+		case 'n':
+			*write++ = '\n';
+			break;
+		case 'r':
+			*write++ = '\r';
+			break;
+		case 't':
+			*write++ = '\t';
+			break;
+		case 'u': {
+			int code_point = reader.end - reader.pointer >= 4 ? ReadJsonHexDigits(reader.pointer) : -1;
+			if (code_point < 0) {
+				return false;
+			}
+			reader.pointer += 4;
+			// A high surrogate is combined with the low one that follows it
+			if (code_point >= 0xD800 && code_point < 0xDC00 && reader.end - reader.pointer >= 6 && reader.pointer[0] == '\\' && reader.pointer[1] == 'u') {
+				int low_surrogate = ReadJsonHexDigits(reader.pointer + 2);
+				if (low_surrogate >= 0xDC00 && low_surrogate < 0xE000) {
+					code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low_surrogate - 0xDC00);
+					reader.pointer += 6;
+				}
+			}
+			write += EncodeUtf8((unsigned int)code_point, write);
+			break;
+		}
+		default:
+			return false;
+		}
+	}
+	return false;
+}
+
+// Skips a value without decoding it. The brackets of the nested values are only counted, not matched
+static bool SkipJsonValue(JsonReader& reader) {
+	SkipJsonWhitespace(reader);
+	const char* start = reader.pointer;
+	unsigned int depth = 0;
+	while (reader.pointer < reader.end) {
+		char character = *reader.pointer;
+		if (character == '"') {
+			reader.pointer++;
+			while (reader.pointer < reader.end && *reader.pointer != '"') {
+				reader.pointer += *reader.pointer == '\\' ? 2 : 1;
+			}
+			if (reader.pointer >= reader.end) {
+				return false;
+			}
+		}
+		else if (character == '[' || character == '{') {
+			depth++;
+		}
+		else if (character == ']' || character == '}' || character == ',' || IsJsonWhitespace(character)) {
+			if (depth == 0) {
+				// The end of a number or a literal
+				return reader.pointer > start;
+			}
+			if (character == ']' || character == '}') {
+				depth--;
+			}
+		}
+		reader.pointer++;
+		if (depth == 0 && (character == '"' || character == ']' || character == '}')) {
+			return true;
+		}
+	}
+	return depth == 0 && reader.pointer > start;
+}
+
+// Splits the command line like a POSIX shell does, without the expansions. The arguments are unquoted in place
+static void SplitCommandLine(Stream<char> command, ResizableStream<Stream<char>>& arguments) {
+	char* read = command.buffer;
+	char* end = command.buffer + command.size;
+	while (true) {
+		while (read < end && IsJsonWhitespace(*read)) {
+			read++;
+		}
+		if (read == end) {
+			return;
+		}
+
+		char* write = read;
+		Stream<char> argument = { write, 0 };
+		char quote = '\0';
+		while (read < end && (quote != '\0' || !IsJsonWhitespace(*read))) {
+			char character = *read++;
+			if (quote == '\'') {
+				if (character == '\'') {
+					quote = '\0';
+				}
+				else {
+					*write++ = character;
+				}
+			}
+			else if (character == '\\' && read < end && (quote == '\0' || *read == '"' || *read == '\\')) {
+				*write++ = *read++;
+			}
+			else if (quote == '"' && character == '"') {
+				quote = '\0';
+			}
+			else if (quote == '\0' && (character == '"' || character == '\'')) {
+				quote = character;
+			}
+			else {
+				*write++ = character;
+			}
+		}
+		argument.size = write - argument.buffer;
+		arguments.Add(argument);
+	}
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+// A path that can't be normalized is copied as it is
+static Stream<char> ResolveCommandPath(Arena& arena, Stream<char> directory, Stream<char> path) {
+	CORE_STACK_CAPACITY_STREAM(char, normalized, COMPILE_COMMANDS_PATH_CAPACITY);
+	return arena.StringCopy(function::JoinPath(directory, path, normalized) ? Stream<char>(normalized) : path);
+}
+
+// The keys of the index are the files. It is rebuilt when it is full, together with the files such that their
+// buffer doesn't move until the next rebuild
+static void EnsureIndexCapacity(CompileCommands* commands, unsigned int file_count) {
+	if (file_count <= commands->index_capacity) {
+		return;
+	}
+
+	unsigned int capacity = std::max(std::max(file_count, commands->index_capacity * 2), (unsigned int)COMPILE_COMMANDS_INITIAL_INDEX_CAPACITY);
+	free(commands->index_buffer);
+	commands->index_buffer = malloc(ConcurrentHashTable::MemoryOf(capacity));
+	commands->index_capacity = capacity;
+	if (commands->files.capacity < capacity) {
+		commands->files.Resize(capacity);
+	}
+	commands->index.Initialize(commands->index_buffer, capacity, commands->files.buffer);
+	for (unsigned int index = 0; index < commands->files.size; index++) {
+		commands->index.Insert(index);
+	}
+}
+
+// Returns false if the file is already listed
+static bool AddCompileCommandsFile(CompileCommands* commands, Stream<char> path) {
+	EnsureIndexCapacity(commands, commands->files.size + 1);
+	unsigned int file_index = commands->files.size;
+	commands->files.Add(path);
+	if (commands->index.Insert(file_index) != file_index) {
+		commands->files.size--;
+		return false;
+	}
+	return true;
+}
+
+// The reader must be at the opening brace. The arguments are a scratch buffer
+static bool ReadCompileCommand(JsonReader& reader, CompileCommands* commands, ResizableStream<Stream<char>>& arguments) {
+	if (!ReadJsonCharacter(reader, '{')) {
+		return false;
+	}
+
+	Stream<char> directory = { nullptr, 0 };
+	Stream<char> file = { nullptr, 0 };
+	Stream<char> command = { nullptr, 0 };
+	arguments.size = 0;
+	if (!ReadJsonCharacter(reader, '}')) {
+		do {
+			Stream<char> key;
+			if (!IsJsonNext(reader, '"') || !ReadJsonString(reader, key) || !ReadJsonCharacter(reader, ':')) {
+				return false;
+			}
+
+			bool is_string = IsJsonNext(reader, '"');
+			bool success = true;
+			if (is_string && key == "directory") {
+				success = ReadJsonString(reader, directory);
+			}
+			else if (is_string && key == "file") {
+				success = ReadJsonString(reader, file);
+			}
+			else if (is_string && key == "command") {
+				success = ReadJsonString(reader, command);
+			}
+			else if (key == "arguments" && ReadJsonCharacter(reader, '[')) {
+				if (!ReadJsonCharacter(reader, ']')) {
+					do {
+						Stream<char> argument;
+						if (!IsJsonNext(reader, '"') || !ReadJsonString(reader, argument)) {
+							return false;
+						}
+						arguments.Add(argument);
+					} while (ReadJsonCharacter(reader, ','));
+					success = ReadJsonCharacter(reader, ']');
+				}
+			}
+			else {
+				success = SkipJsonValue(reader);
+			}
+			if (!success) {
+				return false;
+			}
+		} while (ReadJsonCharacter(reader, ','));
+
+		if (!ReadJsonCharacter(reader, '}')) {
+			return false;
+		}
+	}
+	if (file.size == 0) {
+		return false;
+	}
+
+	// The arguments are preferred, the command is split only when they are missing
+	if (arguments.size == 0 && command.size > 0) {
+		SplitCommandLine(command, arguments);
+	}
+	if (!AddCompileCommandsFile(commands, ResolveCommandPath(commands->arena, directory, file))) {
+		return true;
+	}
+
+	unsigned int directory_offset = commands->directories.size;
+	commands->file_units.Add(commands->translation_unit_count++);
+	commands->directory_offsets.Add(directory_offset);
+	for (unsigned int index = 0; index < arguments.size; index++) {
+		Stream<char> argument = arguments[index];
+		for (size_t flag_index = 0; flag_index < std::size(COMPILE_COMMANDS_INCLUDE_FLAGS); flag_index++) {
+			const CompileCommandsIncludeFlag& flag = COMPILE_COMMANDS_INCLUDE_FLAGS[flag_index];
+			size_t flag_size = strlen(flag.flag);
+			if (argument.size < flag_size || memcmp(argument.buffer, flag.flag, flag_size) != 0) {
+				continue;
+			}
+
+			Stream<char> path = { argument.buffer + flag_size, argument.size - flag_size };
+			if (path.size == 0 && index + 1 < arguments.size) {
+				path = arguments[++index];
+			}
+			if (path.size > 0) {
+				commands->directories.Add({ ResolveCommandPath(commands->arena, directory, path), flag.kind });
+			}
+			break;
+		}
+	}
+	// The quoted includes search the -iquote directories first, then all of them search -I, -isystem and -idirafter
+	std::stable_sort(commands->directories.buffer + directory_offset, commands->directories.buffer + commands->directories.size,
+		[](const CompileCommandsDirectory& first, const CompileCommandsDirectory& second) {
+			return first.kind < second.kind;
+		}
+	);
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+struct CompileCommandsScanRange {
+	unsigned int thread_id;
+	unsigned int offset;
+	unsigned int count;
+};
+
+struct CompileCommandsScanData {
+	CompileCommands* commands;
+	unsigned int round_start;
+	unsigned int round_end;
+	std::atomic<unsigned int> next_file;
+	// The headers found by each thread, in the order in which the thread scanned its files
+	ResizableStream<Stream<char>>* thread_headers;
+	// Indexed by the file minus the round start
+	CompileCommandsScanRange* file_ranges;
+	size_t* thread_unresolved_counts;
+};
+
+// The path is normalized and looked up among the known files first, the file system is asked only for the new
+// ones, which are copied into the arena. Returns false if the file doesn't exist
+static bool FindIncludeCandidate(const CompileCommands* commands, Stream<char> directory, Stream<char> spelling, Arena* arena, Stream<char>& found) {
+	CORE_STACK_CAPACITY_STREAM(char, candidate, COMPILE_COMMANDS_PATH_CAPACITY);
+	CORE_STACK_CAPACITY_STREAM(char, normalized, COMPILE_COMMANDS_PATH_CAPACITY);
+	if (directory.size + 1 + spelling.size > candidate.capacity) {
+		return false;
+	}
+	candidate.AddStream(directory);
+	if (directory.size > 0) {
+		candidate.Add('/');
+	}
+	candidate.AddStream(spelling);
+	if (!function::NormalizePath(candidate, normalized)) {
+		return false;
+	}
+
+	unsigned int file_index = commands->index.Find(normalized);
+	if (file_index != CORE_HASH_TABLE_NOT_FOUND) {
+		found = commands->files[file_index];
+		return true;
+	}
+	if (!normalized.AddSafe('\0') || !IsRegularFile(normalized)) {
+		return false;
+	}
+	normalized.size--;
+	found = arena->StringCopy(normalized);
+	return true;
+}
+
+CORE_THREAD_TASK(ScanCompileCommandsIncludes) {
+	CompileCommandsScanData* data = (CompileCommandsScanData*)_data;
+	const CompileCommands* commands = data->commands;
+	ResizableStream<Stream<char>>* headers = data->thread_headers + thread_id;
+	Arena* arena = commands->thread_arenas + thread_id;
+
+	while (true) {
+		// Reading a file costs much more than taking it from the shared counter
+		unsigned int file_index = data->next_file.fetch_add(1, CORE_RELAXED);
+		if (file_index >= data->round_end) {
+			return;
+		}
+		CompileCommandsScanRange* range = data->file_ranges + (file_index - data->round_start);
+		*range = { thread_id, headers->size, 0 };
+
+		// A file that can't be read is reported by the count
+		Stream<char> path = commands->files[file_index];
+		Stream<char> content = ReadWholeFileText(path);
+		if (content.buffer == nullptr) {
+			continue;
+		}
+
+		unsigned int unit = commands->file_units[file_index];
+		unsigned int directory_offset = commands->directory_offsets[unit];
+		unsigned int directory_count = commands->directory_offsets[unit + 1] - directory_offset;
+		const CompileCommandsDirectory* directories = commands->directories.buffer + directory_offset;
+		Stream<char> file_directory = { path.buffer, 0 };
+		for (size_t index = path.size; index > 0; index--) {
+			if (path[index - 1] == '/') {
+				file_directory.size = index - 1;
+				break;
+			}
+		}
+
+		const char* current = content.buffer;
+		Stream<char> spelling;
+		bool angled;
+		while (NextIncludeDirective(content, current, spelling, angled)) {
+			Stream<char> header;
+			bool is_found = false;
+			if (spelling[0] == '/') {
+				is_found = FindIncludeCandidate(commands, { nullptr, 0 }, spelling, arena, header);
+			}
+			else {
+				is_found = !angled && FindIncludeCandidate(commands, file_directory, spelling, arena, header);
+				for (unsigned int index = 0; index < directory_count && !is_found; index++) {
+					if (!angled || directories[index].kind != COMPILE_COMMANDS_DIRECTORY_QUOTE) {
+						is_found = FindIncludeCandidate(commands, directories[index].path, spelling, arena, header);
+					}
+				}
+			}
+
+			if (is_found) {
+				headers->Add(header);
+			}
+			else {
+				data->thread_unresolved_counts[thread_id]++;
+			}
+		}
+		free(content.buffer);
+		range->count = headers->size - range->offset;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+CompileCommands::CompileCommands() : translation_unit_count(0), unresolved_count(0), index_buffer(nullptr), index_capacity(0),
+	mapping({ nullptr, 0 }), thread_arenas(nullptr), thread_arena_count(0) {}
+
+CompileCommands::~CompileCommands() {
+	Release();
+	files.FreeBuffer();
+	file_units.FreeBuffer();
+	directory_offsets.FreeBuffer();
+	directories.FreeBuffer();
+	delete[] thread_arenas;
+}
+
+void CompileCommands::Release() {
+	UnmapFile(mapping);
+	mapping = { nullptr, 0 };
+	free(index_buffer);
+	index_buffer = nullptr;
+	index_capacity = 0;
+	files.size = 0;
+	file_units.size = 0;
+	directory_offsets.size = 0;
+	directories.size = 0;
+	translation_unit_count = 0;
+	unresolved_count = 0;
+	arena.Clear();
+	for (unsigned int index = 0; index < thread_arena_count; index++) {
+		thread_arenas[index].Clear();
+	}
+}
+
+bool CompileCommands::Load(Stream<char> path, CapacityStream<char>* error_message) {
+	Release();
+	mapping = MapFilePrivate(path);
+	if (mapping.buffer == nullptr) {
+		CORE_FORMAT_STRING(*error_message, "Could not open the compilation database {#}.\n", path);
+		return false;
+	}
+
+	JsonReader reader = { mapping.buffer, mapping.buffer + mapping.size };
+	ResizableStream<Stream<char>> arguments;
+	bool success = ReadJsonCharacter(reader, '[');
+	if (success && !ReadJsonCharacter(reader, ']')) {
+		do {
+			success = ReadCompileCommand(reader, this, arguments);
+		} while (success && ReadJsonCharacter(reader, ','));
+		success = success && ReadJsonCharacter(reader, ']');
+	}
+	arguments.FreeBuffer();
+
+	// The offsets of the last unit end at the last directory
+	directory_offsets.Add(directories.size);
+	if (!success) {
+		CORE_FORMAT_STRING(*error_message, "The compilation database {#} is not an array of command objects, the error is at byte {#}.\n",
+			path, (size_t)(reader.pointer - mapping.buffer));
+		Release();
+		return false;
+	}
+	return true;
+}
+
+void CompileCommands::ResolveIncludes(ThreadPool& thread_pool) {
+	unsigned int thread_count = thread_pool.GetThreadCount();
+	if (thread_arena_count != thread_count) {
+		delete[] thread_arenas;
+		thread_arenas = new Arena[thread_count];
+		thread_arena_count = thread_count;
+	}
+
+	CompileCommandsScanData data;
+	data.commands = this;
+	data.thread_headers = new ResizableStream<Stream<char>>[thread_count];
+	data.thread_unresolved_counts = (size_t*)calloc(thread_count, sizeof(size_t));
+	data.file_ranges = nullptr;
+	unsigned int file_range_capacity = 0;
+
+	// Each round scans the files that the previous one found. The headers are added in the order of the files that
+	// include them, such that the result doesn't depend on the scheduling of the threads
+	unsigned int round_start = 0;
+	while (round_start < files.size) {
+		data.round_start = round_start;
+		data.round_end = files.size;
+		data.next_file.store(round_start, CORE_RELAXED);
+		if (file_range_capacity < data.round_end - round_start) {
+			file_range_capacity = data.round_end - round_start;
+			free(data.file_ranges);
+			data.file_ranges = (CompileCommandsScanRange*)malloc(sizeof(CompileCommandsScanRange) * file_range_capacity);
+		}
+		for (unsigned int index = 0; index < thread_count; index++) {
+			data.thread_headers[index].size = 0;
+		}
+		thread_pool.Run(ScanCompileCommandsIncludes, &data);
+
+		for (unsigned int file_index = data.round_start; file_index < data.round_end; file_index++) {
+			CompileCommandsScanRange range = data.file_ranges[file_index - data.round_start];
+			const Stream<char>* headers = data.thread_headers[range.thread_id].buffer + range.offset;
+			for (unsigned int index = 0; index < range.count; index++) {
+				if (AddCompileCommandsFile(this, headers[index])) {
+					file_units.Add(file_units[file_index]);
+				}
+			}
+		}
+		round_start = data.round_end;
+	}
+
+	for (unsigned int index = 0; index < thread_count; index++) {
+		unresolved_count += data.thread_unresolved_counts[index];
+		data.thread_headers[index].FreeBuffer();
+	}
+	delete[] data.thread_headers;
+	free(data.thread_unresolved_counts);
+	free(data.file_ranges);
+}
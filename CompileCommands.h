@@ -0,0 +1,72 @@
+#pragma once
+#include "Core/Core.h"
+
+using namespace Core;
+
+enum COMPILE_COMMANDS_DIRECTORY_KIND : unsigned char {
+	// -iquote, searched only for the quoted includes
+	COMPILE_COMMANDS_DIRECTORY_QUOTE,
+	// -I
+	COMPILE_COMMANDS_DIRECTORY_ANGLED,
+	// -isystem
+	COMPILE_COMMANDS_DIRECTORY_SYSTEM,
+	// -idirafter
+	COMPILE_COMMANDS_DIRECTORY_AFTER
+};
+
+struct CompileCommandsDirectory {
+	Stream<char> path;
+	COMPILE_COMMANDS_DIRECTORY_KIND kind;
+};
+
+// The files that a compilation database, compile_commands.json, compiles. The database is mapped privately and
+// read in a single pass by a streaming JSON reader: the strings are unescaped in place, only the directory, file,
+// arguments and command members are looked at and the other values are skipped without being decoded. The relative
+// paths are resolved against the directory of their command and normalized, a translation unit that is listed
+// several times, with different flags, is kept once. The include directories are taken from the -I, -iquote,
+// -isystem and -idirafter flags. The headers are found by reading the files round by round on a thread pool,
+// each round scans the files that the previous one found. The directives are resolved like the compiler does,
+// relative to the including file for the quoted ones and then in the include directories of the translation unit
+// that reached the file first, and they are checked on disk. The directories that the compiler adds on its own
+// are not known, so the standard library headers are left out unless they are given with -isystem
+struct CompileCommands {
+	CompileCommands();
+	~CompileCommands();
+
+	CompileCommands(const CompileCommands& other) = delete;
+	CompileCommands& operator = (const CompileCommands& other) = delete;
+
+	// Returns false if the database could not be mapped or is not an array of command objects, the error
+	// message says why. The previous files are released
+	bool Load(Stream<char> path, CapacityStream<char>* error_message);
+
+	// Appends the headers that the translation units include, directly or transitively. The directives of the
+	// disabled preprocessor branches are followed as well
+	void ResolveIncludes(ThreadPool& thread_pool);
+
+	void Release();
+
+	// The translation units come first, in the order of the database, and then the headers in the order they were found
+	ResizableStream<Stream<char>> files;
+	unsigned int translation_unit_count;
+	// The directives that name no file on disk, after ResolveIncludes
+	size_t unresolved_count;
+
+	// Indexed by file, the translation unit whose include directories are searched for its directives
+	ResizableStream<unsigned int> file_units;
+	// The include directories of a translation unit are [directory_offsets[unit], directory_offsets[unit + 1]),
+	// sorted by kind in the order of the search
+	ResizableStream<unsigned int> directory_offsets;
+	ResizableStream<CompileCommandsDirectory> directories;
+
+	// From the paths to the file indices, grown together with the files
+	ConcurrentHashTable index;
+	void* index_buffer;
+	unsigned int index_capacity;
+
+	Stream<char> mapping;
+	Arena arena;
+	// The headers found by each thread of the last ResolveIncludes
+	Arena* thread_arenas;
+	unsigned int thread_arena_count;
+};
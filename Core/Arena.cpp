@@ -0,0 +1,74 @@
+#include "Arena.h"
+#include "StringUtilities.h"
+
+#include <algorithm>
+
+#define ARENA_CHUNK_SIZE (CORE_MB * 4)
+
+namespace Core {
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	void* Arena::Allocate(size_t size, size_t alignment) {
+		while (current_chunk < chunk_count) {
+			Chunk* chunk = chunks + current_chunk;
+			uintptr_t start = (uintptr_t)chunk->buffer + chunk->size;
+			size_t offset = function::AlignPointer(start, alignment) - (uintptr_t)chunk->buffer;
+			if (offset + size <= chunk->capacity) {
+				chunk->size = offset + size;
+				return function::OffsetPointer(chunk->buffer, offset);
+			}
+			current_chunk++;
+		}
+
+		if (chunk_count == chunk_capacity) {
+			unsigned int new_capacity = chunk_capacity == 0 ? 4 : chunk_capacity * 2;
+			chunks = (Chunk*)realloc(chunks, sizeof(Chunk) * new_capacity);
+			chunk_capacity = new_capacity;
+		}
+
+		size_t new_chunk_capacity = std::max((size_t)ARENA_CHUNK_SIZE, size + alignment);
+		Chunk* chunk = chunks + chunk_count;
+		chunk->buffer = malloc(new_chunk_capacity);
+		chunk->capacity = new_chunk_capacity;
+		size_t offset = function::AlignPointer((uintptr_t)chunk->buffer, alignment) - (uintptr_t)chunk->buffer;
+		chunk->size = offset + size;
+		current_chunk = chunk_count;
+		chunk_count++;
+		return function::OffsetPointer(chunk->buffer, offset);
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	void Arena::Clear() {
+		for (unsigned int index = 0; index < chunk_count; index++) {
+			chunks[index].size = 0;
+		}
+		current_chunk = 0;
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	void Arena::Free() {
+		for (unsigned int index = 0; index < chunk_count; index++) {
+			free(chunks[index].buffer);
+		}
+		free(chunks);
+		chunks = nullptr;
+		chunk_count = 0;
+		chunk_capacity = 0;
+		current_chunk = 0;
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	Stream<char> Arena::StringCopy(Stream<char> string) {
+		char* allocation = (char*)Allocate(string.size + 1, alignof(char));
+		memcpy(allocation, string.buffer, string.size);
+		allocation[string.size] = '\0';
+		return { allocation, string.size };
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+}
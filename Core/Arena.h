@@ -0,0 +1,42 @@
+#pragma once
+#include "Stream.h"
+
+namespace Core {
+
+	// Chunked bump allocator. Clear keeps the chunks around for the next use
+	struct Arena {
+		Arena() = default;
+		Arena(const Arena& other) = delete;
+		Arena& operator = (const Arena& other) = delete;
+
+		~Arena() {
+			Free();
+		}
+
+		void* Allocate(size_t size, size_t alignment = alignof(void*));
+
+		template<typename T>
+		T* Allocate(size_t count = 1) {
+			return (T*)Allocate(sizeof(T) * count, alignof(T));
+		}
+
+		void Clear();
+
+		void Free();
+
+		// The copy is null terminated
+		Stream<char> StringCopy(Stream<char> string);
+
+		struct Chunk {
+			void* buffer;
+			size_t size;
+			size_t capacity;
+		};
+
+		Chunk* chunks = nullptr;
+		unsigned int chunk_count = 0;
+		unsigned int chunk_capacity = 0;
+		unsigned int current_chunk = 0;
+	};
+
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Core {
+
+	// The classes are bit flags such that a character can belong to multiple classes
+	enum CHARACTER_CLASS : unsigned char {
+		CHARACTER_CLASS_IDENTIFIER = 1 << 0,
+		// Spaces, tabs, \r, \v and \f. New lines are not included
+		CHARACTER_CLASS_WHITESPACE = 1 << 1,
+		// The first characters of the control keywords. Used only to filter the keyword candidates
+		CHARACTER_CLASS_KEYWORD_START = 1 << 2,
+		CHARACTER_CLASS_COUNT = 3
+	};
+
+	struct CharacterClassTable {
+		constexpr unsigned char operator[](char character) const {
+			return classes[(unsigned char)character];
+		}
+
+		constexpr bool Is(char character, CHARACTER_CLASS character_class) const {
+			return (classes[(unsigned char)character] & character_class) != 0;
+		}
+
+		constexpr void AddRange(char first, char last, CHARACTER_CLASS character_class) {
+			for (unsigned int index = (unsigned char)first; index <= (unsigned char)last; index++) {
+				classes[index] |= character_class;
+			}
+		}
+
+		constexpr void Add(const char* characters, CHARACTER_CLASS character_class) {
+			for (; *characters != '\0'; characters++) {
+				classes[(unsigned char)*characters] |= character_class;
+			}
+		}
+
+		unsigned char classes[256];
+	};
+
+	// The table used by the C family of languages. Another language needs only its own constexpr table
+	constexpr CharacterClassTable MakeCCharacterClassTable() {
+		CharacterClassTable table = {};
+		table.AddRange('a', 'z', CHARACTER_CLASS_IDENTIFIER);
+		table.AddRange('A', 'Z', CHARACTER_CLASS_IDENTIFIER);
+		table.AddRange('0', '9', CHARACTER_CLASS_IDENTIFIER);
+		table.Add("_", CHARACTER_CLASS_IDENTIFIER);
+		table.Add(" \t\r\v\f", CHARACTER_CLASS_WHITESPACE);
+		// if, else, for, while, do, switch, case, default, try and catch
+		table.Add("iefwdsct", CHARACTER_CLASS_KEYWORD_START);
+		return table;
+	}
+
+	inline constexpr CharacterClassTable C_CHARACTER_CLASSES = MakeCCharacterClassTable();
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	// The vectorized form of a table, for pshufb style lookups. A byte belongs to a class if
+	// (low[byte & 0xF] & high[byte >> 4] & class_bits[class_index]) != 0. Each class gets a bit for
+	// every distinct set of low nibbles among its high nibble rows, which makes the lookup exact
+	struct NibbleLookupTable {
+		// The bits to test after the lookup for a single class
+		constexpr unsigned char Bits(CHARACTER_CLASS character_class) const {
+			unsigned int class_index = 0;
+			while ((1 << class_index) != character_class) {
+				class_index++;
+			}
+			return class_bits[class_index];
+		}
+
+		unsigned char low[16];
+		unsigned char high[16];
+		unsigned char class_bits[CHARACTER_CLASS_COUNT];
+		// False when the classes need more than 8 bits
+		bool valid;
+	};
+
+	constexpr NibbleLookupTable MakeNibbleLookupTable(const CharacterClassTable& table) {
+		NibbleLookupTable lookup = {};
+		lookup.valid = true;
+		unsigned int next_bit = 0;
+		for (unsigned int class_index = 0; class_index < CHARACTER_CLASS_COUNT; class_index++) {
+			unsigned char character_class = (unsigned char)(1 << class_index);
+
+			uint16_t row_bit_patterns[8] = {};
+			unsigned int row_bit_count = 0;
+			for (unsigned int high = 0; high < 16; high++) {
+				uint16_t row = 0;
+				for (unsigned int low = 0; low < 16; low++) {
+					if (table.classes[high * 16 + low] & character_class) {
+						row |= (uint16_t)(1 << low);
+					}
+				}
+				if (row == 0) {
+					continue;
+				}
+
+				unsigned int pattern_index = 0;
+				while (pattern_index < row_bit_count && row_bit_patterns[pattern_index] != row) {
+					pattern_index++;
+				}
+				if (pattern_index == row_bit_count) {
+					if (next_bit == 8) {
+						lookup.valid = false;
+						return lookup;
+					}
+					row_bit_patterns[row_bit_count++] = row;
+					unsigned char bit = (unsigned char)(1 << next_bit++);
+					lookup.class_bits[class_index] |= bit;
+					for (unsigned int low = 0; low < 16; low++) {
+						if (row & (1 << low)) {
+							lookup.low[low] |= bit;
+						}
+					}
+				}
+				// The bit of this row pattern is the one allocated in the order of the patterns
+				unsigned char class_bits = lookup.class_bits[class_index];
+				for (unsigned int skip = 0; skip < pattern_index; skip++) {
+					class_bits &= class_bits - 1;
+				}
+				lookup.high[high] |= class_bits & (unsigned char)-class_bits;
+			}
+		}
+		return lookup;
+	}
+
+	// Verifies that the lookup gives the same classes as the table for all the bytes
+	constexpr bool IsNibbleLookupTableExact(const CharacterClassTable& table, const NibbleLookupTable& lookup) {
+		if (!lookup.valid) {
+			return false;
+		}
+		for (unsigned int byte = 0; byte < 256; byte++) {
+			unsigned char bits = lookup.low[byte & 0xF] & lookup.high[byte >> 4];
+			for (unsigned int class_index = 0; class_index < CHARACTER_CLASS_COUNT; class_index++) {
+				bool in_lookup = (bits & lookup.class_bits[class_index]) != 0;
+				bool in_table = (table.classes[byte] & (1 << class_index)) != 0;
+				if (in_lookup != in_table) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	inline constexpr NibbleLookupTable C_CHARACTER_CLASSES_NIBBLE_LOOKUP = MakeNibbleLookupTable(C_CHARACTER_CLASSES);
+	static_assert(IsNibbleLookupTableExact(C_CHARACTER_CLASSES, C_CHARACTER_CLASSES_NIBBLE_LOOKUP), "The C character classes can't be looked up by nibbles");
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "Stream.h"
+#include "StringUtilities.h"
+
+#include <new>
+
+#define CORE_HASH_TABLE_NOT_FOUND ((unsigned int)-1)
+
+namespace Core {
+
+	// Lock-free open addressing table from string keys to indices, with a fixed capacity. The keys are not
+	// stored in the table, a value is the index of its key in an array that the caller owns. Each slot packs
+	// the upper half of the hash next to the value, such that a single compare exchange publishes both and
+	// the probes only compare the keys when the tags match. The insertions can be made concurrently from any
+	// thread and the lookups can run concurrently with them. When a key is inserted twice the first value is kept
+	struct ConcurrentHashTable {
+		// The slot count is a power of two at least twice the element count
+		static size_t MemoryOf(unsigned int element_count) {
+			return sizeof(std::atomic<uint64_t>) * GetSlotCount(element_count);
+		}
+
+		static unsigned int GetSlotCount(unsigned int element_count) {
+			unsigned int slot_count = 16;
+			while (slot_count < element_count * 2) {
+				slot_count *= 2;
+			}
+			return slot_count;
+		}
+
+		// The buffer must have MemoryOf(element_count) bytes. The key of a value must be written before
+		// the value is inserted
+		void Initialize(void* buffer, unsigned int element_count, const Stream<char>* _keys) {
+			unsigned int slot_count = GetSlotCount(element_count);
+			slots = (std::atomic<uint64_t>*)buffer;
+			for (unsigned int index = 0; index < slot_count; index++) {
+				new (slots + index) std::atomic<uint64_t>(EMPTY_SLOT);
+			}
+			slot_mask = slot_count - 1;
+			keys = _keys;
+		}
+
+		// Returns the value that is kept for the key, the given one or the one that was inserted first
+		unsigned int Insert(unsigned int value, uint64_t hash) {
+			uint64_t entry = (hash & HASH_TAG_MASK) | value;
+			unsigned int slot = (unsigned int)hash & slot_mask;
+			while (true) {
+				uint64_t expected = EMPTY_SLOT;
+				if (slots[slot].compare_exchange_strong(expected, entry, CORE_RELEASE, CORE_ACQUIRE)) {
+					return value;
+				}
+				if (((expected ^ entry) & HASH_TAG_MASK) == 0 && keys[(unsigned int)expected] == keys[value]) {
+					return (unsigned int)expected;
+				}
+				slot = (slot + 1) & slot_mask;
+			}
+		}
+
+		unsigned int Insert(unsigned int value) {
+			return Insert(value, function::HashString(keys[value]));
+		}
+
+		// Returns CORE_HASH_TABLE_NOT_FOUND if the key was not inserted
+		unsigned int Find(Stream<char> key, uint64_t hash) const {
+			uint64_t tag = hash & HASH_TAG_MASK;
+			unsigned int slot = (unsigned int)hash & slot_mask;
+			while (true) {
+				uint64_t entry = slots[slot].load(CORE_ACQUIRE);
+				if (entry == EMPTY_SLOT) {
+					return CORE_HASH_TABLE_NOT_FOUND;
+				}
+				if ((entry & HASH_TAG_MASK) == tag && keys[(unsigned int)entry] == key) {
+					return (unsigned int)entry;
+				}
+				slot = (slot + 1) & slot_mask;
+			}
+		}
+
+		unsigned int Find(Stream<char> key) const {
+			return Find(key, function::HashString(key));
+		}
+
+		// The value bits of an empty slot are CORE_HASH_TABLE_NOT_FOUND, which is never inserted
+		static const uint64_t EMPTY_SLOT = ~0ull;
+		static const uint64_t HASH_TAG_MASK = 0xFFFFFFFF00000000ull;
+
+		std::atomic<uint64_t>* slots;
+		unsigned int slot_mask;
+		const Stream<char>* keys;
+	};
+
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "Stream.h"
+#include "CharacterClass.h"
+#include "StringUtilities.h"
+#include "Format.h"
+#include "File.h"
+#include "Arena.h"
+#include "Multithreading.h"
+#include "ConcurrentHashTable.h"
+#include "Timer.h"
@@ -0,0 +1,407 @@
+#include "File.h"
+#include "Format.h"
+#include "StringUtilities.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+namespace Core {
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	static FILE_STATUS_FLAGS StatusFromErrno(int error) {
+		switch (error) {
+		case ENOENT:
+		case ENOTDIR:
+			return FILE_STATUS_NOT_FOUND;
+		case EACCES:
+		case EPERM:
+			return FILE_STATUS_ACCESS_DENIED;
+		default:
+			return FILE_STATUS_ERROR;
+		}
+	}
+
+	static FILE_STATUS_FLAGS OpenFileImpl(Stream<char> path, FILE_HANDLE* handle, int flags, CapacityStream<char>* error_message) {
+		int descriptor = open(path.buffer, flags | O_CLOEXEC, 0644);
+		if (descriptor == -1) {
+			int error = errno;
+			if (error_message != nullptr) {
+				CORE_FORMAT_STRING(*error_message, "Opening file {#} failed: {#}.", path, strerror(error));
+			}
+			return StatusFromErrno(error);
+		}
+		*handle = descriptor;
+		return FILE_STATUS_OK;
+	}
+
+	static int GetOpenFlags(FILE_ACCESS_FLAGS access_flags) {
+		int flags = O_RDONLY;
+		if (access_flags & FILE_ACCESS_WRITE_ONLY) {
+			flags = O_WRONLY;
+		}
+		else if (access_flags & FILE_ACCESS_READ_WRITE) {
+			flags = O_RDWR;
+		}
+		if (access_flags & FILE_ACCESS_TRUNCATE_FILE) {
+			flags |= O_TRUNC;
+		}
+		if (access_flags & FILE_ACCESS_APPEND) {
+			flags |= O_APPEND;
+		}
+		return flags;
+	}
+
+	FILE_STATUS_FLAGS OpenFile(Stream<char> path, FILE_HANDLE* handle, FILE_ACCESS_FLAGS access_flags, CapacityStream<char>* error_message) {
+		FILE_STATUS_FLAGS status = OpenFileImpl(path, handle, GetOpenFlags(access_flags), error_message);
+		if (status == FILE_STATUS_OK && (access_flags & FILE_ACCESS_OPTIMIZE_SEQUENTIAL)) {
+			posix_fadvise(*handle, 0, 0, POSIX_FADV_SEQUENTIAL);
+		}
+		return status;
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	FILE_STATUS_FLAGS FileCreate(Stream<char> path, FILE_HANDLE* handle, FILE_ACCESS_FLAGS access_flags, CapacityStream<char>* error_message) {
+		return OpenFileImpl(path, handle, GetOpenFlags(access_flags) | O_CREAT, error_message);
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	void CloseFile(FILE_HANDLE handle) {
+		close(handle);
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	size_t ReadFromFile(FILE_HANDLE handle, Stream<char> buffer) {
+		size_t total = 0;
+		while (total < buffer.size) {
+			ssize_t count = read(handle, buffer.buffer + total, buffer.size - total);
+			if (count == 0) {
+				break;
+			}
+			if (count < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return CORE_FILE_SIZE_ERROR;
+			}
+			total += (size_t)count;
+		}
+		return total;
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	bool WriteFile(FILE_HANDLE handle, Stream<char> data) {
+		size_t total = 0;
+		while (total < data.size) {
+			ssize_t count = write(handle, data.buffer + total, data.size - total);
+			if (count < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+			total += (size_t)count;
+		}
+		return true;
+	}
+
+	bool WriteFileAt(FILE_HANDLE handle, Stream<char> data, size_t offset) {
+		size_t total = 0;
+		while (total < data.size) {
+			ssize_t count = pwrite(handle, data.buffer + total, data.size - total, (off_t)(offset + total));
+			if (count < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+			total += (size_t)count;
+		}
+		return true;
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	size_t GetFileByteSize(FILE_HANDLE handle) {
+		struct stat file_stat;
+		if (fstat(handle, &file_stat) != 0) {
+			return CORE_FILE_SIZE_ERROR;
+		}
+		return (size_t)file_stat.st_size;
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	bool ResizeFile(FILE_HANDLE handle, size_t size) {
+		return ftruncate(handle, (off_t)size) == 0;
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	bool FlushFileToDisk(FILE_HANDLE handle) {
+		return fdatasync(handle) == 0;
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	Stream<char> ReadWholeFileText(Stream<char> path) {
+		FILE_HANDLE handle = 0;
+		if (OpenFile(path, &handle, FILE_ACCESS_READ_ONLY) != FILE_STATUS_OK) {
+			return {};
+		}
+
+		size_t file_size = GetFileByteSize(handle);
+		if (file_size == CORE_FILE_SIZE_ERROR) {
+			CloseFile(handle);
+			return {};
+		}
+
+		char* buffer = (char*)malloc(file_size + 1);
+		size_t bytes_read = ReadFromFile(handle, { buffer, file_size });
+		CloseFile(handle);
+		if (bytes_read == CORE_FILE_SIZE_ERROR) {
+			free(buffer);
+			return {};
+		}
+		buffer[bytes_read] = '\0';
+		return { buffer, bytes_read };
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	Stream<char> MapFilePrivate(Stream<char> path) {
+		FILE_HANDLE handle = 0;
+		if (OpenFile(path, &handle, FILE_ACCESS_READ_ONLY) != FILE_STATUS_OK) {
+			return {};
+		}
+
+		size_t file_size = GetFileByteSize(handle);
+		void* mapping = MAP_FAILED;
+		if (file_size != CORE_FILE_SIZE_ERROR && file_size > 0) {
+			mapping = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, handle, 0);
+		}
+		// The mapping keeps its own reference to the file
+		CloseFile(handle);
+		if (mapping == MAP_FAILED) {
+			return {};
+		}
+		return { mapping, file_size };
+	}
+
+	void UnmapFile(Stream<char> mapping) {
+		if (mapping.buffer != nullptr) {
+			munmap(mapping.buffer, mapping.size);
+		}
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	bool GetFileIdentity(Stream<char> path, FileIdentity* identity) {
+		struct stat file_stat;
+		if (stat(path.buffer, &file_stat) != 0) {
+			return false;
+		}
+		*identity = { (uint64_t)file_stat.st_dev, (uint64_t)file_stat.st_ino };
+		return true;
+	}
+
+	bool IsRegularFile(Stream<char> path) {
+		struct stat file_stat;
+		return stat(path.buffer, &file_stat) == 0 && S_ISREG(file_stat.st_mode);
+	}
+
+	bool IsEmptyFile(Stream<char> path) {
+		struct stat file_stat;
+		return stat(path.buffer, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size == 0;
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	#define DIRECTORY_VISIT_SHARD_COUNT 64
+	#define DIRECTORY_VISIT_SHARD_INITIAL_CAPACITY 256
+
+	static uint64_t HashFileIdentity(FileIdentity identity) {
+		uint64_t hash = identity.inode ^ (identity.device * 0x9E3779B97F4A7C15ull);
+		hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+		hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+		return hash ^ (hash >> 31);
+	}
+
+	// The capacity is a power of two
+	static void InsertIntoSlots(FileIdentity* slots, unsigned int capacity, FileIdentity identity, uint64_t hash) {
+		unsigned int index = (unsigned int)(hash >> 6) & (capacity - 1);
+		while (slots[index].inode != 0) {
+			index = (index + 1) & (capacity - 1);
+		}
+		slots[index] = identity;
+	}
+
+	DirectoryVisitSet::DirectoryVisitSet() : repeated_count(0) {
+		shards = new Shard[DIRECTORY_VISIT_SHARD_COUNT];
+		for (unsigned int index = 0; index < DIRECTORY_VISIT_SHARD_COUNT; index++) {
+			shards[index].slots = (FileIdentity*)calloc(DIRECTORY_VISIT_SHARD_INITIAL_CAPACITY, sizeof(FileIdentity));
+			shards[index].count = 0;
+			shards[index].capacity = DIRECTORY_VISIT_SHARD_INITIAL_CAPACITY;
+		}
+	}
+
+	DirectoryVisitSet::~DirectoryVisitSet() {
+		for (unsigned int index = 0; index < DIRECTORY_VISIT_SHARD_COUNT; index++) {
+			free(shards[index].slots);
+		}
+		delete[] shards;
+	}
+
+	bool DirectoryVisitSet::Insert(FileIdentity identity) {
+		uint64_t hash = HashFileIdentity(identity);
+		Shard* shard = shards + (hash & (DIRECTORY_VISIT_SHARD_COUNT - 1));
+		std::lock_guard<std::mutex> guard(shard->lock);
+
+		unsigned int index = (unsigned int)(hash >> 6) & (shard->capacity - 1);
+		while (shard->slots[index].inode != 0) {
+			if (shard->slots[index] == identity) {
+				repeated_count.fetch_add(1, CORE_RELAXED);
+				return false;
+			}
+			index = (index + 1) & (shard->capacity - 1);
+		}
+
+		// Kept at most half full
+		if ((shard->count + 1) * 2 > shard->capacity) {
+			unsigned int new_capacity = shard->capacity * 2;
+			FileIdentity* new_slots = (FileIdentity*)calloc(new_capacity, sizeof(FileIdentity));
+			for (unsigned int slot_index = 0; slot_index < shard->capacity; slot_index++) {
+				if (shard->slots[slot_index].inode != 0) {
+					InsertIntoSlots(new_slots, new_capacity, shard->slots[slot_index], HashFileIdentity(shard->slots[slot_index]));
+				}
+			}
+			free(shard->slots);
+			shard->slots = new_slots;
+			shard->capacity = new_capacity;
+		}
+		InsertIntoSlots(shard->slots, shard->capacity, identity, hash);
+		shard->count++;
+		return true;
+	}
+
+	void DirectoryVisitSet::Clear() {
+		for (unsigned int index = 0; index < DIRECTORY_VISIT_SHARD_COUNT; index++) {
+			memset(shards[index].slots, 0, sizeof(FileIdentity) * shards[index].capacity);
+			shards[index].count = 0;
+		}
+		repeated_count.store(0, CORE_RELAXED);
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	static bool HasExtension(const char* name, size_t name_size, Stream<Stream<char>> extensions) {
+		for (size_t index = 0; index < extensions.size; index++) {
+			if (function::EndsWith({ name, name_size }, extensions[index])) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	enum FOR_EACH_RESULT : unsigned char {
+		FOR_EACH_CONTINUE,
+		FOR_EACH_STOPPED,
+		FOR_EACH_OPEN_FAILED
+	};
+
+	// The path buffer is reused for the whole recursion, each level appends its entry name
+	static FOR_EACH_RESULT ForEachFileRecursive(
+		CapacityStream<char>& path,
+		Stream<Stream<char>> extensions,
+		void* data,
+		ForEachFileFunctor functor,
+		DirectoryVisitSet* visited,
+		bool check_visited
+	) {
+		DIR* directory = opendir(path.buffer);
+		if (directory == nullptr) {
+			return FOR_EACH_OPEN_FAILED;
+		}
+
+		// The identity of the opened directory, not of the entry, such that mount points are handled
+		struct stat directory_stat;
+		if (check_visited && fstat(dirfd(directory), &directory_stat) == 0
+			&& !visited->Insert({ (uint64_t)directory_stat.st_dev, (uint64_t)directory_stat.st_ino })) {
+			closedir(directory);
+			return FOR_EACH_CONTINUE;
+		}
+
+		unsigned int base_size = path.size;
+		bool continue_iteration = true;
+		struct dirent* entry;
+		while (continue_iteration && (entry = readdir(directory)) != nullptr) {
+			const char* name = entry->d_name;
+			if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+				continue;
+			}
+
+			size_t name_size = strlen(name);
+			if (base_size + 1 + name_size + 1 > path.capacity) {
+				continue;
+			}
+
+			path.size = base_size;
+			if (path.size > 0 && path[path.size - 1] != '/') {
+				path.buffer[path.size++] = '/';
+			}
+			memcpy(path.buffer + path.size, name, name_size + 1);
+			path.size += (unsigned int)name_size;
+
+			unsigned char type = entry->d_type;
+			if (type == DT_UNKNOWN || type == DT_LNK) {
+				struct stat entry_stat;
+				if (stat(path.buffer, &entry_stat) != 0) {
+					continue;
+				}
+				type = S_ISDIR(entry_stat.st_mode) ? DT_DIR : (S_ISREG(entry_stat.st_mode) ? DT_REG : DT_UNKNOWN);
+			}
+
+			if (type == DT_DIR) {
+				// A directory that cannot be opened is skipped, only the functor can stop the iteration
+				continue_iteration = ForEachFileRecursive(path, extensions, data, functor, visited, visited != nullptr) != FOR_EACH_STOPPED;
+			}
+			else if (type == DT_REG && HasExtension(name, name_size, extensions)) {
+				continue_iteration = functor({ path.buffer, path.size }, data);
+			}
+		}
+
+		path.size = base_size;
+		path.buffer[base_size] = '\0';
+		closedir(directory);
+		return continue_iteration ? FOR_EACH_CONTINUE : FOR_EACH_STOPPED;
+	}
+
+	bool ForEachFileInDirectoryRecursiveWithExtension(
+		Stream<char> directory,
+		Stream<Stream<char>> extensions,
+		void* data,
+		ForEachFileFunctor functor,
+		DirectoryVisitSet* visited
+	) {
+		const size_t PATH_CAPACITY = 4096;
+		CORE_STACK_CAPACITY_STREAM(char, path, PATH_CAPACITY);
+		if (directory.size + 1 > PATH_CAPACITY) {
+			return false;
+		}
+		path.AddStream(directory);
+		path.buffer[path.size] = '\0';
+
+		return ForEachFileRecursive(path, extensions, data, functor, visited, false) == FOR_EACH_CONTINUE;
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+}
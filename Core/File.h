@@ -0,0 +1,135 @@
+#pragma once
+#include "Stream.h"
+
+#include <mutex>
+
+// Returned by ReadFromFile and GetFileByteSize when the call failed
+#define CORE_FILE_SIZE_ERROR ((size_t)-1)
+
+namespace Core {
+
+	typedef int FILE_HANDLE;
+
+	enum FILE_STATUS_FLAGS : unsigned char {
+		FILE_STATUS_OK,
+		FILE_STATUS_NOT_FOUND,
+		FILE_STATUS_ACCESS_DENIED,
+		FILE_STATUS_ERROR
+	};
+
+	enum FILE_ACCESS_FLAGS : unsigned int {
+		FILE_ACCESS_READ_ONLY = 1 << 0,
+		FILE_ACCESS_WRITE_ONLY = 1 << 1,
+		FILE_ACCESS_READ_WRITE = 1 << 2,
+		FILE_ACCESS_TRUNCATE_FILE = 1 << 3,
+		// Hints the kernel that the file is going to be read front to back
+		FILE_ACCESS_OPTIMIZE_SEQUENTIAL = 1 << 4,
+		// Every write goes to the end of the file
+		FILE_ACCESS_APPEND = 1 << 5
+	};
+
+	inline FILE_ACCESS_FLAGS operator | (FILE_ACCESS_FLAGS first, FILE_ACCESS_FLAGS second) {
+		return (FILE_ACCESS_FLAGS)((unsigned int)first | (unsigned int)second);
+	}
+
+	// The path must be null terminated. If the error message is given, the reason of the failure is appended to it
+	FILE_STATUS_FLAGS OpenFile(Stream<char> path, FILE_HANDLE* handle, FILE_ACCESS_FLAGS access_flags, CapacityStream<char>* error_message = nullptr);
+
+	// The path must be null terminated. The file is created or, if it exists, it is truncated
+	FILE_STATUS_FLAGS FileCreate(Stream<char> path, FILE_HANDLE* handle, FILE_ACCESS_FLAGS access_flags, CapacityStream<char>* error_message = nullptr);
+
+	void CloseFile(FILE_HANDLE handle);
+
+	// Reads at most buffer.size bytes. Returns CORE_FILE_SIZE_ERROR if an error occured
+	size_t ReadFromFile(FILE_HANDLE handle, Stream<char> buffer);
+
+	// Returns false if not all the data could be written
+	bool WriteFile(FILE_HANDLE handle, Stream<char> data);
+
+	// Writes at the given offset without moving the file position, such that several threads can write
+	// disjoint ranges of the same file. Returns false if not all the data could be written
+	bool WriteFileAt(FILE_HANDLE handle, Stream<char> data, size_t offset);
+
+	// Returns CORE_FILE_SIZE_ERROR if the size could not be determined
+	size_t GetFileByteSize(FILE_HANDLE handle);
+
+	// Cuts or extends the file to the given size. Returns false if it failed
+	bool ResizeFile(FILE_HANDLE handle, size_t size);
+
+	// Waits until the written data reaches the disk. Returns false if it failed
+	bool FlushFileToDisk(FILE_HANDLE handle);
+
+	// The returned buffer is allocated with malloc, it must be deallocated with free. It is null terminated.
+	// Returns { nullptr, 0 } if the file could not be read
+	Stream<char> ReadWholeFileText(Stream<char> path);
+
+	// Maps the whole file privately: it can be written, but the changes stay in this process and are not
+	// written back. Returns { nullptr, 0 } if the file could not be mapped or if it is empty
+	Stream<char> MapFilePrivate(Stream<char> path);
+
+	void UnmapFile(Stream<char> mapping);
+
+	// The same for all the paths that lead to a file, through symlinks or bind mounts
+	struct FileIdentity {
+		bool operator == (const FileIdentity& other) const {
+			return device == other.device && inode == other.inode;
+		}
+
+		uint64_t device;
+		uint64_t inode;
+	};
+
+	// The path must be null terminated. Symlinks are followed. Returns false if the file doesn't exist
+	bool GetFileIdentity(Stream<char> path, FileIdentity* identity);
+
+	// The path must be null terminated. Symlinks are followed. Returns false if it doesn't exist or is not a regular file
+	bool IsRegularFile(Stream<char> path);
+
+	// The path must be null terminated. Symlinks are followed. Returns true only for an existing regular file of 0 bytes
+	bool IsEmptyFile(Stream<char> path);
+
+	// Thread safe set of the directories that were visited. It is split into shards with their own lock,
+	// such that the threads that walk different subtrees rarely wait for each other
+	struct DirectoryVisitSet {
+		DirectoryVisitSet();
+		~DirectoryVisitSet();
+
+		DirectoryVisitSet(const DirectoryVisitSet& other) = delete;
+		DirectoryVisitSet& operator = (const DirectoryVisitSet& other) = delete;
+
+		// Returns false if the directory was already in the set
+		bool Insert(FileIdentity identity);
+
+		void Clear();
+
+		// The Insert calls that found the directory already there
+		std::atomic<size_t> repeated_count;
+
+		struct Shard {
+			std::mutex lock;
+			// Open addressing, an inode of 0 marks an empty slot
+			FileIdentity* slots;
+			unsigned int count;
+			unsigned int capacity;
+		};
+
+		Shard* shards;
+	};
+
+	// Return false from the functor to stop the iteration
+	typedef bool (*ForEachFileFunctor)(Stream<char> path, void* data);
+
+	// Calls the functor for each file inside the directory, recursively, whose name ends in one of the extensions.
+	// The path given to the functor is null terminated and valid only during the call.
+	// Returns false if the iteration was stopped by the functor or if the directory could not be opened.
+	// With a visit set, the subdirectories that are already in it are skipped and the others are added, which
+	// breaks the symlink loops and lets several walks share the work. The directory itself is not checked
+	bool ForEachFileInDirectoryRecursiveWithExtension(
+		Stream<char> directory,
+		Stream<Stream<char>> extensions,
+		void* data,
+		ForEachFileFunctor functor,
+		DirectoryVisitSet* visited = nullptr
+	);
+
+}
@@ -0,0 +1,92 @@
+#include "Format.h"
+
+namespace Core {
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	unsigned int ConvertIntToChars(char* buffer, uint64_t value) {
+		char digits[20];
+		unsigned int count = 0;
+		do {
+			digits[count++] = '0' + (char)(value % 10);
+			value /= 10;
+		} while (value != 0);
+
+		for (unsigned int index = 0; index < count; index++) {
+			buffer[index] = digits[count - 1 - index];
+		}
+		return count;
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	bool FormatStringImpl(CapacityStream<char>& destination, const char* format, Stream<FormatArgument> arguments) {
+		if (destination.capacity == 0) {
+			return false;
+		}
+
+		// Keep one character for the null terminator
+		unsigned int limit = destination.capacity - 1;
+		bool fits = true;
+		auto append = [&](const char* characters, size_t count) {
+			if (destination.size + count > limit) {
+				count = limit > destination.size ? limit - destination.size : 0;
+				fits = false;
+			}
+			memcpy(destination.buffer + destination.size, characters, count);
+			destination.size += (unsigned int)count;
+		};
+
+		size_t argument_index = 0;
+		const char* current = format;
+		while (*current != '\0') {
+			const char* placeholder = strstr(current, "{#}");
+			if (placeholder == nullptr) {
+				append(current, strlen(current));
+				break;
+			}
+
+			append(current, placeholder - current);
+			current = placeholder + 3;
+			if (argument_index == arguments.size) {
+				append("{#}", 3);
+				continue;
+			}
+
+			const FormatArgument& argument = arguments[argument_index++];
+			char number[64];
+			switch (argument.type) {
+			case FORMAT_ARGUMENT_SIGNED:
+			{
+				unsigned int offset = 0;
+				uint64_t value = (uint64_t)argument.signed_value;
+				if (argument.signed_value < 0) {
+					number[offset++] = '-';
+					value = 0 - value;
+				}
+				offset += ConvertIntToChars(number + offset, value);
+				append(number, offset);
+			}
+			break;
+			case FORMAT_ARGUMENT_UNSIGNED:
+				append(number, ConvertIntToChars(number, argument.unsigned_value));
+				break;
+			case FORMAT_ARGUMENT_DOUBLE:
+			{
+				int count = snprintf(number, sizeof(number), "%.2f", argument.double_value);
+				append(number, count > 0 ? (size_t)count : 0);
+			}
+			break;
+			case FORMAT_ARGUMENT_STRING:
+				append(argument.string_value.buffer, argument.string_value.size);
+				break;
+			}
+		}
+
+		destination.buffer[destination.size] = '\0';
+		return fits;
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+}
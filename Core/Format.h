@@ -0,0 +1,59 @@
+#pragma once
+#include "Stream.h"
+
+// Appends the formatted string to the capacity stream. Each {#} is replaced by the next argument
+#define CORE_FORMAT_STRING(stream, format, ...) Core::FormatString(stream, format, __VA_ARGS__)
+// Creates a stack capacity stream with the formatted string
+#define CORE_FORMAT_TEMP_STRING(name, format, ...) CORE_STACK_CAPACITY_STREAM(char, name, 512); Core::FormatString(name, format, __VA_ARGS__)
+
+namespace Core {
+
+	enum FORMAT_ARGUMENT_TYPE : unsigned char {
+		FORMAT_ARGUMENT_SIGNED,
+		FORMAT_ARGUMENT_UNSIGNED,
+		FORMAT_ARGUMENT_DOUBLE,
+		FORMAT_ARGUMENT_STRING
+	};
+
+	struct FormatArgument {
+		FormatArgument(int value) : type(FORMAT_ARGUMENT_SIGNED), signed_value(value) {}
+		FormatArgument(long value) : type(FORMAT_ARGUMENT_SIGNED), signed_value(value) {}
+		FormatArgument(long long value) : type(FORMAT_ARGUMENT_SIGNED), signed_value(value) {}
+		FormatArgument(unsigned int value) : type(FORMAT_ARGUMENT_UNSIGNED), unsigned_value(value) {}
+		FormatArgument(unsigned long value) : type(FORMAT_ARGUMENT_UNSIGNED), unsigned_value(value) {}
+		FormatArgument(unsigned long long value) : type(FORMAT_ARGUMENT_UNSIGNED), unsigned_value(value) {}
+		FormatArgument(double value) : type(FORMAT_ARGUMENT_DOUBLE), double_value(value) {}
+		FormatArgument(float value) : type(FORMAT_ARGUMENT_DOUBLE), double_value(value) {}
+		FormatArgument(const char* value) : type(FORMAT_ARGUMENT_STRING), string_value(value) {}
+		FormatArgument(char* value) : type(FORMAT_ARGUMENT_STRING), string_value(value) {}
+		FormatArgument(Stream<char> value) : type(FORMAT_ARGUMENT_STRING), string_value(value) {}
+		FormatArgument(CapacityStream<char> value) : type(FORMAT_ARGUMENT_STRING), string_value(value) {}
+
+		FORMAT_ARGUMENT_TYPE type;
+		union {
+			int64_t signed_value;
+			uint64_t unsigned_value;
+			double double_value;
+			Stream<char> string_value;
+		};
+	};
+
+	// Appends as much as it fits, it always leaves space for a null terminator which is written.
+	// Returns false if the result was truncated
+	bool FormatStringImpl(CapacityStream<char>& destination, const char* format, Stream<FormatArgument> arguments);
+
+	template<typename... Arguments>
+	bool FormatString(CapacityStream<char>& destination, const char* format, const Arguments&... arguments) {
+		FormatArgument format_arguments[] = { FormatArgument(arguments)... };
+		return FormatStringImpl(destination, format, { format_arguments, sizeof...(Arguments) });
+	}
+
+	inline bool FormatString(CapacityStream<char>& destination, const char* format) {
+		return FormatStringImpl(destination, format, {});
+	}
+
+	// Writes the decimal representation of the value and returns the number of characters written.
+	// The buffer must have at least 20 characters
+	unsigned int ConvertIntToChars(char* buffer, uint64_t value);
+
+}
@@ -0,0 +1,92 @@
+#include "Multithreading.h"
+
+#include <algorithm>
+
+namespace Core {
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	unsigned int ThreadPartitionStream(Stream<ThreadPartition> partitions, unsigned int count) {
+		unsigned int partition_count = (unsigned int)partitions.size;
+		unsigned int per_partition = count / partition_count;
+		unsigned int remainder = count % partition_count;
+
+		unsigned int offset = 0;
+		for (unsigned int index = 0; index < partition_count; index++) {
+			unsigned int size = per_partition + (index < remainder);
+			partitions[index] = { offset, size };
+			offset += size;
+		}
+
+		return per_partition > 0 ? partition_count : remainder;
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	ThreadPool::ThreadPool(unsigned int _thread_count) : function(nullptr), function_data(nullptr), generation(0), running_count(0), exit(false) {
+		thread_count = _thread_count == 0 ? std::max(std::thread::hardware_concurrency(), 1u) : _thread_count;
+		threads = new std::thread[thread_count];
+		for (unsigned int index = 0; index < thread_count; index++) {
+			threads[index] = std::thread([this, index]() {
+				ThreadLoop(index);
+			});
+		}
+	}
+
+	ThreadPool::~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			exit = true;
+		}
+		wake_condition.notify_all();
+
+		for (unsigned int index = 0; index < thread_count; index++) {
+			threads[index].join();
+		}
+		delete[] threads;
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	void ThreadPool::Run(ThreadFunction _function, void* data) {
+		std::unique_lock<std::mutex> guard(lock);
+		function = _function;
+		function_data = data;
+		running_count = thread_count;
+		generation++;
+		wake_condition.notify_all();
+
+		finish_condition.wait(guard, [this]() { return running_count == 0; });
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	void ThreadPool::ThreadLoop(unsigned int thread_id) {
+		size_t last_generation = 0;
+		while (true) {
+			ThreadFunction current_function;
+			void* current_data;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				wake_condition.wait(guard, [&]() { return exit || generation != last_generation; });
+				if (exit) {
+					return;
+				}
+				last_generation = generation;
+				current_function = function;
+				current_data = function_data;
+			}
+
+			current_function(thread_id, current_data);
+
+			std::lock_guard<std::mutex> guard(lock);
+			running_count--;
+			if (running_count == 0) {
+				finish_condition.notify_one();
+			}
+		}
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "Stream.h"
+
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#define CORE_THREAD_TASK(name) void name(unsigned int thread_id, void* _data)
+
+namespace Core {
+
+	typedef void (*ThreadFunction)(unsigned int thread_id, void* data);
+
+	struct ThreadPartition {
+		unsigned int offset;
+		unsigned int size;
+	};
+
+	// Splits the count as evenly as possible between the partitions, each one being a contiguous range.
+	// Returns how many partitions received elements
+	unsigned int ThreadPartitionStream(Stream<ThreadPartition> partitions, unsigned int count);
+
+	// Fork-join thread pool. The threads are kept alive between Run calls such that
+	// repeated runs don't pay for the thread spin-up again
+	struct ThreadPool {
+		// A thread count of 0 uses the hardware concurrency
+		ThreadPool(unsigned int thread_count = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool& other) = delete;
+		ThreadPool& operator = (const ThreadPool& other) = delete;
+
+		// Runs the function once on every thread and waits for all of them to finish
+		void Run(ThreadFunction function, void* data);
+
+		unsigned int GetThreadCount() const {
+			return thread_count;
+		}
+
+		void ThreadLoop(unsigned int thread_id);
+
+		std::thread* threads;
+		unsigned int thread_count;
+
+		std::mutex lock;
+		std::condition_variable wake_condition;
+		std::condition_variable finish_condition;
+		ThreadFunction function;
+		void* function_data;
+		size_t generation;
+		unsigned int running_count;
+		bool exit;
+	};
+
+}
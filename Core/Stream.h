@@ -0,0 +1,241 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#else
+#include <alloca.h>
+#endif
+
+#define CORE_KB (1024ull)
+#define CORE_MB (CORE_KB * 1024ull)
+#define CORE_GB (CORE_MB * 1024ull)
+
+#define CORE_CACHE_LINE_SIZE 64
+
+#define CORE_RELAXED std::memory_order_relaxed
+#define CORE_ACQUIRE std::memory_order_acquire
+#define CORE_RELEASE std::memory_order_release
+
+#define CORE_ASSERT(condition, message) if (!(condition)) { Core::AssertFailed(__FILE__, __LINE__, message); }
+
+#define CORE_STACK_ALLOC(size) alloca(size)
+
+#define CORE_STACK_CAPACITY_STREAM(type, name, capacity) type name##_storage[capacity]; Core::CapacityStream<type> name(name##_storage, 0, capacity)
+#define CORE_STACK_CAPACITY_STREAM_DYNAMIC(type, name, capacity) Core::CapacityStream<type> name(CORE_STACK_ALLOC(sizeof(type) * (capacity)), 0, capacity)
+
+namespace Core {
+
+	[[noreturn]] void AssertFailed(const char* file, unsigned int line, const char* message);
+
+	template<typename T>
+	struct Stream {
+		Stream() : buffer(nullptr), size(0) {}
+		Stream(const void* _buffer, size_t _size) : buffer((T*)_buffer), size(_size) {}
+
+		T& operator [](size_t index) {
+			return buffer[index];
+		}
+
+		const T& operator [](size_t index) const {
+			return buffer[index];
+		}
+
+		T* begin() const {
+			return buffer;
+		}
+
+		T* end() const {
+			return buffer + size;
+		}
+
+		T* buffer;
+		size_t size;
+	};
+
+	template<>
+	struct Stream<char> {
+		Stream() : buffer(nullptr), size(0) {}
+		Stream(const void* _buffer, size_t _size) : buffer((char*)_buffer), size(_size) {}
+		Stream(const char* string) : buffer((char*)string), size(string != nullptr ? strlen(string) : 0) {}
+
+		char& operator [](size_t index) {
+			return buffer[index];
+		}
+
+		const char& operator [](size_t index) const {
+			return buffer[index];
+		}
+
+		char* begin() const {
+			return buffer;
+		}
+
+		char* end() const {
+			return buffer + size;
+		}
+
+		bool operator == (Stream<char> other) const {
+			return size == other.size && memcmp(buffer, other.buffer, size) == 0;
+		}
+
+		char* buffer;
+		size_t size;
+	};
+
+	template<typename T>
+	struct CapacityStream {
+		CapacityStream() : buffer(nullptr), size(0), capacity(0) {}
+		CapacityStream(const void* _buffer, unsigned int _size, unsigned int _capacity) : buffer((T*)_buffer), size(_size), capacity(_capacity) {}
+
+		operator Stream<T>() const {
+			return { buffer, size };
+		}
+
+		void Add(T element) {
+			CORE_ASSERT(size < capacity, "CapacityStream overflow.");
+			buffer[size++] = element;
+		}
+
+		// Returns false if the element could not be added
+		bool AddSafe(T element) {
+			if (size < capacity) {
+				buffer[size++] = element;
+				return true;
+			}
+			return false;
+		}
+
+		void AddStream(Stream<T> elements) {
+			CORE_ASSERT(size + elements.size <= capacity, "CapacityStream overflow.");
+			memcpy(buffer + size, elements.buffer, sizeof(T) * elements.size);
+			size += (unsigned int)elements.size;
+		}
+
+		// Copies as many elements as there is space for. Returns false if not all elements were added
+		bool AddStreamSafe(Stream<T> elements) {
+			size_t count = elements.size;
+			if (size + count > capacity) {
+				count = capacity - size;
+			}
+			memcpy(buffer + size, elements.buffer, sizeof(T) * count);
+			size += (unsigned int)count;
+			return count == elements.size;
+		}
+
+		T& operator [](size_t index) {
+			return buffer[index];
+		}
+
+		const T& operator [](size_t index) const {
+			return buffer[index];
+		}
+
+		T* begin() const {
+			return buffer;
+		}
+
+		T* end() const {
+			return buffer + size;
+		}
+
+		T* buffer;
+		unsigned int size;
+		unsigned int capacity;
+	};
+
+	// Growable stream backed by malloc. The memory is not released in the destructor, such that
+	// it can be kept in plain structs; FreeBuffer must be called explicitly
+	template<typename T>
+	struct ResizableStream {
+		ResizableStream() : buffer(nullptr), size(0), capacity(0) {}
+
+		operator Stream<T>() const {
+			return { buffer, size };
+		}
+
+		void Add(T element) {
+			if (size == capacity) {
+				Resize(capacity == 0 ? 64 : capacity * 2);
+			}
+			buffer[size++] = element;
+		}
+
+		void Resize(unsigned int new_capacity) {
+			T* new_buffer = (T*)realloc(buffer, sizeof(T) * new_capacity);
+			CORE_ASSERT(new_buffer != nullptr, "ResizableStream allocation failed.");
+			buffer = new_buffer;
+			capacity = new_capacity;
+			size = size < capacity ? size : capacity;
+		}
+
+		void FreeBuffer() {
+			free(buffer);
+			buffer = nullptr;
+			size = 0;
+			capacity = 0;
+		}
+
+		T& operator [](size_t index) {
+			return buffer[index];
+		}
+
+		const T& operator [](size_t index) const {
+			return buffer[index];
+		}
+
+		T* begin() const {
+			return buffer;
+		}
+
+		T* end() const {
+			return buffer + size;
+		}
+
+		T* buffer;
+		unsigned int size;
+		unsigned int capacity;
+	};
+
+	// Append only stream that can be written from multiple threads. A writer requests
+	// a range with RequestInt, fills it and then publishes it with FinishRequest
+	template<typename T>
+	struct AtomicStream {
+		AtomicStream() : buffer(nullptr), size(0), write_index(0), capacity(0) {}
+		AtomicStream(const void* _buffer, unsigned int _size, unsigned int _capacity) : buffer((T*)_buffer), size(_size),
+			write_index(_size), capacity(_capacity) {}
+
+		AtomicStream& operator = (const AtomicStream& other) {
+			buffer = other.buffer;
+			size.store(other.size.load(CORE_RELAXED), CORE_RELAXED);
+			write_index.store(other.write_index.load(CORE_RELAXED), CORE_RELAXED);
+			capacity = other.capacity;
+			return *this;
+		}
+
+		// Returns the index of the first reserved element. It can be out of bounds
+		unsigned int RequestInt(unsigned int count) {
+			return size.fetch_add(count, CORE_RELAXED);
+		}
+
+		void FinishRequest(unsigned int count) {
+			write_index.fetch_add(count, CORE_RELEASE);
+		}
+
+		void Reset() {
+			size.store(0, CORE_RELAXED);
+			write_index.store(0, CORE_RELAXED);
+		}
+
+		T* buffer;
+		std::atomic<unsigned int> size;
+		std::atomic<unsigned int> write_index;
+		unsigned int capacity;
+	};
+
+}
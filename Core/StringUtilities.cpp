@@ -0,0 +1,184 @@
+#include "StringUtilities.h"
+
+namespace Core {
+
+	void AssertFailed(const char* file, unsigned int line, const char* message) {
+		fprintf(stderr, "Assert failed in %s at line %u: %s\n", file, line, message);
+		abort();
+	}
+
+	namespace function {
+
+		// ------------------------------------------------------------------------------------------------------------
+
+		Stream<char> TrimWhitespace(Stream<char> string) {
+			while (string.size > 0 && (IsWhitespace(string[0]) || string[0] == '\n')) {
+				string.buffer++;
+				string.size--;
+			}
+			while (string.size > 0 && (IsWhitespace(string[string.size - 1]) || string[string.size - 1] == '\n')) {
+				string.size--;
+			}
+			return string;
+		}
+
+		// ------------------------------------------------------------------------------------------------------------
+
+		bool NormalizePath(Stream<char> path, CapacityStream<char>& destination) {
+			destination.size = 0;
+			bool absolute = path.size > 0 && (path[0] == '/' || path[0] == '\\');
+			if (absolute) {
+				destination.buffer[destination.size++] = '/';
+			}
+			// The prefix that a .. can't remove, the root or the leading .. components
+			unsigned int fixed_size = destination.size;
+
+			size_t index = 0;
+			while (index < path.size) {
+				size_t component_start = index;
+				while (index < path.size && path[index] != '/' && path[index] != '\\') {
+					index++;
+				}
+				Stream<char> component = { path.buffer + component_start, index - component_start };
+				index++;
+
+				if (component.size == 0 || component == ".") {
+					continue;
+				}
+				if (component == ".." && (destination.size > fixed_size || absolute)) {
+					// Remove the last component together with its separator, the root can't be removed
+					while (destination.size > fixed_size && destination[destination.size - 1] != '/') {
+						destination.size--;
+					}
+					destination.size -= destination.size > fixed_size;
+					continue;
+				}
+
+				bool separator = destination.size > 0 && destination[destination.size - 1] != '/';
+				if (destination.size + separator + component.size > destination.capacity) {
+					return false;
+				}
+				if (separator) {
+					destination.buffer[destination.size++] = '/';
+				}
+				memcpy(destination.buffer + destination.size, component.buffer, component.size);
+				destination.size += (unsigned int)component.size;
+				if (component == "..") {
+					fixed_size = destination.size;
+				}
+			}
+			return true;
+		}
+
+		bool JoinPath(Stream<char> directory, Stream<char> path, CapacityStream<char>& destination) {
+			if (path.size == 0 || path[0] == '/' || directory.size == 0) {
+				return NormalizePath(path, destination);
+			}
+
+			CORE_STACK_CAPACITY_STREAM(char, joined, 4096);
+			if (directory.size + 1 + path.size > joined.capacity) {
+				return false;
+			}
+			joined.AddStream(directory);
+			joined.Add('/');
+			joined.AddStream(path);
+			return NormalizePath(joined, destination);
+		}
+
+		// ------------------------------------------------------------------------------------------------------------
+
+		void FindToken(Stream<char> string, char token, CapacityStream<unsigned int>& offsets) {
+			const char* current = string.buffer;
+			const char* end = string.buffer + string.size;
+			while (current < end && offsets.size < offsets.capacity) {
+				const char* found = (const char*)memchr(current, token, end - current);
+				if (found == nullptr) {
+					return;
+				}
+				offsets.buffer[offsets.size++] = (unsigned int)(found - string.buffer);
+				current = found + 1;
+			}
+		}
+
+		// ------------------------------------------------------------------------------------------------------------
+
+		bool EndsWith(Stream<char> string, Stream<char> ending) {
+			return string.size >= ending.size && memcmp(string.buffer + string.size - ending.size, ending.buffer, ending.size) == 0;
+		}
+
+		// ------------------------------------------------------------------------------------------------------------
+
+		// Returns 0 if the bytes are not a well formed sequence. Overlong encodings and surrogates are rejected
+		static size_t GetUtf8SequenceLength(const unsigned char* pointer, const unsigned char* end) {
+			unsigned char lead = pointer[0];
+			size_t length = 0;
+			unsigned char second_min = 0x80;
+			unsigned char second_max = 0xBF;
+			if (lead >= 0xC2 && lead <= 0xDF) {
+				length = 2;
+			}
+			else if (lead >= 0xE0 && lead <= 0xEF) {
+				length = 3;
+				second_min = lead == 0xE0 ? 0xA0 : 0x80;
+				second_max = lead == 0xED ? 0x9F : 0xBF;
+			}
+			else if (lead >= 0xF0 && lead <= 0xF4) {
+				length = 4;
+				second_min = lead == 0xF0 ? 0x90 : 0x80;
+				second_max = lead == 0xF4 ? 0x8F : 0xBF;
+			}
+			else {
+				return 0;
+			}
+
+			if ((size_t)(end - pointer) < length || pointer[1] < second_min || pointer[1] > second_max) {
+				return 0;
+			}
+			for (size_t index = 2; index < length; index++) {
+				if ((pointer[index] & 0xC0) != 0x80) {
+					return 0;
+				}
+			}
+			return length;
+		}
+
+		TEXT_ENCODING GetTextEncoding(Stream<char> string) {
+			const uint64_t LOW_BITS = 0x0101010101010101ull;
+			const uint64_t HIGH_BITS = 0x8080808080808080ull;
+
+			const unsigned char* pointer = (const unsigned char*)string.buffer;
+			const unsigned char* end = pointer + string.size;
+			bool is_ascii = true;
+			bool is_valid = true;
+			while (pointer < end) {
+				if (end - pointer >= 8) {
+					uint64_t word;
+					memcpy(&word, pointer, sizeof(word));
+					// A null byte borrows into its high bit, so this is zero only for 8 bytes in [1, 127]
+					if ((((word - LOW_BITS) | word) & HIGH_BITS) == 0) {
+						pointer += 8;
+						continue;
+					}
+				}
+
+				if (*pointer == 0) {
+					return TEXT_ENCODING_BINARY;
+				}
+				if (*pointer < 0x80) {
+					pointer++;
+					continue;
+				}
+				// Continue after an invalid sequence, a null byte later on still makes the text binary
+				is_ascii = false;
+				size_t length = GetUtf8SequenceLength(pointer, end);
+				is_valid &= length > 0;
+				pointer += length > 0 ? length : 1;
+			}
+			return is_ascii ? TEXT_ENCODING_ASCII : (is_valid ? TEXT_ENCODING_UTF8 : TEXT_ENCODING_INVALID_UTF8);
+		}
+
+		// ------------------------------------------------------------------------------------------------------------
+
+	}
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "Stream.h"
+#include "CharacterClass.h"
+
+namespace Core {
+
+	enum TEXT_ENCODING : unsigned char {
+		TEXT_ENCODING_ASCII,
+		TEXT_ENCODING_UTF8,
+		// Has bytes that don't form UTF-8 sequences, like Latin-1 text
+		TEXT_ENCODING_INVALID_UTF8,
+		// Has null bytes, like object files or UTF-16 text
+		TEXT_ENCODING_BINARY
+	};
+
+	namespace function {
+
+		inline void* OffsetPointer(const void* pointer, size_t offset) {
+			return (void*)((uintptr_t)pointer + offset);
+		}
+
+		inline size_t PointerDifference(const void* first, const void* second) {
+			return (uintptr_t)first - (uintptr_t)second;
+		}
+
+		// The alignment must be a power of two
+		inline uintptr_t AlignPointer(uintptr_t pointer, size_t alignment) {
+			return (pointer + alignment - 1) & ~((uintptr_t)alignment - 1);
+		}
+
+		inline void* AlignPointer(const void* pointer, size_t alignment) {
+			return (void*)AlignPointer((uintptr_t)pointer, alignment);
+		}
+
+		inline bool IsWhitespace(char character) {
+			return C_CHARACTER_CLASSES.Is(character, CHARACTER_CLASS_WHITESPACE);
+		}
+
+		inline bool IsCodeIdentifierCharacter(char character) {
+			return C_CHARACTER_CLASSES.Is(character, CHARACTER_CLASS_IDENTIFIER);
+		}
+
+		// Skips spaces and tabs, but not new lines
+		inline const char* SkipWhitespace(const char* pointer) {
+			while (IsWhitespace(*pointer)) {
+				pointer++;
+			}
+			return pointer;
+		}
+
+		// Returns the string without the leading and trailing whitespace, new lines included
+		Stream<char> TrimWhitespace(Stream<char> string);
+
+		// The backslashes become slashes, the empty and the . components are removed and each .. removes the
+		// previous component if there is one. Returns false if the result doesn't fit
+		bool NormalizePath(Stream<char> path, CapacityStream<char>& destination);
+
+		// Joins the path to the directory when it is relative, an empty directory leaves it as it is, and normalizes the
+		// result. Returns false if it doesn't fit, the joined path must be shorter than 4096 characters
+		bool JoinPath(Stream<char> directory, Stream<char> path, CapacityStream<char>& destination);
+
+		// Adds the offsets of all the occurences of the token. Stops when the capacity is exhausted
+		void FindToken(Stream<char> string, char token, CapacityStream<unsigned int>& offsets);
+
+		bool EndsWith(Stream<char> string, Stream<char> ending);
+
+		// Runs of 8 ASCII bytes are skipped at once, only the other bytes are decoded
+		TEXT_ENCODING GetTextEncoding(Stream<char> string);
+
+		// FNV-1a, stable between runs and processes
+		inline uint64_t HashString(Stream<char> string) {
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t index = 0; index < string.size; index++) {
+				hash = (hash ^ (unsigned char)string[index]) * 1099511628211ull;
+			}
+			return hash;
+		}
+
+	}
+
+}
+
+#define CORE_C_FILE_SINGLE_LINE_COMMENT_TOKEN "//"
+#define CORE_C_FILE_MULTI_LINE_COMMENT_OPENED_TOKEN "/*"
+#define CORE_C_FILE_MULTI_LINE_COMMENT_CLOSED_TOKEN "*/"
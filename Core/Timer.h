@@ -0,0 +1,40 @@
+#pragma once
+#include <chrono>
+#include <stddef.h>
+
+namespace Core {
+
+	enum TIMER_DURATION : unsigned char {
+		TIMER_DURATION_NS,
+		TIMER_DURATION_US,
+		TIMER_DURATION_MS,
+		TIMER_DURATION_S
+	};
+
+	struct Timer {
+		Timer() {
+			SetMarker();
+		}
+
+		void SetMarker() {
+			marker = std::chrono::steady_clock::now();
+		}
+
+		size_t GetDurationSinceMarker(TIMER_DURATION duration_type) const {
+			auto duration = std::chrono::steady_clock::now() - marker;
+			switch (duration_type) {
+			case TIMER_DURATION_NS:
+				return (size_t)std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+			case TIMER_DURATION_US:
+				return (size_t)std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+			case TIMER_DURATION_MS:
+				return (size_t)std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+			default:
+				return (size_t)std::chrono::duration_cast<std::chrono::seconds>(duration).count();
+			}
+		}
+
+		std::chrono::steady_clock::time_point marker;
+	};
+
+}
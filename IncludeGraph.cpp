@@ -0,0 +1,362 @@
+#include "IncludeGraph.h"
+
+#include <algorithm>
+#include <new>
+
+#define INCLUDE_GRAPH_PATH_CAPACITY 4096
+#define INCLUDE_GRAPH_NOT_FOUND CORE_HASH_TABLE_NOT_FOUND
+
+// ------------------------------------------------------------------------------------------------------------
+
+static bool IsHeader(Stream<char> path) {
+	const char* header_extensions[] = { ".h", ".hh", ".hpp", ".hxx", ".inl", ".ipp", ".tpp", ".inc" };
+	for (size_t index = 0; index < std::size(header_extensions); index++) {
+		if (function::EndsWith(path, header_extensions[index])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// The directives inside the block comments and the disabled preprocessor branches are found as well.
+// The computed includes, #include MACRO, are skipped
+bool NextIncludeDirective(Stream<char> content, const char*& current, Stream<char>& spelling, bool& angled) {
+	const char* start = content.buffer;
+	const char* end = content.buffer + content.size;
+	while (current < end) {
+		const char* hash = (const char*)memchr(current, '#', end - current);
+		if (hash == nullptr) {
+			current = end;
+			return false;
+		}
+		current = hash + 1;
+
+		// The # must be the first character of its line
+		const char* line_start = hash;
+		while (line_start > start && function::IsWhitespace(line_start[-1])) {
+			line_start--;
+		}
+		if (line_start > start && line_start[-1] != '\n') {
+			continue;
+		}
+
+		// The content is null terminated, the compare stops at the end
+		const char* directive = function::SkipWhitespace(hash + 1);
+		if (strncmp(directive, "include", 7) != 0 || function::IsCodeIdentifierCharacter(directive[7])) {
+			continue;
+		}
+		directive = function::SkipWhitespace(directive + 7);
+		char closing = *directive == '<' ? '>' : (*directive == '"' ? '"' : '\0');
+		if (closing == '\0') {
+			continue;
+		}
+
+		const char* name = directive + 1;
+		const char* name_end = name;
+		while (*name_end != closing && *name_end != '\n' && *name_end != '\0') {
+			name_end++;
+		}
+		current = name_end;
+		if (*name_end == closing && name_end > name) {
+			spelling = { name, (size_t)(name_end - name) };
+			angled = closing == '>';
+			return true;
+		}
+	}
+	return false;
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+struct IncludeGraphBuildData {
+	IncludeGraph* graph;
+	Stream<Stream<char>> files;
+	Stream<ThreadPartition> thread_partitions;
+	Stream<Stream<char>> include_directories;
+	Arena* thread_arenas;
+	// From the normalized paths to the file indices. When the same path is listed twice the first file is kept
+	ConcurrentHashTable index;
+	// Indexed by file
+	Stream<char>* normalized_paths;
+
+	// The edges in compressed rows, the targets of a file are [edge_offsets[file], edge_offsets[file + 1])
+	unsigned int* thread_edge_offsets;
+	unsigned int* edge_offsets;
+	unsigned int* edge_targets;
+
+	// Each thread counts the translation units that reach a file in its own array, they are summed at the end
+	unsigned int** thread_fan_in;
+	unsigned int* transitive_fan_in;
+};
+
+// ------------------------------------------------------------------------------------------------------------
+
+CORE_THREAD_TASK(IndexIncludeGraphFiles) {
+	IncludeGraphBuildData* data = (IncludeGraphBuildData*)_data;
+	ThreadPartition partition = data->thread_partitions[thread_id];
+
+	CORE_STACK_CAPACITY_STREAM(char, normalized, INCLUDE_GRAPH_PATH_CAPACITY);
+	for (unsigned int index = partition.offset; index < partition.offset + partition.size; index++) {
+		// A path that can't be normalized is kept as it is, it can still be found if it is spelled the same
+		Stream<char> path = data->files[index];
+		if (function::NormalizePath(path, normalized)) {
+			path = data->thread_arenas[thread_id].StringCopy(normalized);
+		}
+		data->normalized_paths[index] = path;
+		data->index.Insert(index);
+	}
+}
+
+// The directory is not normalized again. Returns INCLUDE_GRAPH_NOT_FOUND if no file has that path
+static unsigned int FindIncludeCandidate(const ConcurrentHashTable& index, Stream<char> directory, Stream<char> spelling) {
+	CORE_STACK_CAPACITY_STREAM(char, candidate, INCLUDE_GRAPH_PATH_CAPACITY);
+	CORE_STACK_CAPACITY_STREAM(char, normalized, INCLUDE_GRAPH_PATH_CAPACITY);
+	if (directory.size + 1 + spelling.size > candidate.capacity) {
+		return INCLUDE_GRAPH_NOT_FOUND;
+	}
+	candidate.AddStream(directory);
+	if (directory.size > 0) {
+		candidate.Add('/');
+	}
+	candidate.AddStream(spelling);
+	if (!function::NormalizePath(candidate, normalized)) {
+		return INCLUDE_GRAPH_NOT_FOUND;
+	}
+	return index.Find(normalized);
+}
+
+CORE_THREAD_TASK(ResolveIncludeGraphEdges) {
+	IncludeGraphBuildData* data = (IncludeGraphBuildData*)_data;
+	Stream<IncludeDirective> directives = data->graph->thread_directives[thread_id];
+	ResizableStream<IncludeEdge>* edges = data->graph->thread_edges + thread_id;
+
+	size_t unresolved_count = 0;
+	// The edges of the current file start here, they are used to drop the repeated includes
+	unsigned int file_edges_start = 0;
+	for (size_t index = 0; index < directives.size; index++) {
+		const IncludeDirective* directive = directives.buffer + index;
+		if (index == 0 || directives[index - 1].file_index != directive->file_index) {
+			file_edges_start = edges->size;
+		}
+
+		unsigned int target = INCLUDE_GRAPH_NOT_FOUND;
+		if (!directive->angled) {
+			Stream<char> includer = data->normalized_paths[directive->file_index];
+			size_t directory_size = includer.size;
+			while (directory_size > 0 && includer[directory_size - 1] != '/') {
+				directory_size--;
+			}
+			target = FindIncludeCandidate(data->index, { includer.buffer, directory_size }, directive->spelling);
+		}
+		for (size_t subindex = 0; subindex < data->include_directories.size && target == INCLUDE_GRAPH_NOT_FOUND; subindex++) {
+			target = FindIncludeCandidate(data->index, data->include_directories[subindex], directive->spelling);
+		}
+
+		if (target == INCLUDE_GRAPH_NOT_FOUND) {
+			unresolved_count++;
+			continue;
+		}
+		if (target == directive->file_index) {
+			continue;
+		}
+
+		bool repeated = false;
+		for (unsigned int subindex = file_edges_start; subindex < edges->size && !repeated; subindex++) {
+			repeated = edges->buffer[subindex].to == target;
+		}
+		if (!repeated) {
+			edges->Add({ directive->file_index, target });
+		}
+	}
+	data->graph->thread_unresolved_counts[thread_id] = unresolved_count;
+}
+
+// The edges of each thread are already ordered by the including file, which is in the thread's partition
+CORE_THREAD_TASK(FillIncludeGraphEdges) {
+	IncludeGraphBuildData* data = (IncludeGraphBuildData*)_data;
+	ThreadPartition partition = data->thread_partitions[thread_id];
+	Stream<IncludeEdge> edges = data->graph->thread_edges[thread_id];
+
+	unsigned int edge_offset = data->thread_edge_offsets[thread_id];
+	size_t edge_index = 0;
+	for (unsigned int index = partition.offset; index < partition.offset + partition.size; index++) {
+		data->edge_offsets[index] = edge_offset + (unsigned int)edge_index;
+		while (edge_index < edges.size && edges[edge_index].from == index) {
+			data->edge_targets[edge_offset + edge_index] = edges[edge_index].to;
+			edge_index++;
+		}
+	}
+}
+
+// A depth first search from each translation unit, every file that is reached is counted once
+CORE_THREAD_TASK(CountIncludeGraphFanIn) {
+	IncludeGraphBuildData* data = (IncludeGraphBuildData*)_data;
+	ThreadPartition partition = data->thread_partitions[thread_id];
+	size_t file_count = data->files.size;
+	Arena* arena = data->thread_arenas + thread_id;
+
+	unsigned int* fan_in = arena->Allocate<unsigned int>(file_count);
+	unsigned int* visited = arena->Allocate<unsigned int>(file_count);
+	unsigned int* stack = arena->Allocate<unsigned int>(file_count);
+	memset(fan_in, 0, sizeof(unsigned int) * file_count);
+	memset(visited, 0, sizeof(unsigned int) * file_count);
+	data->thread_fan_in[thread_id] = fan_in;
+
+	for (unsigned int index = partition.offset; index < partition.offset + partition.size; index++) {
+		if (IsHeader(data->files[index])) {
+			continue;
+		}
+
+		// The stamp is different for each search, such that the visited array is not cleared
+		unsigned int stamp = index + 1;
+		unsigned int stack_size = 0;
+		visited[index] = stamp;
+		stack[stack_size++] = index;
+		while (stack_size > 0) {
+			unsigned int file = stack[--stack_size];
+			for (unsigned int edge = data->edge_offsets[file]; edge < data->edge_offsets[file + 1]; edge++) {
+				unsigned int target = data->edge_targets[edge];
+				if (visited[target] != stamp) {
+					visited[target] = stamp;
+					fan_in[target]++;
+					stack[stack_size++] = target;
+				}
+			}
+		}
+	}
+}
+
+CORE_THREAD_TASK(SumIncludeGraphFanIn) {
+	IncludeGraphBuildData* data = (IncludeGraphBuildData*)_data;
+	ThreadPartition partition = data->thread_partitions[thread_id];
+	unsigned int thread_count = data->graph->thread_count;
+
+	for (unsigned int index = partition.offset; index < partition.offset + partition.size; index++) {
+		unsigned int fan_in = 0;
+		for (unsigned int subindex = 0; subindex < thread_count; subindex++) {
+			fan_in += data->thread_fan_in[subindex][index];
+		}
+		data->transitive_fan_in[index] = fan_in;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+IncludeGraph::IncludeGraph(unsigned int _thread_count) : thread_count(_thread_count) {
+	thread_directives = new ResizableStream<IncludeDirective>[thread_count];
+	thread_edges = new ResizableStream<IncludeEdge>[thread_count];
+	thread_unresolved_counts = (size_t*)malloc(sizeof(size_t) * thread_count);
+}
+
+IncludeGraph::~IncludeGraph() {
+	for (unsigned int index = 0; index < thread_count; index++) {
+		thread_directives[index].FreeBuffer();
+		thread_edges[index].FreeBuffer();
+	}
+	delete[] thread_directives;
+	delete[] thread_edges;
+	free(thread_unresolved_counts);
+	file_code_lines.FreeBuffer();
+}
+
+void IncludeGraph::Reset(unsigned int file_count) {
+	for (unsigned int index = 0; index < thread_count; index++) {
+		thread_directives[index].size = 0;
+		thread_edges[index].size = 0;
+		thread_unresolved_counts[index] = 0;
+	}
+	if (file_code_lines.capacity < file_count) {
+		file_code_lines.Resize(file_count);
+	}
+	file_code_lines.size = file_count;
+	memset(file_code_lines.buffer, 0, sizeof(size_t) * file_count);
+}
+
+void IncludeGraph::ExtractIncludes(unsigned int thread_id, unsigned int file_index, Stream<char> content, size_t code_lines, Arena* arena) {
+	file_code_lines[file_index] = code_lines;
+	ResizableStream<IncludeDirective>* directives = thread_directives + thread_id;
+
+	const char* current = content.buffer;
+	Stream<char> spelling;
+	bool angled;
+	while (NextIncludeDirective(content, current, spelling, angled)) {
+		directives->Add({ arena->StringCopy(spelling), file_index, angled });
+	}
+}
+
+IncludeGraphResults IncludeGraph::Build(
+	ThreadPool& thread_pool,
+	Stream<Stream<char>> files,
+	Stream<ThreadPartition> thread_partitions,
+	Stream<Stream<char>> include_directories,
+	Arena* thread_arenas
+) {
+	// The main thread allocates from the first arena while the workers are idle
+	Arena* arena = thread_arenas;
+	unsigned int file_count = (unsigned int)files.size;
+
+	IncludeGraphBuildData data;
+	data.graph = this;
+	data.files = files;
+	data.thread_partitions = thread_partitions;
+	data.thread_arenas = thread_arenas;
+
+	// The include directories are normalized once, such that the candidates can be looked up directly
+	data.include_directories = { arena->Allocate<Stream<char>>(include_directories.size), 0 };
+	CORE_STACK_CAPACITY_STREAM(char, normalized, INCLUDE_GRAPH_PATH_CAPACITY);
+	for (size_t index = 0; index < include_directories.size; index++) {
+		if (function::NormalizePath(include_directories[index], normalized)) {
+			data.include_directories[data.include_directories.size++] = arena->StringCopy(normalized);
+		}
+	}
+
+	data.normalized_paths = arena->Allocate<Stream<char>>(file_count);
+	data.index.Initialize(arena->Allocate(ConcurrentHashTable::MemoryOf(file_count), alignof(std::atomic<uint64_t>)), file_count, data.normalized_paths);
+	thread_pool.Run(IndexIncludeGraphFiles, &data);
+
+	thread_pool.Run(ResolveIncludeGraphEdges, &data);
+
+	IncludeGraphResults results;
+	results.include_count = 0;
+	results.unresolved_count = 0;
+	data.thread_edge_offsets = arena->Allocate<unsigned int>(thread_count);
+	unsigned int edge_count = 0;
+	for (unsigned int index = 0; index < thread_count; index++) {
+		data.thread_edge_offsets[index] = edge_count;
+		edge_count += thread_edges[index].size;
+		results.include_count += thread_directives[index].size;
+		results.unresolved_count += thread_unresolved_counts[index];
+	}
+	data.edge_offsets = arena->Allocate<unsigned int>(file_count + 1);
+	data.edge_offsets[file_count] = edge_count;
+	data.edge_targets = arena->Allocate<unsigned int>(edge_count);
+	thread_pool.Run(FillIncludeGraphEdges, &data);
+
+	data.thread_fan_in = arena->Allocate<unsigned int*>(thread_count);
+	data.transitive_fan_in = arena->Allocate<unsigned int>(file_count);
+	thread_pool.Run(CountIncludeGraphFanIn, &data);
+	thread_pool.Run(SumIncludeGraphFanIn, &data);
+
+	unsigned int* direct_fan_in = arena->Allocate<unsigned int>(file_count);
+	memset(direct_fan_in, 0, sizeof(unsigned int) * file_count);
+	for (unsigned int index = 0; index < edge_count; index++) {
+		direct_fan_in[data.edge_targets[index]]++;
+	}
+
+	unsigned int header_count = 0;
+	for (unsigned int index = 0; index < file_count; index++) {
+		header_count += direct_fan_in[index] > 0;
+	}
+	results.headers = { arena->Allocate<IncludeGraphHeader>(header_count), 0 };
+	for (unsigned int index = 0; index < file_count; index++) {
+		if (direct_fan_in[index] > 0) {
+			size_t code_lines = file_code_lines[index];
+			unsigned int transitive_fan_in = data.transitive_fan_in[index];
+			results.headers[results.headers.size++] = { files[index], code_lines, direct_fan_in[index], transitive_fan_in, transitive_fan_in * code_lines };
+		}
+	}
+	std::sort(results.headers.begin(), results.headers.end(), [](const IncludeGraphHeader& first, const IncludeGraphHeader& second) {
+		return first.cost != second.cost ? first.cost > second.cost : first.transitive_fan_in > second.transitive_fan_in;
+	});
+	return results;
+}
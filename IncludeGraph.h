@@ -0,0 +1,77 @@
+#pragma once
+#include "Core/Core.h"
+
+using namespace Core;
+
+// An #include directive as it was written. The spelling is the text between the quotes or the angle brackets
+struct IncludeDirective {
+	Stream<char> spelling;
+	// The index of the including file in the source files
+	unsigned int file_index;
+	bool angled;
+};
+
+// A resolved directive, both ends are indices in the source files
+struct IncludeEdge {
+	unsigned int from;
+	unsigned int to;
+};
+
+// Finds the next #include directive of the content, starting from the current pointer which is moved past it.
+// The content must be null terminated. The spelling points into the content. Returns false at the end
+bool NextIncludeDirective(Stream<char> content, const char*& current, Stream<char>& spelling, bool& angled);
+
+struct IncludeGraphHeader {
+	Stream<char> path;
+	size_t code_lines;
+	// The files that include it directly
+	unsigned int direct_fan_in;
+	// The translation units (the files that are not headers) that include it directly or transitively
+	unsigned int transitive_fan_in;
+	// transitive_fan_in * code_lines, an estimate of how many lines the compiler parses because of it
+	size_t cost;
+};
+
+struct IncludeGraphResults {
+	// The headers that are included at least once, sorted by descending cost
+	Stream<IncludeGraphHeader> headers;
+	size_t include_count;
+	// The directives that don't name a counted file, like the system headers
+	size_t unresolved_count;
+};
+
+// Collects the #include directives of the counted files into per thread buffers and then resolves them
+// into a graph. The quoted includes are looked up relative to the including file and then in the include
+// directories, the angled ones only in the include directories. The lookups go through a hash index of the
+// lexically normalized paths, no file system calls are made
+struct IncludeGraph {
+	IncludeGraph(unsigned int thread_count);
+	~IncludeGraph();
+
+	IncludeGraph(const IncludeGraph& other) = delete;
+	IncludeGraph& operator = (const IncludeGraph& other) = delete;
+
+	// Must be called before the files are counted
+	void Reset(unsigned int file_count);
+
+	// Called from the counting threads, each thread must extract the files of its partition in order.
+	// The content must be null terminated. The spellings are copied into the arena
+	void ExtractIncludes(unsigned int thread_id, unsigned int file_index, Stream<char> content, size_t code_lines, Arena* arena);
+
+	// The partitions must be the ones that the files were extracted with. The arenas are the per thread
+	// arenas, they must stay alive as long as the results are used
+	IncludeGraphResults Build(
+		ThreadPool& thread_pool,
+		Stream<Stream<char>> files,
+		Stream<ThreadPartition> thread_partitions,
+		Stream<Stream<char>> include_directories,
+		Arena* thread_arenas
+	);
+
+	unsigned int thread_count;
+	ResizableStream<IncludeDirective>* thread_directives;
+	ResizableStream<IncludeEdge>* thread_edges;
+	size_t* thread_unresolved_counts;
+	// Indexed by file, the failed files stay at 0
+	ResizableStream<size_t> file_code_lines;
+};
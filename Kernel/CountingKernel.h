@@ -0,0 +1,74 @@
+#pragma once
+#include "../Core/Stream.h"
+
+// The lexer that classifies the lines is compiled once for each supported ISA level
+// and the best one for the host is selected at startup
+
+// A line is a code line if it has at least an identifier character (letter, digit or underscore)
+// outside of comments, string and character literal contents included. Otherwise it is a comment line
+// if it has a non whitespace character inside a comment. The rest are blank lines, which includes the
+// lines that have only punctuation, like a lone brace.
+// The logical lines are counted in the same pass and don't depend on the formatting. Outside of comments
+// and literals, each ; and each { counts as one, as does each control keyword (if, else, for, while, do,
+// switch, case, default, try and catch). The semicolons of a for header are counted as well.
+// The tokens are counted outside of comments: each run of identifier characters (identifiers, keywords and
+// numbers, where a decimal point splits a number in two), each string or character literal and each punctuation
+// character, such that a multi character operator counts once per character. The backslashes are not tokens.
+// The code bytes are all the bytes that are not inside a comment, the comment tokens included. New lines are
+// always code bytes
+struct FileCounts {
+	size_t code_lines;
+	size_t comment_lines;
+	size_t blank_lines;
+	size_t total_lines;
+	size_t logical_lines;
+	size_t token_count;
+	size_t code_bytes;
+};
+
+inline void AddFileCounts(FileCounts& destination, const FileCounts& source) {
+	destination.code_lines += source.code_lines;
+	destination.comment_lines += source.comment_lines;
+	destination.blank_lines += source.blank_lines;
+	destination.total_lines += source.total_lines;
+	destination.logical_lines += source.logical_lines;
+	destination.token_count += source.token_count;
+	destination.code_bytes += source.code_bytes;
+}
+
+// The lines of a function body, from the opening to the closing brace, and its cyclomatic complexity
+struct FunctionMetrics {
+	// Points into the content of the file
+	Core::Stream<char> name;
+	// Starts at 1
+	size_t start_line;
+	size_t line_count;
+	size_t complexity;
+};
+
+// The content must be followed by a null terminator, content.buffer[content.size] == '\0'.
+// The function metrics are opt-in, when functions is not nullptr they are appended to it.
+// Returns true if the content has a null byte or a byte above 127, which the lexer sees anyway, such
+// that the encoding needs to be checked only for those files
+typedef bool (*CountFileFunction)(Core::Stream<char> content, FileCounts* counts, Core::CapacityStream<FunctionMetrics>* functions);
+
+enum COUNTING_KERNEL_TARGET : unsigned char {
+	COUNTING_KERNEL_DEFAULT,
+	COUNTING_KERNEL_X86_64_V2,
+	COUNTING_KERNEL_X86_64_V3,
+	COUNTING_KERNEL_X86_64_V4,
+	COUNTING_KERNEL_TARGET_COUNT
+};
+
+struct CountingKernel {
+	CountFileFunction count_file;
+	const char* name;
+	COUNTING_KERNEL_TARGET target;
+};
+
+// The selection happens once, the first time it is called. The environment variable LINE_COUNTER_KERNEL
+// can be set to default, x86-64-v2, x86-64-v3 or x86-64-v4 to force a lower level than the host supports
+const CountingKernel* GetCountingKernel();
+
+// Returns nullptr if that target was not compiled in or the host does not support it
+const CountingKernel* GetCountingKernel(COUNTING_KERNEL_TARGET target);
@@ -0,0 +1,99 @@
+#include "CountingKernel.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+// Each compiled variant of CountingKernelImpl.cpp lives in its own namespace
+#define DECLARE_COUNTING_KERNEL(namespace_name) namespace namespace_name { \
+	bool CountFile(Core::Stream<char> content, FileCounts* counts, Core::CapacityStream<FunctionMetrics>* functions); \
+}
+
+DECLARE_COUNTING_KERNEL(CountingKernelDefault)
+#ifdef COUNTING_KERNEL_HAS_X86_64_V2
+DECLARE_COUNTING_KERNEL(CountingKernelX86_64_V2)
+#endif
+#ifdef COUNTING_KERNEL_HAS_X86_64_V3
+DECLARE_COUNTING_KERNEL(CountingKernelX86_64_V3)
+#endif
+#ifdef COUNTING_KERNEL_HAS_X86_64_V4
+DECLARE_COUNTING_KERNEL(CountingKernelX86_64_V4)
+#endif
+
+static const CountingKernel COUNTING_KERNELS[] = {
+	{ CountingKernelDefault::CountFile, "default", COUNTING_KERNEL_DEFAULT },
+#ifdef COUNTING_KERNEL_HAS_X86_64_V2
+	{ CountingKernelX86_64_V2::CountFile, "x86-64-v2", COUNTING_KERNEL_X86_64_V2 },
+#endif
+#ifdef COUNTING_KERNEL_HAS_X86_64_V3
+	{ CountingKernelX86_64_V3::CountFile, "x86-64-v3", COUNTING_KERNEL_X86_64_V3 },
+#endif
+#ifdef COUNTING_KERNEL_HAS_X86_64_V4
+	{ CountingKernelX86_64_V4::CountFile, "x86-64-v4", COUNTING_KERNEL_X86_64_V4 },
+#endif
+};
+
+// ------------------------------------------------------------------------------------------------------------
+
+static bool IsTargetSupported(COUNTING_KERNEL_TARGET target) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+	switch (target) {
+	case COUNTING_KERNEL_DEFAULT:
+		return true;
+	case COUNTING_KERNEL_X86_64_V2:
+		return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt");
+	case COUNTING_KERNEL_X86_64_V3:
+		return IsTargetSupported(COUNTING_KERNEL_X86_64_V2) && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi")
+			&& __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("pclmul");
+	case COUNTING_KERNEL_X86_64_V4:
+		return IsTargetSupported(COUNTING_KERNEL_X86_64_V3) && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+			&& __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512cd");
+	default:
+		return false;
+	}
+#else
+	return target == COUNTING_KERNEL_DEFAULT;
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+const CountingKernel* GetCountingKernel(COUNTING_KERNEL_TARGET target) {
+	for (size_t index = 0; index < sizeof(COUNTING_KERNELS) / sizeof(COUNTING_KERNELS[0]); index++) {
+		if (COUNTING_KERNELS[index].target == target) {
+			return IsTargetSupported(target) ? COUNTING_KERNELS + index : nullptr;
+		}
+	}
+	return nullptr;
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+static const CountingKernel* SelectCountingKernel() {
+	COUNTING_KERNEL_TARGET limit = (COUNTING_KERNEL_TARGET)(COUNTING_KERNEL_TARGET_COUNT - 1);
+	const char* forced_kernel = getenv("LINE_COUNTER_KERNEL");
+	if (forced_kernel != nullptr) {
+		for (size_t index = 0; index < sizeof(COUNTING_KERNELS) / sizeof(COUNTING_KERNELS[0]); index++) {
+			if (strcmp(forced_kernel, COUNTING_KERNELS[index].name) == 0) {
+				limit = COUNTING_KERNELS[index].target;
+				break;
+			}
+		}
+	}
+
+	// The table is ordered from the lowest to the highest level
+	const CountingKernel* selected = COUNTING_KERNELS;
+	for (size_t index = 1; index < sizeof(COUNTING_KERNELS) / sizeof(COUNTING_KERNELS[0]); index++) {
+		if (COUNTING_KERNELS[index].target <= limit && IsTargetSupported(COUNTING_KERNELS[index].target)) {
+			selected = COUNTING_KERNELS + index;
+		}
+	}
+	return selected;
+}
+
+const CountingKernel* GetCountingKernel() {
+	static const CountingKernel* kernel = SelectCountingKernel();
+	return kernel;
+}
+
+// ------------------------------------------------------------------------------------------------------------
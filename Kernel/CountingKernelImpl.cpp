@@ -0,0 +1,871 @@
+// This translation unit is compiled once for each ISA level, every time with a different
+// COUNTING_KERNEL_NAMESPACE and -march. Nothing from here should be called directly, only
+// through the table returned by GetCountingKernel
+#include "CountingKernel.h"
+#include "Keywords.h"
+#include "../Core/StringUtilities.h"
+
+#ifndef COUNTING_KERNEL_NAMESPACE
+#define COUNTING_KERNEL_NAMESPACE CountingKernelDefault
+#endif
+
+// The block lexer works on any x86-64 target, it uses the widest vectors the variant was compiled for.
+// COUNTING_KERNEL_SCALAR forces the byte by byte reference lexer
+#if defined(__SSE2__) && !defined(COUNTING_KERNEL_SCALAR)
+#define COUNTING_KERNEL_BLOCK_LEXER
+#include <immintrin.h>
+#endif
+
+// pshufb is needed for the nibble lookups of the character classes. The SSE2 baseline uses range compares
+#if defined(COUNTING_KERNEL_BLOCK_LEXER) && defined(__SSSE3__)
+#define COUNTING_KERNEL_NIBBLE_LOOKUP
+#endif
+
+using namespace Core;
+
+namespace COUNTING_KERNEL_NAMESPACE {
+
+	// The scalar and the vector paths must classify the characters with the same table
+	static constexpr const CharacterClassTable& CHARACTER_CLASSES = C_CHARACTER_CLASSES;
+	static constexpr const NibbleLookupTable& CHARACTER_CLASSES_LOOKUP = C_CHARACTER_CLASSES_NIBBLE_LOOKUP;
+
+	enum LEXER_STATE : unsigned char {
+		LEXER_CODE,
+		LEXER_STRING,
+		LEXER_CHARACTER,
+		LEXER_LINE_COMMENT,
+		LEXER_BLOCK_COMMENT
+	};
+
+	struct LineState {
+		bool has_code;
+		bool has_comment;
+	};
+
+	static inline void FinishLine(LineState& line, FileCounts* counts) {
+		counts->code_lines += line.has_code;
+		counts->comment_lines += !line.has_code & line.has_comment;
+		line = { false, false };
+	}
+
+	// The identifier that starts at the pointer must be followed by a non identifier character,
+	// the null terminator included
+	static inline KEYWORD FindKeyword(const char* identifier) {
+		unsigned int length = 0;
+		while (length <= KEYWORD_MAX_LENGTH && CHARACTER_CLASSES.Is(identifier[length], CHARACTER_CLASS_IDENTIFIER)) {
+			length++;
+		}
+		return MatchKeyword(identifier, length);
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	// Detects the function bodies from the tokens outside of comments and literals. A { opens a function
+	// body when no function is open and the previous structural token is a ) at parenthesis depth 0, which
+	// includes the const, noexcept and initializer list forms. Inside a body only the braces and the decision
+	// points matter. The complexity starts at 1 and every decision point adds 1: if, for, while, case, catch,
+	// &&, || and ?. The preprocessor directives are skipped, from the # up to the first new line that is not escaped
+	struct FunctionTracker {
+		// The longest name that is looked for before the parameter list
+		static constexpr size_t MAX_NAME_SIZE = 256;
+
+		void OnKeyword(KEYWORD keyword) {
+			if (in_directive) {
+				return;
+			}
+			if (in_function) {
+				current.complexity += KEYWORDS[keyword].is_decision;
+			}
+			else {
+				// The parenthesis of the attribute macros don't make the namespace a function
+				in_namespace_declaration |= keyword == KEYWORD_NAMESPACE;
+			}
+		}
+
+		// The character must be outside of comments and literals, new lines excluded. The line starts at 1
+		void OnCharacter(char character, char next_character, size_t offset, size_t line) {
+			if (in_directive) {
+				return;
+			}
+			if (character == '#') {
+				in_directive = true;
+				return;
+			}
+
+			if (in_function) {
+				switch (character) {
+				case '{':
+					brace_depth++;
+					break;
+				case '}':
+					brace_depth--;
+					if (brace_depth == function_depth) {
+						in_function = false;
+						last_token = '}';
+						current.line_count = line - current.start_line + 1;
+						// The functions past the capacity are not recorded
+						functions->AddSafe(current);
+					}
+					break;
+				case '?':
+					current.complexity++;
+					break;
+				case '&':
+				case '|':
+					current.complexity += next_character == character;
+					break;
+				}
+				return;
+			}
+
+			switch (character) {
+			case '(':
+				if (paren_depth == 0) {
+					paren_offset = offset;
+				}
+				paren_depth++;
+				break;
+			case ')':
+				paren_depth -= paren_depth > 0;
+				break;
+			case '{':
+				if (!in_namespace_declaration && last_token == ')' && paren_depth == 0) {
+					in_function = true;
+					function_depth = brace_depth;
+					current = { FunctionName(), line, 0, 1 };
+				}
+				in_namespace_declaration = false;
+				brace_depth++;
+				break;
+			case '}':
+				brace_depth -= brace_depth > 0;
+				break;
+			case ';':
+				in_namespace_declaration = false;
+				break;
+			default:
+				return;
+			}
+			last_token = character;
+		}
+
+		// The name is the run of characters before the last parameter list, such that qualified
+		// names and operators are kept whole
+		Stream<char> FunctionName() const {
+			size_t end = paren_offset;
+			while (end > 0 && (function::IsWhitespace(content[end - 1]) || content[end - 1] == '\n')) {
+				end--;
+			}
+			size_t start = end;
+			while (start > 0 && end - start < MAX_NAME_SIZE && !function::IsWhitespace(content[start - 1])
+				&& strchr("\n(){};,\"'", content[start - 1]) == nullptr) {
+				start--;
+			}
+			return { content.buffer + start, end - start };
+		}
+
+		Stream<char> content;
+		CapacityStream<FunctionMetrics>* functions;
+		FunctionMetrics current = {};
+		size_t brace_depth = 0;
+		size_t paren_depth = 0;
+		size_t function_depth = 0;
+		size_t paren_offset = 0;
+		char last_token = '\0';
+		bool in_function = false;
+		bool in_namespace_declaration = false;
+		bool in_directive = false;
+	};
+
+	// The new line is escaped when it follows an odd number of backslashes
+	static inline bool IsNewLineEscaped(Stream<char> content, size_t offset) {
+		size_t backslash_count = 0;
+		while (offset > backslash_count && content[offset - backslash_count - 1] == '\\') {
+			backslash_count++;
+		}
+		return (backslash_count & 1) != 0;
+	}
+
+	static inline void FinishFile(Stream<char> content, LineState& line, size_t new_line_count, size_t comment_bytes, FileCounts* counts) {
+		counts->total_lines = new_line_count;
+		counts->code_bytes = content.size - comment_bytes;
+		// The last line is counted only if it has characters
+		if (content.size > 0 && content[content.size - 1] != '\n') {
+			counts->total_lines++;
+			FinishLine(line, counts);
+		}
+		counts->blank_lines = counts->total_lines - counts->code_lines - counts->comment_lines;
+	}
+
+#ifndef COUNTING_KERNEL_BLOCK_LEXER
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	// A null byte wraps around to 255
+	static inline bool IsSpecialByte(char character) {
+		return (unsigned char)(character - 1) >= 0x7F;
+	}
+
+	// The reference lexer. The block lexer must give exactly the same results
+	bool CountFile(Stream<char> content, FileCounts* counts, CapacityStream<FunctionMetrics>* functions) {
+		*counts = {};
+		FunctionTracker tracker;
+		tracker.content = content;
+		tracker.functions = functions;
+
+		LEXER_STATE state = LEXER_CODE;
+		LineState line = { false, false };
+		size_t new_line_count = 0;
+		size_t comment_bytes = 0;
+		bool has_special_bytes = false;
+
+		const char* current = content.buffer;
+		const char* end = content.buffer + content.size;
+		while (current < end) {
+			char character = *current;
+			// The bytes skipped below are the second bytes of the comment tokens, which are ASCII, and the escaped
+			// bytes, which are checked there
+			has_special_bytes |= IsSpecialByte(character);
+			if (character == '\n') {
+				// A new line ends the line comments, the unterminated literals and the preprocessor directives
+				if (tracker.in_directive && !IsNewLineEscaped(content, current - content.buffer)) {
+					tracker.in_directive = false;
+				}
+				FinishLine(line, counts);
+				new_line_count++;
+				state = state == LEXER_BLOCK_COMMENT ? LEXER_BLOCK_COMMENT : LEXER_CODE;
+				current++;
+				continue;
+			}
+
+			switch (state) {
+			case LEXER_CODE:
+				if (character == '"') {
+					state = LEXER_STRING;
+					counts->token_count++;
+				}
+				else if (character == '\'') {
+					state = LEXER_CHARACTER;
+					counts->token_count++;
+				}
+				else if (character == '/' && (current[1] == '/' || current[1] == '*')) {
+					state = current[1] == '/' ? LEXER_LINE_COMMENT : LEXER_BLOCK_COMMENT;
+					line.has_comment = true;
+					comment_bytes += 2;
+					current += 2;
+					continue;
+				}
+				else if (CHARACTER_CLASSES.Is(character, CHARACTER_CLASS_IDENTIFIER)) {
+					line.has_code = true;
+					// Only the identifiers that start here can be keywords
+					bool identifier_start = current == content.buffer || !CHARACTER_CLASSES.Is(current[-1], CHARACTER_CLASS_IDENTIFIER);
+					counts->token_count += identifier_start;
+					// The function metrics need the namespace keyword as well, which is not a control keyword
+					if (identifier_start && (functions != nullptr || CHARACTER_CLASSES.Is(character, CHARACTER_CLASS_KEYWORD_START))) {
+						KEYWORD keyword = FindKeyword(current);
+						counts->logical_lines += KEYWORDS[keyword].is_control;
+						if (functions != nullptr) {
+							tracker.OnKeyword(keyword);
+						}
+					}
+				}
+				else {
+					counts->logical_lines += character == ';' || character == '{';
+					counts->token_count += !CHARACTER_CLASSES.Is(character, CHARACTER_CLASS_WHITESPACE) && character != '\\';
+					if (functions != nullptr) {
+						tracker.OnCharacter(character, current[1], current - content.buffer, new_line_count + 1);
+					}
+				}
+				break;
+			case LEXER_STRING:
+			case LEXER_CHARACTER:
+				if (character == '\\') {
+					// The escaped character is part of the literal, an escaped new line continues it
+					current++;
+					if (current < end) {
+						has_special_bytes |= IsSpecialByte(*current);
+						if (*current == '\n') {
+							FinishLine(line, counts);
+							new_line_count++;
+						}
+						else {
+							line.has_code |= CHARACTER_CLASSES.Is(*current, CHARACTER_CLASS_IDENTIFIER);
+						}
+					}
+					current++;
+					continue;
+				}
+				if (character == (state == LEXER_STRING ? '"' : '\'')) {
+					state = LEXER_CODE;
+				}
+				else {
+					line.has_code |= CHARACTER_CLASSES.Is(character, CHARACTER_CLASS_IDENTIFIER);
+				}
+				break;
+			case LEXER_LINE_COMMENT:
+				line.has_comment |= !CHARACTER_CLASSES.Is(character, CHARACTER_CLASS_WHITESPACE);
+				comment_bytes++;
+				break;
+			case LEXER_BLOCK_COMMENT:
+				if (character == '*' && current[1] == '/') {
+					line.has_comment = true;
+					state = LEXER_CODE;
+					comment_bytes += 2;
+					current += 2;
+					continue;
+				}
+				line.has_comment |= !CHARACTER_CLASSES.Is(character, CHARACTER_CLASS_WHITESPACE);
+				comment_bytes++;
+				break;
+			}
+			current++;
+		}
+
+		FinishFile(content, line, new_line_count, comment_bytes, counts);
+		return has_special_bytes;
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+#else
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	// One bit per byte of a 64 byte block. The next_ masks describe the byte that follows each position
+	struct BlockMasks {
+		uint64_t quote;
+		uint64_t apostrophe;
+		uint64_t backslash;
+		uint64_t slash;
+		uint64_t star;
+		uint64_t new_line;
+		uint64_t semicolon;
+		uint64_t open_brace;
+		uint64_t identifier;
+		uint64_t whitespace;
+		uint64_t keyword_start;
+		uint64_t next_slash;
+		uint64_t next_star;
+		// The null bytes and the bytes above 127
+		uint64_t special;
+	};
+
+	// The characters that only the function metrics need. They are classified only when requested
+	struct FunctionBlockMasks {
+		uint64_t hash;
+		// The first character of the namespace keyword, which is not in the control keyword class
+		uint64_t namespace_start;
+		uint64_t open_paren;
+		uint64_t close_paren;
+		uint64_t close_brace;
+		uint64_t question;
+		uint64_t ampersand;
+		uint64_t pipe;
+	};
+
+#if defined(__AVX512BW__)
+
+	static inline void ClassifyBlock(const char* pointer, BlockMasks& masks) {
+		__m512i input = _mm512_loadu_si512(pointer);
+		__m512i next = _mm512_loadu_si512(pointer + 1);
+
+		masks.quote = _mm512_cmpeq_epi8_mask(input, _mm512_set1_epi8('"'));
+		masks.apostrophe = _mm512_cmpeq_epi8_mask(input, _mm512_set1_epi8('\''));
+		masks.backslash = _mm512_cmpeq_epi8_mask(input, _mm512_set1_epi8('\\'));
+		masks.slash = _mm512_cmpeq_epi8_mask(input, _mm512_set1_epi8('/'));
+		masks.star = _mm512_cmpeq_epi8_mask(input, _mm512_set1_epi8('*'));
+		masks.new_line = _mm512_cmpeq_epi8_mask(input, _mm512_set1_epi8('\n'));
+		masks.semicolon = _mm512_cmpeq_epi8_mask(input, _mm512_set1_epi8(';'));
+		masks.open_brace = _mm512_cmpeq_epi8_mask(input, _mm512_set1_epi8('{'));
+		masks.next_slash = _mm512_cmpeq_epi8_mask(next, _mm512_set1_epi8('/'));
+		masks.next_star = _mm512_cmpeq_epi8_mask(next, _mm512_set1_epi8('*'));
+		masks.special = _mm512_movepi8_mask(input) | _mm512_cmpeq_epi8_mask(input, _mm512_setzero_si512());
+
+		__m512i low_table = _mm512_maskz_broadcast_i32x4(0xFFFF, _mm_loadu_si128((const __m128i*)CHARACTER_CLASSES_LOOKUP.low));
+		__m512i high_table = _mm512_maskz_broadcast_i32x4(0xFFFF, _mm_loadu_si128((const __m128i*)CHARACTER_CLASSES_LOOKUP.high));
+		__m512i nibble_mask = _mm512_set1_epi8(0x0F);
+		__m512i low_nibbles = _mm512_and_si512(input, nibble_mask);
+		__m512i high_nibbles = _mm512_and_si512(_mm512_srli_epi16(input, 4), nibble_mask);
+		__m512i classes = _mm512_and_si512(_mm512_shuffle_epi8(low_table, low_nibbles), _mm512_shuffle_epi8(high_table, high_nibbles));
+		masks.identifier = _mm512_test_epi8_mask(classes, _mm512_set1_epi8(CHARACTER_CLASSES_LOOKUP.Bits(CHARACTER_CLASS_IDENTIFIER)));
+		masks.whitespace = _mm512_test_epi8_mask(classes, _mm512_set1_epi8(CHARACTER_CLASSES_LOOKUP.Bits(CHARACTER_CLASS_WHITESPACE)));
+		masks.keyword_start = _mm512_test_epi8_mask(classes, _mm512_set1_epi8(CHARACTER_CLASSES_LOOKUP.Bits(CHARACTER_CLASS_KEYWORD_START)));
+	}
+
+	static inline void ClassifyFunctionBlock(const char* pointer, FunctionBlockMasks& masks) {
+		__m512i input = _mm512_loadu_si512(pointer);
+		masks.hash = _mm512_cmpeq_epi8_mask(input, _mm512_set1_epi8('#'));
+		masks.namespace_start = _mm512_cmpeq_epi8_mask(input, _mm512_set1_epi8('n'));
+		masks.open_paren = _mm512_cmpeq_epi8_mask(input, _mm512_set1_epi8('('));
+		masks.close_paren = _mm512_cmpeq_epi8_mask(input, _mm512_set1_epi8(')'));
+		masks.close_brace = _mm512_cmpeq_epi8_mask(input, _mm512_set1_epi8('}'));
+		masks.question = _mm512_cmpeq_epi8_mask(input, _mm512_set1_epi8('?'));
+		masks.ampersand = _mm512_cmpeq_epi8_mask(input, _mm512_set1_epi8('&'));
+		masks.pipe = _mm512_cmpeq_epi8_mask(input, _mm512_set1_epi8('|'));
+	}
+
+#else
+
+#if defined(__AVX2__)
+	typedef __m256i Vector;
+#define VECTOR_SIZE 32
+#define VectorLoad(pointer) _mm256_loadu_si256((const __m256i*)(pointer))
+#define VectorSet(value) _mm256_set1_epi8(value)
+#define VectorEqual(first, second) _mm256_cmpeq_epi8(first, second)
+#define VectorGreater(first, second) _mm256_cmpgt_epi8(first, second)
+#define VectorAnd(first, second) _mm256_and_si256(first, second)
+#define VectorOr(first, second) _mm256_or_si256(first, second)
+#define VectorMask(vector) ((uint64_t)(uint32_t)_mm256_movemask_epi8(vector))
+#define VectorLoadTable(pointer) _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(pointer)))
+#define VectorShuffle(table, indices) _mm256_shuffle_epi8(table, indices)
+#define VectorShiftRight16(vector, count) _mm256_srli_epi16(vector, count)
+#else
+	typedef __m128i Vector;
+#define VECTOR_SIZE 16
+#define VectorLoad(pointer) _mm_loadu_si128((const __m128i*)(pointer))
+#define VectorSet(value) _mm_set1_epi8(value)
+#define VectorEqual(first, second) _mm_cmpeq_epi8(first, second)
+#define VectorGreater(first, second) _mm_cmpgt_epi8(first, second)
+#define VectorAnd(first, second) _mm_and_si128(first, second)
+#define VectorOr(first, second) _mm_or_si128(first, second)
+#define VectorMask(vector) ((uint64_t)(uint32_t)_mm_movemask_epi8(vector))
+#define VectorLoadTable(pointer) _mm_loadu_si128((const __m128i*)(pointer))
+#define VectorShuffle(table, indices) _mm_shuffle_epi8(table, indices)
+#define VectorShiftRight16(vector, count) _mm_srli_epi16(vector, count)
+#endif
+
+	static inline void ClassifyBlock(const char* pointer, BlockMasks& masks) {
+		masks = {};
+#ifdef COUNTING_KERNEL_NIBBLE_LOOKUP
+		const uint64_t VECTOR_BITS = VECTOR_SIZE == 64 ? ~0ull : (1ull << VECTOR_SIZE) - 1;
+		Vector low_table = VectorLoadTable(CHARACTER_CLASSES_LOOKUP.low);
+		Vector high_table = VectorLoadTable(CHARACTER_CLASSES_LOOKUP.high);
+		Vector identifier_bits = VectorSet(CHARACTER_CLASSES_LOOKUP.Bits(CHARACTER_CLASS_IDENTIFIER));
+		Vector whitespace_bits = VectorSet(CHARACTER_CLASSES_LOOKUP.Bits(CHARACTER_CLASS_WHITESPACE));
+		Vector keyword_start_bits = VectorSet(CHARACTER_CLASSES_LOOKUP.Bits(CHARACTER_CLASS_KEYWORD_START));
+		Vector nibble_mask = VectorSet(0x0F);
+		Vector zero = VectorSet(0);
+#endif
+		for (unsigned int offset = 0; offset < 64; offset += VECTOR_SIZE) {
+			Vector input = VectorLoad(pointer + offset);
+			Vector next = VectorLoad(pointer + offset + 1);
+
+			Vector new_line = VectorEqual(input, VectorSet('\n'));
+			masks.quote |= VectorMask(VectorEqual(input, VectorSet('"'))) << offset;
+			masks.apostrophe |= VectorMask(VectorEqual(input, VectorSet('\''))) << offset;
+			masks.backslash |= VectorMask(VectorEqual(input, VectorSet('\\'))) << offset;
+			masks.slash |= VectorMask(VectorEqual(input, VectorSet('/'))) << offset;
+			masks.star |= VectorMask(VectorEqual(input, VectorSet('*'))) << offset;
+			masks.new_line |= VectorMask(new_line) << offset;
+			masks.semicolon |= VectorMask(VectorEqual(input, VectorSet(';'))) << offset;
+			masks.open_brace |= VectorMask(VectorEqual(input, VectorSet('{'))) << offset;
+			masks.next_slash |= VectorMask(VectorEqual(next, VectorSet('/'))) << offset;
+			masks.next_star |= VectorMask(VectorEqual(next, VectorSet('*'))) << offset;
+			// The movemask of the input itself gives the bytes above 127
+			masks.special |= (VectorMask(input) | VectorMask(VectorEqual(input, VectorSet(0)))) << offset;
+
+#ifdef COUNTING_KERNEL_NIBBLE_LOOKUP
+			Vector low_nibbles = VectorAnd(input, nibble_mask);
+			Vector high_nibbles = VectorAnd(VectorShiftRight16(input, 4), nibble_mask);
+			Vector classes = VectorAnd(VectorShuffle(low_table, low_nibbles), VectorShuffle(high_table, high_nibbles));
+			masks.identifier |= (~VectorMask(VectorEqual(VectorAnd(classes, identifier_bits), zero)) & VECTOR_BITS) << offset;
+			masks.whitespace |= (~VectorMask(VectorEqual(VectorAnd(classes, whitespace_bits), zero)) & VECTOR_BITS) << offset;
+			masks.keyword_start |= (~VectorMask(VectorEqual(VectorAnd(classes, keyword_start_bits), zero)) & VECTOR_BITS) << offset;
+#else
+			// The signed compares reject the bytes above 127
+			Vector lower = VectorOr(input, VectorSet(0x20));
+			Vector letter = VectorAnd(VectorGreater(lower, VectorSet('a' - 1)), VectorGreater(VectorSet('z' + 1), lower));
+			Vector digit = VectorAnd(VectorGreater(input, VectorSet('0' - 1)), VectorGreater(VectorSet('9' + 1), input));
+			Vector underscore = VectorEqual(input, VectorSet('_'));
+			masks.identifier |= VectorMask(VectorOr(VectorOr(letter, digit), underscore)) << offset;
+
+			// Space, \t, \v, \f and \r
+			Vector control_whitespace = VectorAnd(VectorGreater(input, VectorSet('\t' - 1)), VectorGreater(VectorSet('\r' + 1), input));
+			uint64_t whitespace = VectorMask(VectorOr(control_whitespace, VectorEqual(input, VectorSet(' '))));
+			masks.whitespace |= (whitespace << offset) & ~masks.new_line;
+#endif
+		}
+#ifndef COUNTING_KERNEL_NIBBLE_LOOKUP
+		// The keyword start class only filters the candidates, all the identifier characters are a valid superset
+		masks.keyword_start = masks.identifier;
+#endif
+	}
+
+	static inline void ClassifyFunctionBlock(const char* pointer, FunctionBlockMasks& masks) {
+		masks = {};
+		for (unsigned int offset = 0; offset < 64; offset += VECTOR_SIZE) {
+			Vector input = VectorLoad(pointer + offset);
+			masks.hash |= VectorMask(VectorEqual(input, VectorSet('#'))) << offset;
+			masks.namespace_start |= VectorMask(VectorEqual(input, VectorSet('n'))) << offset;
+			masks.open_paren |= VectorMask(VectorEqual(input, VectorSet('('))) << offset;
+			masks.close_paren |= VectorMask(VectorEqual(input, VectorSet(')'))) << offset;
+			masks.close_brace |= VectorMask(VectorEqual(input, VectorSet('}'))) << offset;
+			masks.question |= VectorMask(VectorEqual(input, VectorSet('?'))) << offset;
+			masks.ampersand |= VectorMask(VectorEqual(input, VectorSet('&'))) << offset;
+			masks.pipe |= VectorMask(VectorEqual(input, VectorSet('|'))) << offset;
+		}
+	}
+
+#undef VECTOR_SIZE
+#undef VectorLoad
+#undef VectorSet
+#undef VectorEqual
+#undef VectorGreater
+#undef VectorAnd
+#undef VectorOr
+#undef VectorMask
+#undef VectorLoadTable
+#undef VectorShuffle
+#undef VectorShiftRight16
+
+#endif
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	// Each set bit toggles the in-string state: bit i of the result is the xor of the bits 0..i
+	static inline uint64_t PrefixXor(uint64_t bits) {
+#if defined(__PCLMUL__)
+		// A carry-less multiplication with all ones is exactly the prefix xor
+		__m128i product = _mm_clmulepi64_si128(_mm_set_epi64x(0, (long long)bits), _mm_set1_epi8((char)0xFF), 0);
+		return (uint64_t)_mm_cvtsi128_si64(product);
+#else
+		bits ^= bits << 1;
+		bits ^= bits << 2;
+		bits ^= bits << 4;
+		bits ^= bits << 8;
+		bits ^= bits << 16;
+		bits ^= bits << 32;
+		return bits;
+#endif
+	}
+
+	static inline unsigned int TrailingZeroCount(uint64_t bits) {
+		return (unsigned int)__builtin_ctzll(bits);
+	}
+
+	static inline unsigned int PopCount(uint64_t bits) {
+		return (unsigned int)__builtin_popcountll(bits);
+	}
+
+	// The bits that are preceded by an odd number of backslashes. The carry tells if the first
+	// bit of the next block is escaped
+	static inline uint64_t FindEscaped(uint64_t backslash, uint64_t& escaped_carry) {
+		const uint64_t EVEN_BITS = 0x5555555555555555ull;
+
+		// An escaped backslash can't escape the next character
+		backslash &= ~escaped_carry;
+		uint64_t follows_escape = (backslash << 1) | escaped_carry;
+		uint64_t odd_sequence_starts = backslash & ~EVEN_BITS & ~follows_escape;
+		uint64_t sequences_starting_on_even_bits;
+		escaped_carry = __builtin_add_overflow(odd_sequence_starts, backslash, &sequences_starting_on_even_bits);
+		uint64_t invert_mask = sequences_starting_on_even_bits << 1;
+		return (EVEN_BITS ^ invert_mask) & follows_escape;
+	}
+
+	// Bits [start, 64)
+	static inline uint64_t MaskFrom(unsigned int start) {
+		return start >= 64 ? 0 : ~0ull << start;
+	}
+
+	// Bits [0, end)
+	static inline uint64_t MaskBefore(unsigned int end) {
+		return end >= 64 ? ~0ull : (1ull << end) - 1;
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	struct BlockLexer {
+		LEXER_STATE state = LEXER_CODE;
+		// How many bytes at the start of the next block belong to a comment token that started in this block
+		unsigned int comment_token_carry = 0;
+		uint64_t escaped_carry = 0;
+		// Set when the last byte of the previous block is an identifier character
+		uint64_t identifier_carry = 0;
+		LineState line = { false, false };
+		size_t new_line_count = 0;
+		// The new lines inside the comments are not counted
+		size_t comment_bytes = 0;
+		uint64_t special_bytes = 0;
+		FunctionTracker tracker;
+
+		// Returns the bits of the block that are inside comments, the comment tokens included. The literal
+		// bits are those of the string and character literals, the quotes included. The literal starts are
+		// the opening quotes
+		uint64_t ResolveComments(const char* block, const BlockMasks& masks, uint64_t escaped, uint64_t& literal_bits, uint64_t& literal_starts) {
+			literal_bits = 0;
+			literal_starts = 0;
+			uint64_t comment_bits = MaskBefore(comment_token_carry);
+			unsigned int position = comment_token_carry;
+			comment_token_carry = 0;
+
+			// Fast paths for the blocks that don't change the state or that have only strings
+			if (state == LEXER_BLOCK_COMMENT) {
+				if ((masks.star & masks.next_slash & MaskFrom(position)) == 0) {
+					return ~0ull;
+				}
+			}
+			else if (state == LEXER_CODE || state == LEXER_STRING) {
+				// Resolve the string regions with a prefix xor of the unescaped quotes. This is valid only if
+				// the block has no comment or character literal and no string that spans a new line
+				uint64_t in_string = PrefixXor(masks.quote & ~escaped) ^ (state == LEXER_STRING ? ~0ull : 0);
+				uint64_t outside_string = ~in_string & MaskFrom(position);
+				uint64_t comment_starts = masks.slash & (masks.next_slash | masks.next_star);
+				uint64_t breaking = ((comment_starts | masks.apostrophe | (masks.quote & escaped)) & outside_string)
+					| (masks.new_line & in_string & ~escaped);
+				if (breaking == 0) {
+					state = (in_string >> 63) ? LEXER_STRING : LEXER_CODE;
+					// The closing quotes are not in the prefix xor
+					literal_bits = in_string | (masks.quote & ~escaped);
+					literal_starts = in_string & masks.quote & ~escaped;
+					return comment_bits;
+				}
+			}
+
+			// The general path visits only the bytes that can change the state
+			uint64_t comment_starts = masks.slash & (masks.next_slash | masks.next_star);
+			unsigned int literal_start = position;
+			while (position < 64) {
+				uint64_t from = MaskFrom(position);
+				uint64_t candidates;
+				switch (state) {
+				case LEXER_CODE:
+					candidates = (masks.quote | masks.apostrophe | comment_starts) & from;
+					if (candidates == 0) {
+						return comment_bits;
+					}
+					position = TrailingZeroCount(candidates);
+					if (block[position] == '"') {
+						state = LEXER_STRING;
+						literal_start = position;
+						literal_starts |= 1ull << position;
+						position++;
+					}
+					else if (block[position] == '\'') {
+						state = LEXER_CHARACTER;
+						literal_start = position;
+						literal_starts |= 1ull << position;
+						position++;
+					}
+					else {
+						state = block[position + 1] == '/' ? LEXER_LINE_COMMENT : LEXER_BLOCK_COMMENT;
+						comment_bits |= 3ull << position;
+						position += 2;
+					}
+					break;
+				case LEXER_STRING:
+				case LEXER_CHARACTER:
+					candidates = ((state == LEXER_STRING ? masks.quote : masks.apostrophe) | masks.new_line) & ~escaped & from;
+					if (candidates == 0) {
+						literal_bits |= MaskFrom(literal_start);
+						return comment_bits;
+					}
+					position = TrailingZeroCount(candidates) + 1;
+					literal_bits |= MaskFrom(literal_start) & MaskBefore(position);
+					state = LEXER_CODE;
+					break;
+				case LEXER_LINE_COMMENT:
+					candidates = masks.new_line & from;
+					if (candidates == 0) {
+						return comment_bits | from;
+					}
+					position = TrailingZeroCount(candidates);
+					comment_bits |= from & MaskBefore(position);
+					state = LEXER_CODE;
+					break;
+				case LEXER_BLOCK_COMMENT:
+					candidates = masks.star & masks.next_slash & from;
+					if (candidates == 0) {
+						return comment_bits | from;
+					}
+					position = TrailingZeroCount(candidates) + 2;
+					comment_bits |= from & MaskBefore(position);
+					state = LEXER_CODE;
+					break;
+				}
+			}
+
+			// A literal that was opened on the last byte
+			if (state == LEXER_STRING || state == LEXER_CHARACTER) {
+				literal_bits |= MaskFrom(literal_start);
+			}
+			// A two character comment token that started on the last byte
+			comment_token_carry = position - 64;
+			return comment_bits;
+		}
+
+		// The bits from each # up to the first new line that is not escaped. The flag carries
+		// a directive that continues from the previous block into the next one
+		static uint64_t FindDirectives(uint64_t hashes, uint64_t directive_ends, bool& in_directive) {
+			uint64_t directives = 0;
+			unsigned int position = 0;
+			while (true) {
+				if (in_directive) {
+					uint64_t ends = directive_ends & MaskFrom(position);
+					if (ends == 0) {
+						return directives | MaskFrom(position);
+					}
+					unsigned int end = TrailingZeroCount(ends);
+					directives |= MaskFrom(position) & MaskBefore(end + 1);
+					in_directive = false;
+					position = end + 1;
+				}
+				hashes &= MaskFrom(position);
+				if (hashes == 0) {
+					return directives;
+				}
+				position = TrailingZeroCount(hashes);
+				in_directive = true;
+			}
+		}
+
+		// Outside of the function bodies the structural tokens are visited one by one. Inside a body only
+		// the braces are visited and the decision points in between are counted with a popcount
+		void ProcessFunctionTokens(
+			const char* block,
+			size_t block_offset,
+			const BlockMasks& masks,
+			const FunctionBlockMasks& function_masks,
+			uint64_t escaped,
+			uint64_t outside,
+			uint64_t decision_keywords,
+			uint64_t namespace_keywords
+		) {
+			// The tokens are replayed outside of the directives, the directive state is restored for the next block
+			bool in_directive = tracker.in_directive;
+			tracker.in_directive = false;
+			uint64_t active = outside & ~FindDirectives(function_masks.hash & outside, masks.new_line & ~escaped, in_directive);
+			uint64_t braces = (masks.open_brace | function_masks.close_brace) & active;
+			uint64_t structural = ((masks.semicolon | function_masks.open_paren | function_masks.close_paren | namespace_keywords) & active) | braces;
+
+			// The pairs use the byte after the block, which is at most the null terminator
+			uint64_t next_ampersand = (function_masks.ampersand >> 1) | ((uint64_t)(block[64] == '&') << 63);
+			uint64_t next_pipe = (function_masks.pipe >> 1) | ((uint64_t)(block[64] == '|') << 63);
+			uint64_t decisions = (function_masks.question | (function_masks.ampersand & next_ampersand) | (function_masks.pipe & next_pipe)
+				| decision_keywords) & active;
+
+			unsigned int position = 0;
+			while (position < 64) {
+				uint64_t from = MaskFrom(position);
+				uint64_t events = (tracker.in_function ? braces : structural) & from;
+				if (events == 0) {
+					tracker.current.complexity += tracker.in_function ? PopCount(decisions & from) : 0;
+					break;
+				}
+
+				unsigned int event = TrailingZeroCount(events);
+				if (tracker.in_function) {
+					tracker.current.complexity += PopCount(decisions & from & MaskBefore(event));
+				}
+				if (namespace_keywords & (1ull << event)) {
+					tracker.OnKeyword(KEYWORD_NAMESPACE);
+				}
+				else {
+					size_t line_number = new_line_count + PopCount(masks.new_line & MaskBefore(event)) + 1;
+					tracker.OnCharacter(block[event], block[event + 1], block_offset + event, line_number);
+				}
+				position = event + 1;
+			}
+			tracker.in_directive = in_directive;
+		}
+
+		void ProcessBlock(const char* block, size_t block_offset, BlockMasks& masks, uint64_t valid, FileCounts* counts) {
+			uint64_t escaped = FindEscaped(masks.backslash, escaped_carry);
+			special_bytes |= masks.special & valid;
+			uint64_t literal_bits;
+			uint64_t literal_starts;
+			uint64_t comment_bits = ResolveComments(block, masks, escaped, literal_bits, literal_starts) & valid;
+			comment_bytes += PopCount(comment_bits & ~masks.new_line);
+
+			// The statements and the keywords are looked for only outside of comments and literals
+			uint64_t outside = ~(comment_bits | literal_bits) & valid;
+			counts->logical_lines += PopCount((masks.semicolon | masks.open_brace) & outside);
+			uint64_t identifier_starts = masks.identifier & ~((masks.identifier << 1) | identifier_carry);
+			identifier_carry = masks.identifier >> 63;
+
+			uint64_t punctuation = ~(masks.identifier | masks.whitespace | masks.new_line | masks.backslash);
+			counts->token_count += PopCount(identifier_starts & outside) + PopCount(punctuation & outside) + PopCount(literal_starts & valid);
+			uint64_t keyword_candidates = identifier_starts & masks.keyword_start & outside;
+			if (tracker.functions == nullptr) {
+				while (keyword_candidates != 0) {
+					counts->logical_lines += KEYWORDS[FindKeyword(block + TrailingZeroCount(keyword_candidates))].is_control;
+					keyword_candidates &= keyword_candidates - 1;
+				}
+			}
+			else {
+				FunctionBlockMasks function_masks;
+				ClassifyFunctionBlock(block, function_masks);
+				keyword_candidates |= identifier_starts & function_masks.namespace_start & outside;
+
+				uint64_t decision_keywords = 0;
+				uint64_t namespace_keywords = 0;
+				while (keyword_candidates != 0) {
+					unsigned int position = TrailingZeroCount(keyword_candidates);
+					KEYWORD keyword = FindKeyword(block + position);
+					counts->logical_lines += KEYWORDS[keyword].is_control;
+					decision_keywords |= (uint64_t)KEYWORDS[keyword].is_decision << position;
+					namespace_keywords |= (uint64_t)(keyword == KEYWORD_NAMESPACE) << position;
+					keyword_candidates &= keyword_candidates - 1;
+				}
+
+				// Before the new lines of this block are added, the tokens need the line count up to the block
+				ProcessFunctionTokens(block, block_offset, masks, function_masks, escaped, outside, decision_keywords, namespace_keywords);
+			}
+
+			uint64_t code = masks.identifier & ~comment_bits & valid;
+			uint64_t comment = comment_bits & ~masks.whitespace & ~masks.new_line;
+			uint64_t new_lines = masks.new_line & valid;
+			new_line_count += PopCount(new_lines);
+
+			// Classify each line that ends in this block, then carry the rest into the next block
+			uint64_t line_start = 0;
+			while (new_lines != 0) {
+				unsigned int new_line = TrailingZeroCount(new_lines);
+				uint64_t line_bits = MaskBefore(new_line + 1) & ~MaskBefore((unsigned int)line_start);
+				line.has_code |= (code & line_bits) != 0;
+				line.has_comment |= (comment & line_bits) != 0;
+				FinishLine(line, counts);
+				line_start = new_line + 1;
+				new_lines &= new_lines - 1;
+			}
+			uint64_t remaining = MaskFrom((unsigned int)line_start);
+			line.has_code |= (code & remaining) != 0;
+			line.has_comment |= (comment & remaining) != 0;
+		}
+	};
+
+	// ------------------------------------------------------------------------------------------------------------
+
+	bool CountFile(Stream<char> content, FileCounts* counts, CapacityStream<FunctionMetrics>* functions) {
+		*counts = {};
+		BlockLexer lexer;
+		BlockMasks masks;
+		lexer.tracker.content = content;
+		lexer.tracker.functions = functions;
+
+		// The full blocks read one byte past their end, which is at most the null terminator
+		const char* current = content.buffer;
+		const char* end = content.buffer + content.size;
+		while (current + 64 <= end) {
+			ClassifyBlock(current, masks);
+			lexer.ProcessBlock(current, current - content.buffer, masks, ~0ull, counts);
+			current += 64;
+		}
+
+		size_t remaining = end - current;
+		if (remaining > 0) {
+			// The last partial block is copied into a zeroed buffer, such that the loads stay in bounds
+			alignas(64) char tail[128] = {};
+			memcpy(tail, current, remaining);
+			ClassifyBlock(tail, masks);
+			lexer.ProcessBlock(tail, current - content.buffer, masks, MaskBefore((unsigned int)remaining), counts);
+		}
+
+		FinishFile(content, lexer.line, lexer.new_line_count, lexer.comment_bytes, counts);
+		return lexer.special_bytes != 0;
+	}
+
+	// ------------------------------------------------------------------------------------------------------------
+
+#endif
+
+}
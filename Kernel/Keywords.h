@@ -0,0 +1,89 @@
+#pragma once
+#include <string.h>
+
+// The keywords of the C family that the lexer looks for. They are matched with a perfect hash of their
+// length and their first and last characters, followed by a single compare against the keyword in that slot
+enum KEYWORD : unsigned char {
+	KEYWORD_NONE,
+	KEYWORD_IF,
+	KEYWORD_ELSE,
+	KEYWORD_FOR,
+	KEYWORD_WHILE,
+	KEYWORD_DO,
+	KEYWORD_SWITCH,
+	KEYWORD_CASE,
+	KEYWORD_DEFAULT,
+	KEYWORD_TRY,
+	KEYWORD_CATCH,
+	KEYWORD_NAMESPACE,
+	KEYWORD_COUNT
+};
+
+struct KeywordDescriptor {
+	const char* text;
+	unsigned int length;
+	// The control keywords count as a logical line on their own
+	bool is_control;
+	// The keywords that add a path to the cyclomatic complexity
+	bool is_decision;
+};
+
+constexpr KeywordDescriptor KEYWORDS[KEYWORD_COUNT] = {
+	{ "", 0, false, false },
+	{ "if", 2, true, true },
+	{ "else", 4, true, false },
+	{ "for", 3, true, true },
+	{ "while", 5, true, true },
+	{ "do", 2, true, false },
+	{ "switch", 6, true, false },
+	{ "case", 4, true, true },
+	{ "default", 7, true, false },
+	{ "try", 3, true, false },
+	{ "catch", 5, true, true },
+	{ "namespace", 9, false, false }
+};
+
+#define KEYWORD_MIN_LENGTH 2
+#define KEYWORD_MAX_LENGTH 9
+#define KEYWORD_HASH_SIZE 32
+
+constexpr unsigned int KeywordHash(unsigned char first, unsigned char last, unsigned int length, unsigned int seed) {
+	return (first * seed + last * 3 + length) & (KEYWORD_HASH_SIZE - 1);
+}
+
+struct KeywordHashTable {
+	// 0 if no seed without collisions was found
+	unsigned int seed;
+	unsigned char slots[KEYWORD_HASH_SIZE];
+};
+
+constexpr KeywordHashTable MakeKeywordHashTable() {
+	for (unsigned int seed = 1; seed < 1024; seed++) {
+		KeywordHashTable table = {};
+		bool collision = false;
+		for (unsigned int index = 1; index < KEYWORD_COUNT && !collision; index++) {
+			const KeywordDescriptor& keyword = KEYWORDS[index];
+			unsigned int slot = KeywordHash(keyword.text[0], keyword.text[keyword.length - 1], keyword.length, seed);
+			collision = table.slots[slot] != KEYWORD_NONE;
+			table.slots[slot] = (unsigned char)index;
+		}
+		if (!collision) {
+			table.seed = seed;
+			return table;
+		}
+	}
+	return {};
+}
+
+inline constexpr KeywordHashTable KEYWORD_HASH_TABLE = MakeKeywordHashTable();
+static_assert(KEYWORD_HASH_TABLE.seed != 0, "The keywords don't have a perfect hash");
+
+// The identifier is given by its characters and its length
+inline KEYWORD MatchKeyword(const char* identifier, unsigned int length) {
+	if (length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH) {
+		return KEYWORD_NONE;
+	}
+	unsigned int slot = KeywordHash(identifier[0], identifier[length - 1], length, KEYWORD_HASH_TABLE.seed);
+	const KeywordDescriptor& keyword = KEYWORDS[KEYWORD_HASH_TABLE.slots[slot]];
+	return keyword.length == length && memcmp(identifier, keyword.text, length) == 0 ? (KEYWORD)KEYWORD_HASH_TABLE.slots[slot] : KEYWORD_NONE;
+}
@@ -0,0 +1,712 @@
+#include "LineCounter.h"
+
+#include <algorithm>
+
+#define DEFAULT_FILE_BUFFER_SIZE (CORE_MB * 10)
+
+const char* GetFileErrorDescription(LINE_COUNTER_FILE_ERROR error) {
+	switch (error) {
+	case LINE_COUNTER_FILE_ERROR_NONE:
+		return "no error";
+	case LINE_COUNTER_FILE_ERROR_OPEN:
+		return "could not be opened";
+	case LINE_COUNTER_FILE_ERROR_READ:
+		return "could not be read";
+	case LINE_COUNTER_FILE_ERROR_TOO_LARGE:
+		return "is too large";
+	case LINE_COUNTER_FILE_ERROR_BINARY:
+		return "is binary";
+	case LINE_COUNTER_FILE_ERROR_INVALID_ENCODING:
+		return "is not valid UTF-8, it was counted";
+	case LINE_COUNTER_FILE_ERROR_CRASH:
+		return "crashed a worker process";
+	case LINE_COUNTER_FILE_ERROR_WORKER:
+		return "was not counted, its worker process could not be started";
+	default:
+		return "unknown error";
+	}
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+void LineCounterFileTable::Resize(size_t count, bool with_functions) {
+	// The columns are carved from one block, the widest first such that each one stays aligned
+	const size_t COUNT_COLUMNS = 7;
+	size_t row_size = sizeof(unsigned int) * COUNT_COLUMNS + sizeof(LINE_COUNTER_FILE_ERROR) + sizeof(unsigned char);
+	row_size += with_functions ? sizeof(Stream<FunctionMetrics>) : 0;
+	size_t byte_size = std::max(row_size * count, (size_t)1);
+	if (byte_size > capacity) {
+		free(buffer);
+		buffer = malloc(byte_size);
+		capacity = byte_size;
+	}
+
+	char* pointer = (char*)buffer;
+	functions = nullptr;
+	if (with_functions) {
+		functions = (Stream<FunctionMetrics>*)pointer;
+		pointer += sizeof(Stream<FunctionMetrics>) * count;
+	}
+	unsigned int** count_columns[COUNT_COLUMNS] = { &code_lines, &comment_lines, &blank_lines, &total_lines, &logical_lines, &token_counts, &code_bytes };
+	for (size_t index = 0; index < COUNT_COLUMNS; index++) {
+		*count_columns[index] = (unsigned int*)pointer;
+		pointer += sizeof(unsigned int) * count;
+	}
+	errors = (LINE_COUNTER_FILE_ERROR*)pointer;
+	pointer += sizeof(LINE_COUNTER_FILE_ERROR) * count;
+	flags = (unsigned char*)pointer;
+	size = count;
+}
+
+void LineCounterFileTable::FreeBuffer() {
+	free(buffer);
+	buffer = nullptr;
+	capacity = 0;
+	size = 0;
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+struct DiscoveryRoot {
+	FileIdentity identity;
+	// The same directory as an earlier search path, it is not searched
+	bool is_repeated;
+};
+
+struct ListAllFilesInsidePathsData {
+	LineCounter* counter;
+	Stream<Stream<char>> search_paths;
+	Stream<DiscoveryRoot> roots;
+	Stream<Stream<char>> extensions;
+	Stream<ThreadPartition> thread_partitions;
+	// Set when the directories are listed through the tree snapshot
+	TreeSnapshot* tree_snapshot;
+	unsigned int shard_index;
+	unsigned int shard_count;
+	bool shard_by_directory;
+};
+
+// The shard depends only on the path, such that separate processes with the same search paths agree
+static unsigned int GetPathShard(Stream<char> path, unsigned int shard_count, bool by_directory) {
+	if (by_directory) {
+		while (path.size > 0 && path[path.size - 1] != '/') {
+			path.size--;
+		}
+	}
+	return (unsigned int)(function::HashString(path) % shard_count);
+}
+
+// The search paths are put into the visit set before the walks start, so a walk doesn't descend into a search
+// path that is nested in its own: a file is found from the innermost search path, even through symlinks
+static Stream<DiscoveryRoot> GetDiscoveryRoots(Stream<Stream<char>> search_paths, DirectoryVisitSet* visited, Arena* arena) {
+	Stream<DiscoveryRoot> roots = { arena->Allocate<DiscoveryRoot>(search_paths.size), search_paths.size };
+	for (size_t index = 0; index < search_paths.size; index++) {
+		roots[index].is_repeated = false;
+		if (GetFileIdentity(search_paths[index], &roots[index].identity)) {
+			roots[index].is_repeated = !visited->Insert(roots[index].identity);
+		}
+	}
+	return roots;
+}
+
+// The paths that a discovery thread found in one search path and didn't publish yet
+struct DiscoveryBatch {
+	Stream<char> paths[LINE_COUNTER_DISCOVERY_BATCH_SIZE];
+	unsigned int size;
+	unsigned int root_index;
+};
+
+// The whole batch is reserved with a single atomic operation, instead of two for each file. The paths that
+// don't fit in the source files go to the overflow of the thread, nothing is dropped
+static void PublishDiscoveryBatch(LineCounter* counter, unsigned int thread_id, DiscoveryBatch* batch) {
+	AtomicStream<Stream<char>>* source_files = &counter->source_files;
+	unsigned int position = source_files->RequestInt(batch->size);
+	unsigned int count = position < source_files->capacity ? std::min(batch->size, source_files->capacity - position) : 0;
+	if (count > 0) {
+		memcpy(source_files->buffer + position, batch->paths, sizeof(Stream<char>) * count);
+		for (unsigned int index = 0; index < count; index++) {
+			counter->source_roots[position + index] = batch->root_index;
+		}
+	}
+	source_files->FinishRequest(count);
+
+	for (unsigned int index = count; index < batch->size; index++) {
+		counter->thread_overflow_files[thread_id].Add(batch->paths[index]);
+		counter->thread_overflow_roots[thread_id].Add(batch->root_index);
+	}
+	batch->size = 0;
+}
+
+CORE_THREAD_TASK(ListAllFilesInsidePaths) {
+	ListAllFilesInsidePathsData* data = (ListAllFilesInsidePathsData*)_data;
+
+	struct FunctorData {
+		LineCounter* counter;
+		unsigned int thread_id;
+		const ListAllFilesInsidePathsData* list_data;
+		DiscoveryBatch batch;
+	};
+
+	FunctorData functor_data;
+	functor_data.counter = data->counter;
+	functor_data.thread_id = thread_id;
+	functor_data.list_data = data;
+	functor_data.batch.size = 0;
+
+	for (size_t index = 0; index < data->thread_partitions[thread_id].size; index++) {
+		functor_data.batch.root_index = data->thread_partitions[thread_id].offset + (unsigned int)index;
+		if (data->roots[functor_data.batch.root_index].is_repeated) {
+			continue;
+		}
+
+		ForEachFileFunctor functor = [](Stream<char> path, void* _data) {
+			FunctorData* data = (FunctorData*)_data;
+			const ListAllFilesInsidePathsData* list_data = data->list_data;
+			if (list_data->shard_count > 1 && GetPathShard(path, list_data->shard_count, list_data->shard_by_directory) != list_data->shard_index) {
+				return true;
+			}
+
+			data->batch.paths[data->batch.size++] = data->counter->thread_arenas[data->thread_id].StringCopy(path);
+			if (data->batch.size == LINE_COUNTER_DISCOVERY_BATCH_SIZE) {
+				PublishDiscoveryBatch(data->counter, data->thread_id, &data->batch);
+			}
+			return true;
+		};
+
+		Stream<char> search_path = data->search_paths[functor_data.batch.root_index];
+		if (data->tree_snapshot != nullptr) {
+			data->tree_snapshot->Walk(thread_id, search_path, data->extensions, &functor_data, functor, &data->counter->visited_directories, data->counter->thread_arenas + thread_id);
+		}
+		else {
+			ForEachFileInDirectoryRecursiveWithExtension(search_path, data->extensions, &functor_data, functor, &data->counter->visited_directories);
+		}
+
+		// A batch holds the files of a single search path
+		if (functor_data.batch.size > 0) {
+			PublishDiscoveryBatch(data->counter, thread_id, &functor_data.batch);
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+struct LineCountThreadTaskData {
+	LineCounter* counter;
+	LineCounterFileCallback callback;
+	void* callback_data;
+	bool record_per_file_results;
+	bool record_functions;
+	bool record_includes;
+	// Set while the checkpoint log is written
+	CheckpointLog* checkpoint;
+	// Set when the per file results are recorded
+	ConcurrentHashTable* path_table;
+};
+
+// The buffer grows to fit the file, up to LINE_COUNTER_MAX_FILE_SIZE. Returns the error of the file, if any
+static LINE_COUNTER_FILE_ERROR ReadSourceFile(FILE_HANDLE file_handle, Stream<char>* file_buffer, Stream<char>& content, int& system_error) {
+	size_t file_size = GetFileByteSize(file_handle);
+	if (file_size == CORE_FILE_SIZE_ERROR) {
+		system_error = errno;
+		return LINE_COUNTER_FILE_ERROR_READ;
+	}
+	if (file_size > LINE_COUNTER_MAX_FILE_SIZE) {
+		return LINE_COUNTER_FILE_ERROR_TOO_LARGE;
+	}
+	if (file_size > file_buffer->size) {
+		// One extra byte for the null terminator
+		void* new_buffer = realloc(file_buffer->buffer, file_size + 1);
+		if (new_buffer == nullptr) {
+			system_error = ENOMEM;
+			return LINE_COUNTER_FILE_ERROR_TOO_LARGE;
+		}
+		*file_buffer = { new_buffer, file_size };
+	}
+
+	// A file that grew since its size was taken is cut at the buffer size
+	size_t bytes_read = ReadFromFile(file_handle, *file_buffer);
+	if (bytes_read == CORE_FILE_SIZE_ERROR) {
+		system_error = errno;
+		return LINE_COUNTER_FILE_ERROR_READ;
+	}
+	content = { file_buffer->buffer, bytes_read };
+	content.buffer[bytes_read] = '\0';
+	return LINE_COUNTER_FILE_ERROR_NONE;
+}
+
+// Called only for the files in which the lexer saw a null byte or a byte above 127, the ASCII files skip the second pass
+static LINE_COUNTER_FILE_ERROR CheckSourceEncoding(Stream<char> content) {
+	TEXT_ENCODING encoding = function::GetTextEncoding(content);
+	if (encoding == TEXT_ENCODING_BINARY) {
+		return LINE_COUNTER_FILE_ERROR_BINARY;
+	}
+	return encoding == TEXT_ENCODING_INVALID_UTF8 ? LINE_COUNTER_FILE_ERROR_INVALID_ENCODING : LINE_COUNTER_FILE_ERROR_NONE;
+}
+
+CORE_THREAD_TASK(LineCountThreadTask) {
+	LineCountThreadTaskData* data = (LineCountThreadTaskData*)_data;
+	LineCounter* counter = data->counter;
+
+	ThreadPartition partition = counter->thread_partitions[thread_id];
+	LineCounterErrorTable* errors = counter->thread_errors + thread_id;
+	errors->Reset();
+	FileCounts* thread_totals = counter->thread_totals + thread_id;
+	*thread_totals = {};
+	LineCounterRootResult* root_totals = nullptr;
+	if (counter->root_results.size > 0) {
+		root_totals = counter->thread_root_results.buffer + thread_id * counter->root_results.size;
+		std::fill_n(root_totals, counter->root_results.size, LineCounterRootResult{});
+	}
+	if (partition.size == 0) {
+		return;
+	}
+
+	// Each thread inserts its own range, the table is complete when the count returns
+	if (data->path_table != nullptr) {
+		for (unsigned int index = partition.offset; index < partition.offset + partition.size; index++) {
+			data->path_table->Insert(index);
+		}
+	}
+
+	Stream<char>* file_buffer = counter->thread_file_buffers + thread_id;
+	Arena* arena = counter->thread_arenas + thread_id;
+
+	CapacityStream<FunctionMetrics>* function_buffer = nullptr;
+	if (data->record_functions) {
+		function_buffer = counter->thread_function_buffers + thread_id;
+		if (function_buffer->buffer == nullptr) {
+			*function_buffer = { malloc(sizeof(FunctionMetrics) * LINE_COUNTER_MAX_FUNCTIONS_PER_FILE), 0, LINE_COUNTER_MAX_FUNCTIONS_PER_FILE };
+		}
+	}
+
+	FILE_HANDLE file_handle = 0;
+	for (unsigned int index = 0; index < partition.size; index++) {
+		Stream<char> current_path = counter->source_files.buffer[partition.offset + index];
+		unsigned int root_index = counter->source_roots[partition.offset + index];
+		LineCounterFileResult file_result = { current_path, {}, {}, partition.offset + index, thread_id, true, LINE_COUNTER_FILE_ERROR_OPEN, 0, root_index };
+
+		bool is_resumed = data->checkpoint != nullptr && data->checkpoint->IsDone(partition.offset + index);
+		if (is_resumed) {
+			// Finished before the restart, only the counts and the warning were logged
+			const CheckpointFile* finished = data->checkpoint->files.buffer + partition.offset + index;
+			file_result.counts = finished->counts;
+			file_result.error = (LINE_COUNTER_FILE_ERROR)finished->error;
+			file_result.failed = false;
+			AddFileCounts(*thread_totals, file_result.counts);
+		}
+		else {
+			FILE_STATUS_FLAGS file_status = OpenFile(current_path, &file_handle, FILE_ACCESS_READ_ONLY | FILE_ACCESS_OPTIMIZE_SEQUENTIAL);
+			// If the opening succeded, try to read the whole file into a memory buffer
+			if (file_status == FILE_STATUS_OK) {
+				Stream<char> current_buffer;
+				file_result.error = ReadSourceFile(file_handle, file_buffer, current_buffer, file_result.system_error);
+				file_result.failed = IsFileErrorFailure(file_result.error);
+				if (!file_result.failed) {
+					if (function_buffer != nullptr) {
+						function_buffer->size = 0;
+					}
+					if (counter->kernel->count_file(current_buffer, &file_result.counts, function_buffer)) {
+						file_result.error = CheckSourceEncoding(current_buffer);
+						file_result.failed = IsFileErrorFailure(file_result.error);
+						if (file_result.failed) {
+							file_result.counts = {};
+						}
+					}
+				}
+				if (!file_result.failed) {
+					if (function_buffer != nullptr && function_buffer->size > 0) {
+						// The names point into the file buffer, which is reused for the next file
+						file_result.functions = { arena->Allocate<FunctionMetrics>(function_buffer->size), function_buffer->size };
+						for (unsigned int function_index = 0; function_index < function_buffer->size; function_index++) {
+							file_result.functions[function_index] = function_buffer->buffer[function_index];
+							file_result.functions[function_index].name = arena->StringCopy(function_buffer->buffer[function_index].name);
+						}
+					}
+
+					if (data->record_includes) {
+						counter->include_graph.ExtractIncludes(thread_id, partition.offset + index, current_buffer, file_result.counts.code_lines, arena);
+					}
+
+					AddFileCounts(*thread_totals, file_result.counts);
+					if (data->checkpoint != nullptr) {
+						data->checkpoint->Record(thread_id, partition.offset + index, file_result.counts, file_result.error);
+					}
+				}
+
+				// Close the file
+				CloseFile(file_handle);
+			}
+			else {
+				file_result.system_error = errno;
+			}
+		}
+
+		if (file_result.error != LINE_COUNTER_FILE_ERROR_NONE) {
+			errors->Add(current_path, file_result.error, file_result.system_error);
+		}
+		if (root_totals != nullptr) {
+			LineCounterRootResult* root = root_totals + root_index;
+			root->file_count++;
+			root->error_count += file_result.failed ? 1 : 0;
+			AddFileCounts(root->totals, file_result.counts);
+		}
+
+		// Each thread writes only its own rows, no synchronization is needed
+		if (data->record_per_file_results) {
+			unsigned char file_flags = file_result.failed ? LINE_COUNTER_FILE_FLAG_FAILED : 0;
+			file_flags |= is_resumed ? LINE_COUNTER_FILE_FLAG_RESUMED : 0;
+			counter->file_table.Set(partition.offset + index, file_result.counts, file_result.error, file_flags);
+			if (counter->file_table.functions != nullptr) {
+				counter->file_table.functions[partition.offset + index] = file_result.functions;
+			}
+		}
+		if (data->callback != nullptr) {
+			data->callback(&file_result, data->callback_data);
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+LineCounter::LineCounter(unsigned int thread_count) : thread_pool(thread_count), kernel(GetCountingKernel()),
+	include_graph(thread_pool.GetThreadCount()), checkpoint(thread_pool.GetThreadCount()), is_checkpoint_active(false),
+	tree_snapshot(thread_pool.GetThreadCount()) {
+	unsigned int pool_thread_count = thread_pool.GetThreadCount();
+
+	thread_arenas = new Arena[pool_thread_count];
+	thread_file_buffers = (Stream<char>*)malloc(sizeof(Stream<char>) * pool_thread_count);
+	thread_totals = (FileCounts*)malloc(sizeof(FileCounts) * pool_thread_count);
+	thread_errors = (LineCounterErrorTable*)malloc(sizeof(LineCounterErrorTable) * pool_thread_count);
+	thread_function_buffers = (CapacityStream<FunctionMetrics>*)malloc(sizeof(CapacityStream<FunctionMetrics>) * pool_thread_count);
+	for (unsigned int index = 0; index < pool_thread_count; index++) {
+		thread_function_buffers[index] = { nullptr, 0, 0 };
+		// One extra byte for the null terminator
+		thread_file_buffers[index] = { malloc(sizeof(char) * (DEFAULT_FILE_BUFFER_SIZE + 1)), DEFAULT_FILE_BUFFER_SIZE };
+		thread_errors[index].entries = { malloc(sizeof(LineCounterFileError) * LINE_COUNTER_MAX_ERRORS_PER_THREAD), 0, LINE_COUNTER_MAX_ERRORS_PER_THREAD };
+		thread_errors[index].Reset();
+	}
+
+	source_files = AtomicStream<Stream<char>>(malloc(sizeof(Stream<char>) * LINE_COUNTER_FILE_CAPACITY), 0, LINE_COUNTER_FILE_CAPACITY);
+	source_roots = (unsigned int*)malloc(sizeof(unsigned int) * LINE_COUNTER_FILE_CAPACITY);
+	thread_overflow_files = new ResizableStream<Stream<char>>[pool_thread_count];
+	thread_overflow_roots = new ResizableStream<unsigned int>[pool_thread_count];
+	file_table = {};
+	path_table = { nullptr, 0, source_files.buffer };
+	path_table_buffer = nullptr;
+	path_table_capacity = 0;
+	thread_partitions = { malloc(sizeof(ThreadPartition) * pool_thread_count), pool_thread_count };
+	error_results = { malloc(sizeof(LineCounterFileError) * LINE_COUNTER_MAX_ERRORS_PER_THREAD * pool_thread_count), 0 };
+}
+
+LineCounter::~LineCounter() {
+	unsigned int pool_thread_count = thread_pool.GetThreadCount();
+	for (unsigned int index = 0; index < pool_thread_count; index++) {
+		free(thread_file_buffers[index].buffer);
+		free(thread_errors[index].entries.buffer);
+		free(thread_function_buffers[index].buffer);
+		thread_overflow_files[index].FreeBuffer();
+		thread_overflow_roots[index].FreeBuffer();
+	}
+	delete[] thread_overflow_files;
+	delete[] thread_overflow_roots;
+
+	delete[] thread_arenas;
+	free(thread_file_buffers);
+	free(thread_totals);
+	free(thread_errors);
+	free(thread_function_buffers);
+	free(source_files.buffer);
+	free(source_roots);
+	root_results.FreeBuffer();
+	thread_root_results.FreeBuffer();
+	file_table.FreeBuffer();
+	free(path_table_buffer);
+	free(thread_partitions.buffer);
+	free(error_results.buffer);
+}
+
+LineCounterResults LineCounter::Count(Stream<Stream<char>> search_paths, const LineCounterOptions& options) {
+	return Count(search_paths, options, nullptr, nullptr);
+}
+
+LineCounterResults LineCounter::Count(
+	Stream<Stream<char>> search_paths,
+	const LineCounterOptions& options,
+	LineCounterFileCallback callback,
+	void* callback_data
+) {
+	std::lock_guard<std::mutex> guard(count_lock);
+
+	Timer timer;
+	DiscoverFilesWithCheckpoint(search_paths, options);
+	return CountSourceFiles(options, callback, callback_data, timer);
+}
+
+unsigned int LineCounter::FindFile(Stream<char> path) const {
+	return path_table.slots != nullptr ? path_table.Find(path) : CORE_HASH_TABLE_NOT_FOUND;
+}
+
+Stream<Stream<char>> LineCounter::ListFiles(Stream<Stream<char>> search_paths, const LineCounterOptions& options) {
+	std::lock_guard<std::mutex> guard(count_lock);
+
+	DiscoverFiles(search_paths, options);
+	return { source_files.buffer, source_files.size.load(CORE_RELAXED) };
+}
+
+LineCounterResults LineCounter::CountFiles(
+	Stream<Stream<char>> files,
+	const LineCounterOptions& options,
+	LineCounterFileCallback callback,
+	void* callback_data
+) {
+	std::lock_guard<std::mutex> guard(count_lock);
+
+	Timer timer;
+	// The files returned by ListFiles live in the arenas and are already in place
+	if (files.buffer != source_files.buffer) {
+		ClearArenas();
+		unsigned int file_count = (unsigned int)files.size;
+		ReserveSourceFiles(file_count);
+		memcpy(source_files.buffer, files.buffer, sizeof(Stream<char>) * file_count);
+		memset(source_roots, 0, sizeof(unsigned int) * file_count);
+		visited_directories.Clear();
+		tree_snapshot.Reset();
+		source_files.size.store(file_count, CORE_RELAXED);
+		source_files.write_index.store(file_count, CORE_RELAXED);
+		root_results.size = 0;
+	}
+	return CountSourceFiles(options, callback, callback_data, timer);
+}
+
+void LineCounter::ReserveSourceFiles(unsigned int count) {
+	if (count > source_files.capacity) {
+		Stream<char>* files = (Stream<char>*)realloc(source_files.buffer, sizeof(Stream<char>) * count);
+		unsigned int* roots = (unsigned int*)realloc(source_roots, sizeof(unsigned int) * count);
+		CORE_ASSERT(files != nullptr && roots != nullptr, "The source files could not grow.");
+		source_files.buffer = files;
+		source_roots = roots;
+		source_files.capacity = count;
+	}
+}
+
+void LineCounter::ClearArenas() {
+	unsigned int thread_count = thread_pool.GetThreadCount();
+	for (unsigned int index = 0; index < thread_count; index++) {
+		thread_arenas[index].Clear();
+	}
+}
+
+void LineCounter::DiscoverFiles(Stream<Stream<char>> search_paths, const LineCounterOptions& options) {
+	// Reset the state of the previous call
+	ClearArenas();
+	source_files.Reset();
+	unsigned int thread_count = thread_pool.GetThreadCount();
+	for (unsigned int index = 0; index < thread_count; index++) {
+		thread_overflow_files[index].size = 0;
+		thread_overflow_roots[index].size = 0;
+	}
+
+	Stream<char> default_extensions[] = {
+		".cpp",
+		".c",
+		".hpp",
+		".h"
+	};
+
+	ListAllFilesInsidePathsData list_data;
+	list_data.counter = this;
+	list_data.search_paths = search_paths;
+	// The arenas were cleared, nothing else allocates from them before the threads start
+	visited_directories.Clear();
+	list_data.roots = GetDiscoveryRoots(search_paths, &visited_directories, thread_arenas);
+	list_data.extensions = options.extensions.size > 0 ? options.extensions : Stream<Stream<char>>(default_extensions, std::size(default_extensions));
+	list_data.thread_partitions = thread_partitions;
+	list_data.tree_snapshot = nullptr;
+	list_data.shard_index = options.shard_index;
+	list_data.shard_count = options.shard_count;
+	list_data.shard_by_directory = options.shard_by_directory;
+	ThreadPartitionStream(list_data.thread_partitions, search_paths.size);
+
+	// The snapshot lists every file with the extensions, the shards are applied on top of it
+	uint64_t snapshot_fingerprint = list_data.extensions.size;
+	for (size_t index = 0; index < list_data.extensions.size; index++) {
+		snapshot_fingerprint = (snapshot_fingerprint ^ function::HashString(list_data.extensions[index])) * 1099511628211ull;
+	}
+	tree_snapshot.Reset();
+	if (options.tree_snapshot_path.size > 0) {
+		tree_snapshot.Load(options.tree_snapshot_path, snapshot_fingerprint);
+		list_data.tree_snapshot = &tree_snapshot;
+	}
+	thread_pool.Run(ListAllFilesInsidePaths, &list_data);
+
+	if (list_data.tree_snapshot != nullptr) {
+		tree_snapshot.Save(options.tree_snapshot_path, snapshot_fingerprint);
+	}
+
+	// The size counts every file that was found, the ones in the overflows included
+	unsigned int file_count = source_files.size.load(CORE_RELAXED);
+	unsigned int position = std::min(file_count, source_files.capacity);
+	ReserveSourceFiles(file_count);
+	for (unsigned int index = 0; index < thread_count; index++) {
+		unsigned int overflow_count = thread_overflow_files[index].size;
+		if (overflow_count > 0) {
+			memcpy(source_files.buffer + position, thread_overflow_files[index].buffer, sizeof(Stream<char>) * overflow_count);
+			memcpy(source_roots + position, thread_overflow_roots[index].buffer, sizeof(unsigned int) * overflow_count);
+			position += overflow_count;
+		}
+	}
+	source_files.write_index.store(file_count, CORE_RELAXED);
+	ResetRootResults(search_paths, options);
+}
+
+void LineCounter::ResetRootResults(Stream<Stream<char>> search_paths, const LineCounterOptions& options) {
+	root_results.size = 0;
+	for (size_t index = 0; index < search_paths.size; index++) {
+		Stream<char> label = index < options.root_labels.size && options.root_labels[index].size > 0 ? options.root_labels[index] : search_paths[index];
+		root_results.Add({ label, search_paths[index], {}, 0, 0 });
+	}
+}
+
+// The checkpoint of a run can only be continued by a run that discovers the same files
+static uint64_t GetCheckpointFingerprint(Stream<Stream<char>> search_paths, const LineCounterOptions& options) {
+	uint64_t fingerprint = ((uint64_t)options.shard_index << 33) ^ ((uint64_t)options.shard_count << 1) ^ (uint64_t)options.shard_by_directory;
+	for (size_t index = 0; index < search_paths.size; index++) {
+		fingerprint = (fingerprint ^ function::HashString(search_paths[index])) * 1099511628211ull;
+	}
+	// The extensions are separated from the search paths, such that a path can't pass for an extension
+	fingerprint = (fingerprint ^ search_paths.size) * 1099511628211ull;
+	for (size_t index = 0; index < options.extensions.size; index++) {
+		fingerprint = (fingerprint ^ function::HashString(options.extensions[index])) * 1099511628211ull;
+	}
+	return fingerprint;
+}
+
+void LineCounter::DiscoverFilesWithCheckpoint(Stream<Stream<char>> search_paths, const LineCounterOptions& options) {
+	is_checkpoint_active = false;
+	if (options.checkpoint_path.size == 0) {
+		DiscoverFiles(search_paths, options);
+		return;
+	}
+
+	uint64_t fingerprint = GetCheckpointFingerprint(search_paths, options);
+	bool is_restored = options.resume && checkpoint.Restore(options.checkpoint_path, fingerprint);
+	for (size_t index = 0; index < checkpoint.listed_roots.size && is_restored; index++) {
+		is_restored = checkpoint.listed_roots[index] < search_paths.size;
+	}
+	if (is_restored) {
+		// The restored paths are owned by the checkpoint
+		ClearArenas();
+		unsigned int file_count = (unsigned int)checkpoint.listed_files.size;
+		ReserveSourceFiles(file_count);
+		memcpy(source_files.buffer, checkpoint.listed_files.buffer, sizeof(Stream<char>) * file_count);
+		memcpy(source_roots, checkpoint.listed_roots.buffer, sizeof(unsigned int) * file_count);
+		visited_directories.Clear();
+		tree_snapshot.Reset();
+		source_files.size.store(file_count, CORE_RELAXED);
+		source_files.write_index.store(file_count, CORE_RELAXED);
+		ResetRootResults(search_paths, options);
+	}
+	else {
+		checkpoint.Discard();
+		DiscoverFiles(search_paths, options);
+	}
+	is_checkpoint_active = checkpoint.Begin(options.checkpoint_path, fingerprint, { source_files.buffer, source_files.size.load(CORE_RELAXED) }, source_roots);
+}
+
+LineCounterResults LineCounter::CountSourceFiles(
+	const LineCounterOptions& options,
+	LineCounterFileCallback callback,
+	void* callback_data,
+	Timer timer
+) {
+	unsigned int thread_count = thread_pool.GetThreadCount();
+	unsigned int file_count = source_files.size.load(CORE_RELAXED);
+	ThreadPartitionStream(thread_partitions, file_count);
+	if (options.record_includes) {
+		include_graph.Reset(file_count);
+	}
+	if (root_results.size > 0) {
+		thread_root_results.size = 0;
+		thread_root_results.Resize(thread_count * root_results.size);
+		thread_root_results.size = thread_count * root_results.size;
+	}
+
+	LineCountThreadTaskData count_data;
+	count_data.counter = this;
+	count_data.callback = callback;
+	count_data.callback_data = callback_data;
+	count_data.record_per_file_results = options.record_per_file_results;
+	count_data.record_functions = options.record_functions;
+	count_data.record_includes = options.record_includes;
+	count_data.checkpoint = is_checkpoint_active ? &checkpoint : nullptr;
+	count_data.path_table = nullptr;
+	path_table.slots = nullptr;
+	if (options.record_per_file_results) {
+		size_t index_size = ConcurrentHashTable::MemoryOf(file_count);
+		if (index_size > path_table_capacity) {
+			free(path_table_buffer);
+			path_table_buffer = malloc(index_size);
+			path_table_capacity = index_size;
+		}
+		path_table.Initialize(path_table_buffer, file_count, source_files.buffer);
+		count_data.path_table = &path_table;
+
+		file_table.Resize(file_count, options.record_functions);
+		file_table.paths = source_files.buffer;
+		file_table.root_indices = source_roots;
+	}
+	thread_pool.Run(LineCountThreadTask, &count_data);
+	if (is_checkpoint_active) {
+		checkpoint.End();
+		is_checkpoint_active = false;
+	}
+
+	LineCounterResults results;
+	results.totals = {};
+	results.error_count = 0;
+	results.dropped_error_count = 0;
+	memset(results.error_kind_counts, 0, sizeof(results.error_kind_counts));
+	// The partitions are in file order, so are the joined tables
+	error_results.size = 0;
+	for (unsigned int index = 0; index < thread_count; index++) {
+		AddFileCounts(results.totals, thread_totals[index]);
+		const LineCounterErrorTable* errors = thread_errors + index;
+		memcpy(error_results.buffer + error_results.size, errors->entries.buffer, sizeof(LineCounterFileError) * errors->entries.size);
+		error_results.size += errors->entries.size;
+		results.dropped_error_count += errors->dropped_count;
+		for (unsigned int kind = 0; kind < LINE_COUNTER_FILE_ERROR_COUNT; kind++) {
+			results.error_kind_counts[kind] += errors->kind_counts[kind];
+			results.error_count += IsFileErrorFailure((LINE_COUNTER_FILE_ERROR)kind) ? errors->kind_counts[kind] : 0;
+		}
+	}
+
+	results.file_count = file_count;
+	results.files = file_table;
+	results.files.size = options.record_per_file_results ? file_count : 0;
+	results.thread_partitions = thread_partitions;
+	for (unsigned int index = 0; index < root_results.size; index++) {
+		LineCounterRootResult* root = root_results.buffer + index;
+		root->totals = {};
+		root->file_count = 0;
+		root->error_count = 0;
+		for (unsigned int thread_index = 0; thread_index < thread_count; thread_index++) {
+			const LineCounterRootResult* thread_root = thread_root_results.buffer + thread_index * root_results.size + index;
+			AddFileCounts(root->totals, thread_root->totals);
+			root->file_count += thread_root->file_count;
+			root->error_count += thread_root->error_count;
+		}
+	}
+	results.roots = root_results;
+	results.repeated_directory_count = visited_directories.repeated_count.load(CORE_RELAXED);
+	results.errors = error_results;
+	results.includes = {};
+	results.resumed_file_count = count_data.checkpoint != nullptr ? checkpoint.restored_count : 0;
+	results.snapshot_reused_directory_count = tree_snapshot.GetReusedCount();
+	results.snapshot_read_directory_count = tree_snapshot.GetReadCount();
+	results.snapshot_unchanged_subtree_count = tree_snapshot.GetUnchangedSubtreeCount();
+	if (options.record_includes) {
+		results.includes = include_graph.Build(thread_pool, { source_files.buffer, file_count }, thread_partitions, options.include_directories, thread_arenas);
+	}
+	results.microseconds = timer.GetDurationSinceMarker(TIMER_DURATION_US);
+	return results;
+}
@@ -0,0 +1,325 @@
+#pragma once
+#include "Core/Core.h"
+#include "Kernel/CountingKernel.h"
+#include "IncludeGraph.h"
+#include "Checkpoint.h"
+#include "TreeSnapshot.h"
+
+// The initial capacity of the source files, it grows when the discovery finds more
+#define LINE_COUNTER_FILE_CAPACITY (CORE_KB * 256)
+// The functions of a file past this count are not recorded
+#define LINE_COUNTER_MAX_FUNCTIONS_PER_FILE (CORE_KB * 64)
+// Larger files are reported as errors instead of being counted
+#define LINE_COUNTER_MAX_FILE_SIZE (CORE_MB * 512)
+// A discovery thread publishes the files it finds in batches of this size
+#define LINE_COUNTER_DISCOVERY_BATCH_SIZE 256
+// The errors of a thread past this count are only counted, not recorded
+#define LINE_COUNTER_MAX_ERRORS_PER_THREAD 256
+
+using namespace Core;
+
+enum LINE_COUNTER_FILE_ERROR : unsigned char {
+	LINE_COUNTER_FILE_ERROR_NONE,
+	LINE_COUNTER_FILE_ERROR_OPEN,
+	LINE_COUNTER_FILE_ERROR_READ,
+	// Larger than LINE_COUNTER_MAX_FILE_SIZE, or the buffer for it could not be allocated
+	LINE_COUNTER_FILE_ERROR_TOO_LARGE,
+	// The file has null bytes
+	LINE_COUNTER_FILE_ERROR_BINARY,
+	// The file is not valid UTF-8. It is still counted, this is only a warning
+	LINE_COUNTER_FILE_ERROR_INVALID_ENCODING,
+	// The file crashed the worker process that was counting it
+	LINE_COUNTER_FILE_ERROR_CRASH,
+	// The worker process for the file could not be started
+	LINE_COUNTER_FILE_ERROR_WORKER,
+	LINE_COUNTER_FILE_ERROR_COUNT
+};
+
+const char* GetFileErrorDescription(LINE_COUNTER_FILE_ERROR error);
+
+// When true, the counts of the file are 0 and they are left out of the totals
+inline bool IsFileErrorFailure(LINE_COUNTER_FILE_ERROR error) {
+	return error != LINE_COUNTER_FILE_ERROR_NONE && error != LINE_COUNTER_FILE_ERROR_INVALID_ENCODING;
+}
+
+struct LineCounterFileError {
+	Stream<char> path;
+	LINE_COUNTER_FILE_ERROR error;
+	// The errno value of the failed call, 0 if the error doesn't come from the system
+	int system_error;
+};
+
+// A table with a fixed capacity, such that a tree full of unreadable files can't exhaust the memory
+struct LineCounterErrorTable {
+	void Add(Stream<char> path, LINE_COUNTER_FILE_ERROR error, int system_error) {
+		kind_counts[error]++;
+		if (entries.size < entries.capacity) {
+			entries.Add({ path, error, system_error });
+		}
+		else {
+			dropped_count++;
+		}
+	}
+
+	void Reset() {
+		entries.size = 0;
+		dropped_count = 0;
+		memset(kind_counts, 0, sizeof(kind_counts));
+	}
+
+	CapacityStream<LineCounterFileError> entries;
+	size_t dropped_count;
+	size_t kind_counts[LINE_COUNTER_FILE_ERROR_COUNT];
+};
+
+struct LineCounterFileResult {
+	Stream<char> path;
+	// The code lines are the sloc
+	FileCounts counts;
+	// Filled only when LineCounterOptions::record_functions is set. The names are copies
+	Stream<FunctionMetrics> functions;
+	// The position of the file in the counted files
+	unsigned int file_index;
+	unsigned int thread_id;
+	// When true, the file could not be counted and the counts are 0. The error says why
+	bool failed;
+	LINE_COUNTER_FILE_ERROR error;
+	// The errno value of the failed call, 0 if the error doesn't come from the system
+	int system_error;
+	// The search path that the file was found in
+	unsigned int root_index;
+};
+
+enum LINE_COUNTER_FILE_FLAG : unsigned char {
+	// The file could not be counted and its counts are 0
+	LINE_COUNTER_FILE_FLAG_FAILED = 1 << 0,
+	// The counts come from the run that left the checkpoint
+	LINE_COUNTER_FILE_FLAG_RESUMED = 1 << 1
+};
+
+// The per file results in columns, indexed by file, such that a report that needs only the sloc reads only
+// that column. Each thread writes the rows of its own files. A file has at most LINE_COUNTER_MAX_FILE_SIZE
+// bytes, so its counts fit in 32 bits
+struct LineCounterFileTable {
+	FileCounts GetCounts(size_t index) const {
+		return { code_lines[index], comment_lines[index], blank_lines[index], total_lines[index], logical_lines[index], token_counts[index], code_bytes[index] };
+	}
+
+	bool IsFailed(size_t index) const {
+		return (flags[index] & LINE_COUNTER_FILE_FLAG_FAILED) != 0;
+	}
+
+	void Set(size_t index, const FileCounts& counts, LINE_COUNTER_FILE_ERROR error, unsigned char file_flags) {
+		code_lines[index] = (unsigned int)counts.code_lines;
+		comment_lines[index] = (unsigned int)counts.comment_lines;
+		blank_lines[index] = (unsigned int)counts.blank_lines;
+		total_lines[index] = (unsigned int)counts.total_lines;
+		logical_lines[index] = (unsigned int)counts.logical_lines;
+		token_counts[index] = (unsigned int)counts.token_count;
+		code_bytes[index] = (unsigned int)counts.code_bytes;
+		errors[index] = error;
+		flags[index] = file_flags;
+	}
+
+	// Makes room for the given row count, the previous rows are not kept. The paths and the root
+	// indices are set by the owner
+	void Resize(size_t count, bool with_functions);
+
+	void FreeBuffer();
+
+	size_t size;
+	// Not owned by the table. The path id of a file is its index, as in the counted files
+	Stream<char>* paths;
+	// The search path of each file
+	const unsigned int* root_indices;
+	unsigned int* code_lines;
+	unsigned int* comment_lines;
+	unsigned int* blank_lines;
+	unsigned int* total_lines;
+	unsigned int* logical_lines;
+	unsigned int* token_counts;
+	unsigned int* code_bytes;
+	LINE_COUNTER_FILE_ERROR* errors;
+	// LINE_COUNTER_FILE_FLAG values
+	unsigned char* flags;
+	// Only when the functions are recorded, otherwise nullptr. The names are copies
+	Stream<FunctionMetrics>* functions;
+
+	void* buffer;
+	size_t capacity;
+};
+
+// The totals of one search path
+struct LineCounterRootResult {
+	// The label from the options or, without one, the search path
+	Stream<char> label;
+	Stream<char> path;
+	// The sum over the files of this search path that were counted successfully
+	FileCounts totals;
+	size_t file_count;
+	size_t error_count;
+};
+
+// Called from the worker threads as soon as a file was counted. It must be thread safe
+typedef void (*LineCounterFileCallback)(const LineCounterFileResult* result, void* user_data);
+
+struct LineCounterOptions {
+	// If left empty, the C/C++ extensions .cpp, .c, .hpp and .h are used
+	Stream<Stream<char>> extensions = {};
+	// Record each file into the LineCounterResults::files table
+	bool record_per_file_results = true;
+	// Detect the functions of each file, with their length and cyclomatic complexity. They are
+	// reported through the file results, so the per file results or a callback are needed
+	bool record_functions = false;
+	// Extract the #include directives into a graph and report the headers by their transitive fan-in
+	// multiplied by their sloc. The include directories are used to resolve the directives
+	bool record_includes = false;
+	Stream<Stream<char>> include_directories = {};
+	// Count only the files whose path hashes to this shard. The shards of the same search paths are disjoint
+	// and together they cover all the files. By directory, all the files of a directory go to the same shard
+	unsigned int shard_index = 0;
+	unsigned int shard_count = 1;
+	bool shard_by_directory = false;
+	// One label for each search path, for the per root totals. An empty label is replaced by the path. A file
+	// inside several search paths is counted once, for the innermost one, and repeated search paths are skipped
+	Stream<Stream<char>> root_labels = {};
+	// Log the discovered files and the counted files to this path while counting. With resume, a log left by
+	// an interrupted run with the same options is continued: its files are not discovered again and the files
+	// it finished are not counted again. Their functions and includes are not recorded
+	Stream<char> checkpoint_path = {};
+	bool resume = false;
+	// Keep the directory tree of the discovery in this file between runs. A directory that didn't change since
+	// the last run is listed from the file instead of being read, the files are still counted
+	Stream<char> tree_snapshot_path = {};
+};
+
+// All the memory referenced here is owned by the LineCounter instance and it is valid
+// until the next Count call on the same instance
+struct LineCounterResults {
+	// The sum over all the files that were counted successfully
+	FileCounts totals;
+	size_t file_count;
+	// The files that could not be counted, the warnings are left out
+	size_t error_count;
+	// Each thread counts a contiguous range of files given by thread_partitions. Empty unless the per file
+	// results are recorded
+	LineCounterFileTable files;
+	Stream<ThreadPartition> thread_partitions;
+	// One entry for each search path, in the same order. Empty when counting a given list of files
+	Stream<LineCounterRootResult> roots;
+	// The directories that were reached again, through a symlink loop or an overlapping search path,
+	// and were not searched again. The repeated search paths are included
+	size_t repeated_directory_count;
+	// The file errors in the order of the files. The ones that don't fit in the bounded
+	// tables are only counted, in the kind counts and in the dropped count
+	Stream<LineCounterFileError> errors;
+	size_t dropped_error_count;
+	size_t error_kind_counts[LINE_COUNTER_FILE_ERROR_COUNT];
+	// Empty unless LineCounterOptions::record_includes is set
+	IncludeGraphResults includes;
+	// The files that were finished by the run that left the checkpoint
+	size_t resumed_file_count;
+	// With a tree snapshot, the directories that were listed from it and the ones that were read, and the
+	// directories whose whole subtree is the same as in the snapshot
+	size_t snapshot_reused_directory_count;
+	size_t snapshot_read_directory_count;
+	size_t snapshot_unchanged_subtree_count;
+	size_t microseconds;
+};
+
+// Reentrant line counter. Each instance owns its own threads and memory, which are reused
+// between Count calls. Different instances can be used concurrently; calls on the same
+// instance are serialized
+struct LineCounter {
+	// A thread count of 0 uses the hardware concurrency
+	LineCounter(unsigned int thread_count = 0);
+	~LineCounter();
+
+	LineCounter(const LineCounter& other) = delete;
+	LineCounter& operator = (const LineCounter& other) = delete;
+
+	// Counts all the files with the given extensions that are found recursively in the search paths
+	LineCounterResults Count(Stream<Stream<char>> search_paths, const LineCounterOptions& options);
+
+	// The same as Count, but each file is reported through the callback as soon as it is counted
+	LineCounterResults Count(
+		Stream<Stream<char>> search_paths,
+		const LineCounterOptions& options,
+		LineCounterFileCallback callback,
+		void* callback_data
+	);
+
+	// Only finds the files that Count would count, with the extension and shard options. The paths are
+	// valid until the next call on the same instance, apart from CountFiles with exactly this stream
+	Stream<Stream<char>> ListFiles(Stream<Stream<char>> search_paths, const LineCounterOptions& options);
+
+	// Counts exactly the given files, the paths must be null terminated. The shard options don't apply
+	LineCounterResults CountFiles(
+		Stream<Stream<char>> files,
+		const LineCounterOptions& options,
+		LineCounterFileCallback callback = nullptr,
+		void* callback_data = nullptr
+	);
+
+	// The row of the file with exactly this path in the results of the last count, or CORE_HASH_TABLE_NOT_FOUND if it
+	// was not counted. Only when the per file results were recorded. It can be called from any thread once the count returned
+	unsigned int FindFile(Stream<char> path) const;
+
+	void ClearArenas();
+
+	// Grows the source files and their roots to hold this many files, keeping the ones already there
+	void ReserveSourceFiles(unsigned int count);
+
+	// Fills the source files
+	void DiscoverFiles(Stream<Stream<char>> search_paths, const LineCounterOptions& options);
+
+	// Counts the source files. The timer is started by the caller
+	LineCounterResults CountSourceFiles(const LineCounterOptions& options, LineCounterFileCallback callback, void* callback_data, Timer timer);
+
+	// One empty root result for each search path
+	void ResetRootResults(Stream<Stream<char>> search_paths, const LineCounterOptions& options);
+
+	// Discovers the files or restores them from the checkpoint and starts the checkpoint log
+	void DiscoverFilesWithCheckpoint(Stream<Stream<char>> search_paths, const LineCounterOptions& options);
+
+	unsigned int GetThreadCount() const {
+		return thread_pool.GetThreadCount();
+	}
+
+	ThreadPool thread_pool;
+	std::mutex count_lock;
+	const CountingKernel* kernel;
+
+	// Per thread state, reused between calls
+	Arena* thread_arenas;
+	Stream<char>* thread_file_buffers;
+	FileCounts* thread_totals;
+	LineCounterErrorTable* thread_errors;
+	// Allocated the first time the functions are recorded
+	CapacityStream<FunctionMetrics>* thread_function_buffers;
+	IncludeGraph include_graph;
+	CheckpointLog checkpoint;
+	// Set while the checkpoint log is written
+	bool is_checkpoint_active;
+	TreeSnapshot tree_snapshot;
+
+	AtomicStream<Stream<char>> source_files;
+	// The directories visited by the discovery, by device and inode
+	DirectoryVisitSet visited_directories;
+	// The search path of each source file
+	unsigned int* source_roots;
+	// The files that each discovery thread found once the source files were full, with their search paths.
+	// They are moved in after the walks, when the source files can grow
+	ResizableStream<Stream<char>>* thread_overflow_files;
+	ResizableStream<unsigned int>* thread_overflow_roots;
+	ResizableStream<LineCounterRootResult> root_results;
+	// The root totals of each thread, thread after thread
+	ResizableStream<LineCounterRootResult> thread_root_results;
+	LineCounterFileTable file_table;
+	// From the source file paths to their indices, filled by the counting threads. Sized for the discovered files
+	ConcurrentHashTable path_table;
+	void* path_table_buffer;
+	size_t path_table_capacity;
+	Stream<ThreadPartition> thread_partitions;
+	Stream<LineCounterFileError> error_results;
+};
@@ -0,0 +1,281 @@
+#include "MultiProcessCounter.h"
+
+#include <algorithm>
+#include <new>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+enum SHARED_FILE_STATE : unsigned char {
+	SHARED_FILE_PENDING,
+	SHARED_FILE_DONE,
+	SHARED_FILE_FAILED,
+	SHARED_FILE_CRASHED
+};
+
+// One entry for each file, written only by the worker that counts it. The state is published last
+struct SharedFileResult {
+	FileCounts counts;
+	unsigned int thread_id;
+	int system_error;
+	LINE_COUNTER_FILE_ERROR error;
+	std::atomic<unsigned char> state;
+};
+
+// The indices of the files that a worker counts
+struct WorkerJob {
+	unsigned int* indices;
+	unsigned int count;
+};
+
+struct RunningWorker {
+	pid_t pid;
+	WorkerJob job;
+};
+
+struct WorkerCallbackData {
+	SharedFileResult* shared_results;
+	const unsigned int* indices;
+};
+
+// ------------------------------------------------------------------------------------------------------------
+
+// The mapping is inherited by the forked workers. It falls back to an anonymous shared mapping
+// if memfd_create is not available
+static SharedFileResult* MapSharedResults(size_t file_count) {
+	size_t byte_size = std::max(sizeof(SharedFileResult) * file_count, (size_t)1);
+	void* mapping = MAP_FAILED;
+	int descriptor = memfd_create("line_counter_results", MFD_CLOEXEC);
+	if (descriptor != -1) {
+		if (ftruncate(descriptor, byte_size) == 0) {
+			mapping = mmap(nullptr, byte_size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+		}
+		close(descriptor);
+	}
+	if (mapping == MAP_FAILED) {
+		mapping = mmap(nullptr, byte_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	}
+	return mapping == MAP_FAILED ? nullptr : (SharedFileResult*)mapping;
+}
+
+// Runs in the forked process and never returns
+[[noreturn]] static void RunWorker(
+	WorkerJob job,
+	Stream<Stream<char>> paths,
+	SharedFileResult* shared_results,
+	const LineCounterOptions& options,
+	unsigned int thread_count
+) {
+	Stream<Stream<char>> files = { malloc(sizeof(Stream<char>) * std::max(job.count, 1u)), job.count };
+	for (unsigned int index = 0; index < job.count; index++) {
+		files[index] = paths[job.indices[index]];
+	}
+
+	LineCounterOptions worker_options = options;
+	worker_options.record_per_file_results = false;
+	worker_options.record_functions = false;
+	worker_options.record_includes = false;
+
+	WorkerCallbackData callback_data = { shared_results, job.indices };
+	LineCounter counter(thread_count);
+	counter.CountFiles(files, worker_options, [](const LineCounterFileResult* result, void* _data) {
+		WorkerCallbackData* data = (WorkerCallbackData*)_data;
+		SharedFileResult* shared_result = data->shared_results + data->indices[result->file_index];
+		shared_result->counts = result->counts;
+		shared_result->thread_id = result->thread_id;
+		shared_result->error = result->error;
+		shared_result->system_error = result->system_error;
+		shared_result->state.store(result->failed ? SHARED_FILE_FAILED : SHARED_FILE_DONE, CORE_RELEASE);
+	}, &callback_data);
+
+	// The thread pool is not joined, the process goes away with it
+	_exit(0);
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+MultiProcessCounter::MultiProcessCounter(unsigned int _process_count, unsigned int _threads_per_process) : restart_count(0) {
+	process_count = std::max(_process_count, 1u);
+	threads_per_process = _threads_per_process != 0 ? _threads_per_process : std::max(std::thread::hardware_concurrency() / process_count, 1u);
+	file_table = {};
+	unsigned int error_capacity = LINE_COUNTER_MAX_ERRORS_PER_THREAD * process_count;
+	errors.entries = { malloc(sizeof(LineCounterFileError) * error_capacity), 0, error_capacity };
+	errors.Reset();
+}
+
+MultiProcessCounter::~MultiProcessCounter() {
+	crashed_files.FreeBuffer();
+	file_table.FreeBuffer();
+	free(errors.entries.buffer);
+}
+
+void MultiProcessCounter::FillErrorResults(LineCounterResults& results) {
+	partition = { 0, (unsigned int)results.file_count };
+	results.thread_partitions = { &partition, 1 };
+	results.errors = errors.entries;
+	results.dropped_error_count = errors.dropped_count;
+	memcpy(results.error_kind_counts, errors.kind_counts, sizeof(results.error_kind_counts));
+}
+
+LineCounterResults MultiProcessCounter::Count(Stream<Stream<char>> search_paths, const LineCounterOptions& options) {
+	Timer timer;
+	arena.Clear();
+	crashed_files.size = 0;
+	errors.Reset();
+	restart_count = 0;
+
+	// The listing counter is destroyed before the fork, such that the workers start from a single threaded process
+	Stream<Stream<char>> paths;
+	LineCounterResults results = {};
+	{
+		LineCounter lister(threads_per_process * process_count);
+		Stream<Stream<char>> listed_paths = lister.ListFiles(search_paths, options);
+		paths = { arena.Allocate<Stream<char>>(listed_paths.size), listed_paths.size };
+		for (size_t index = 0; index < listed_paths.size; index++) {
+			paths[index] = arena.StringCopy(listed_paths[index]);
+		}
+		results.snapshot_reused_directory_count = lister.tree_snapshot.GetReusedCount();
+		results.snapshot_read_directory_count = lister.tree_snapshot.GetReadCount();
+		results.snapshot_unchanged_subtree_count = lister.tree_snapshot.GetUnchangedSubtreeCount();
+	}
+	std::sort(paths.begin(), paths.end(), [](Stream<char> first, Stream<char> second) {
+		return strcmp(first.buffer, second.buffer) < 0;
+	});
+	unsigned int file_count = (unsigned int)paths.size;
+
+	SharedFileResult* shared_results = MapSharedResults(file_count);
+	if (shared_results == nullptr) {
+		// No worker can report back without the mapping
+		int system_error = errno;
+		for (unsigned int index = 0; index < file_count; index++) {
+			errors.Add(paths[index], LINE_COUNTER_FILE_ERROR_WORKER, system_error);
+		}
+		results.file_count = file_count;
+		results.error_count = file_count;
+		FillErrorResults(results);
+		return results;
+	}
+	for (unsigned int index = 0; index < file_count; index++) {
+		new (shared_results + index) SharedFileResult();
+		shared_results[index].state.store(SHARED_FILE_PENDING, CORE_RELAXED);
+	}
+
+	// The sorted files are split into contiguous ranges, one for each process
+	unsigned int* indices = arena.Allocate<unsigned int>(file_count);
+	for (unsigned int index = 0; index < file_count; index++) {
+		indices[index] = index;
+	}
+	ResizableStream<WorkerJob> jobs;
+	Stream<ThreadPartition> job_partitions = { arena.Allocate<ThreadPartition>(process_count), process_count };
+	ThreadPartitionStream(job_partitions, file_count);
+	for (unsigned int index = 0; index < process_count; index++) {
+		if (job_partitions[index].size > 0) {
+			jobs.Add({ indices + job_partitions[index].offset, job_partitions[index].size });
+		}
+	}
+
+	fflush(stdout);
+	int fork_error = 0;
+	ResizableStream<RunningWorker> running_workers;
+	while (jobs.size > 0 || running_workers.size > 0) {
+		while (jobs.size > 0 && running_workers.size < process_count) {
+			WorkerJob job = jobs[--jobs.size];
+			pid_t pid = fork();
+			if (pid == 0) {
+				RunWorker(job, paths, shared_results, options, threads_per_process);
+			}
+			if (pid == -1) {
+				// The job is put back and tried again once a running worker exits, a failure like EAGAIN
+				// is usually transient
+				fork_error = errno;
+				jobs.Add(job);
+				break;
+			}
+			running_workers.Add({ pid, job });
+		}
+		if (running_workers.size == 0) {
+			// Nothing is running that could free the resources, the files of the remaining jobs stay
+			// pending and are reported as errors
+			break;
+		}
+
+		int status = 0;
+		pid_t pid = waitpid(-1, &status, 0);
+		if (pid == -1) {
+			break;
+		}
+		unsigned int worker_index = 0;
+		while (worker_index < running_workers.size && running_workers[worker_index].pid != pid) {
+			worker_index++;
+		}
+		if (worker_index == running_workers.size) {
+			continue;
+		}
+		WorkerJob job = running_workers[worker_index].job;
+		running_workers[worker_index] = running_workers[--running_workers.size];
+
+		// A clean exit leaves nothing pending. Otherwise the files that were not finished are split in two
+		unsigned int* pending = arena.Allocate<unsigned int>(job.count);
+		unsigned int pending_count = 0;
+		for (unsigned int index = 0; index < job.count; index++) {
+			if (shared_results[job.indices[index]].state.load(CORE_ACQUIRE) == SHARED_FILE_PENDING) {
+				pending[pending_count++] = job.indices[index];
+			}
+		}
+		if (pending_count == 1) {
+			shared_results[pending[0]].state.store(SHARED_FILE_CRASHED, CORE_RELAXED);
+			crashed_files.Add(paths[pending[0]]);
+		}
+		else if (pending_count > 1) {
+			unsigned int half = pending_count / 2;
+			jobs.Add({ pending, half });
+			jobs.Add({ pending + half, pending_count - half });
+			restart_count += 2;
+		}
+	}
+	jobs.FreeBuffer();
+	running_workers.FreeBuffer();
+
+	// The per root totals are not collected, all the files belong to the first root
+	file_table.Resize(file_count, false);
+	file_table.paths = paths.buffer;
+	unsigned int* root_indices = arena.Allocate<unsigned int>(file_count);
+	memset(root_indices, 0, sizeof(unsigned int) * file_count);
+	file_table.root_indices = root_indices;
+
+	size_t error_count = 0;
+	for (unsigned int index = 0; index < file_count; index++) {
+		const SharedFileResult* shared_result = shared_results + index;
+		unsigned char state = shared_result->state.load(CORE_ACQUIRE);
+		LINE_COUNTER_FILE_ERROR error = shared_result->error;
+		int system_error = shared_result->system_error;
+		if (state == SHARED_FILE_CRASHED) {
+			error = LINE_COUNTER_FILE_ERROR_CRASH;
+		}
+		else if (state == SHARED_FILE_PENDING) {
+			error = LINE_COUNTER_FILE_ERROR_WORKER;
+			system_error = fork_error;
+		}
+
+		bool failed = state != SHARED_FILE_DONE;
+		file_table.Set(index, failed ? FileCounts{} : shared_result->counts, error, failed ? LINE_COUNTER_FILE_FLAG_FAILED : 0);
+		if (error != LINE_COUNTER_FILE_ERROR_NONE) {
+			errors.Add(paths[index], error, system_error);
+		}
+		if (failed) {
+			error_count++;
+		}
+		else {
+			AddFileCounts(results.totals, shared_result->counts);
+		}
+	}
+	munmap(shared_results, std::max(sizeof(SharedFileResult) * file_count, (size_t)1));
+
+	results.file_count = file_count;
+	results.error_count = error_count;
+	results.files = file_table;
+	results.files.size = options.record_per_file_results ? file_count : 0;
+	FillErrorResults(results);
+	results.microseconds = timer.GetDurationSinceMarker(TIMER_DURATION_US);
+	return results;
+}
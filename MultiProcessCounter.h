@@ -0,0 +1,35 @@
+#pragma once
+#include "LineCounter.h"
+
+// Counts with several worker processes on the same host, each one with its own LineCounter and thread
+// pool, such that they don't share an allocator or a task queue. The supervisor lists the files once,
+// sorts them such that the subtrees are contiguous and forks a worker for each range. The workers write
+// the counts into a per file table in a memfd mapping. When a worker crashes, the files it didn't finish
+// are split in two and given to two new workers, until the file that crashes is counted on its own and
+// reported as an error. Linux only
+struct MultiProcessCounter {
+	// A thread count of 0 divides the hardware concurrency between the processes
+	MultiProcessCounter(unsigned int process_count, unsigned int threads_per_process = 0);
+	~MultiProcessCounter();
+
+	MultiProcessCounter(const MultiProcessCounter& other) = delete;
+	MultiProcessCounter& operator = (const MultiProcessCounter& other) = delete;
+
+	// The function metrics, the include graph and the per root totals are not collected in this mode. The results have a single
+	// partition. They are valid until the next Count call
+	LineCounterResults Count(Stream<Stream<char>> search_paths, const LineCounterOptions& options);
+
+	unsigned int process_count;
+	unsigned int threads_per_process;
+	// The workers that were started again after a crash during the last Count
+	unsigned int restart_count;
+	// The files that crashed a worker on their own during the last Count
+	ResizableStream<Stream<char>> crashed_files;
+
+	void FillErrorResults(LineCounterResults& results);
+
+	Arena arena;
+	LineCounterFileTable file_table;
+	ThreadPartition partition;
+	LineCounterErrorTable errors;
+};
@@ -0,0 +1,263 @@
+#include "NinjaDeps.h"
+
+#include <algorithm>
+
+#define NINJA_DEPS_SIGNATURE "# ninjadeps\n"
+#define NINJA_DEPS_SIGNATURE_SIZE (sizeof(NINJA_DEPS_SIGNATURE) - 1)
+#define NINJA_DEPS_HEADER_SIZE (NINJA_DEPS_SIGNATURE_SIZE + sizeof(unsigned int))
+// Ninja doesn't write larger records
+#define NINJA_DEPS_MAX_RECORD_SIZE ((1u << 19) - 1)
+// The high bit of the record size marks the dependency records
+#define NINJA_DEPS_RECORD_FLAG 0x80000000u
+#define NINJA_DEPS_PATH_CAPACITY 4096
+#define NINJA_DEPS_NO_FILE ((unsigned int)-1)
+
+struct NinjaDepsOutput {
+	Stream<char> target;
+	unsigned int node;
+};
+
+struct NinjaDepsTargetData {
+	NinjaDeps* deps;
+	const unsigned int* code_lines;
+	std::atomic<unsigned int> next_group;
+	// Each thread marks the files that it has already added with its current group plus one, so a file
+	// shared by the outputs of a target is counted once without clearing the marks between the groups
+	unsigned int** thread_marks;
+};
+
+// ------------------------------------------------------------------------------------------------------------
+
+// The objects of a CMake target are written under CMakeFiles/<target>.dir/, in the build directory of the
+// subdirectory that defines it. Any other output is a target on its own
+static Stream<char> GetOutputTarget(Stream<char> output) {
+	const char marker[] = "CMakeFiles/";
+	const size_t marker_size = sizeof(marker) - 1;
+	const char* pointer = output.buffer;
+	const char* end = output.buffer + output.size;
+	while (true) {
+		const char* found = (const char*)memmem(pointer, end - pointer, marker, marker_size);
+		if (found == nullptr) {
+			return output;
+		}
+		pointer = found + marker_size;
+		if (found > output.buffer && found[-1] != '/') {
+			continue;
+		}
+
+		const char* slash = (const char*)memchr(pointer, '/', end - pointer);
+		Stream<char> directory = { pointer, (size_t)((slash != nullptr ? slash : end) - pointer) };
+		if (slash != nullptr && directory.size > 4 && function::EndsWith(directory, ".dir")) {
+			return { directory.buffer, directory.size - 4 };
+		}
+	}
+}
+
+static bool CompareStrings(Stream<char> first, Stream<char> second) {
+	int result = memcmp(first.buffer, second.buffer, std::min(first.size, second.size));
+	return result != 0 ? result < 0 : first.size < second.size;
+}
+
+CORE_THREAD_TASK(ComputeNinjaDepsTargets) {
+	NinjaDepsTargetData* data = (NinjaDepsTargetData*)_data;
+	NinjaDeps* deps = data->deps;
+	unsigned int* marks = data->thread_marks[thread_id];
+
+	while (true) {
+		unsigned int group = data->next_group.fetch_add(1, CORE_RELAXED);
+		if (group >= deps->group_names.size) {
+			return;
+		}
+
+		unsigned int output_start = deps->group_offsets[group];
+		unsigned int output_end = deps->group_offsets[group + 1];
+		NinjaDepsTarget target = { deps->group_names[group], output_end - output_start, 0, 0 };
+		for (unsigned int output_index = output_start; output_index < output_end; output_index++) {
+			NinjaDeps::NodeDeps node_deps = deps->node_deps[deps->outputs[output_index]];
+			for (unsigned int index = 0; index < node_deps.count; index++) {
+				unsigned int file = deps->node_files[node_deps.ids[index]];
+				if (marks[file] != group + 1) {
+					marks[file] = group + 1;
+					target.file_count++;
+					target.code_lines += data->code_lines[file];
+				}
+			}
+		}
+		deps->targets[group] = target;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+NinjaDeps::NinjaDeps() : output_count(0), record_count(0), is_truncated(false), mapping({ nullptr, 0 }) {}
+
+NinjaDeps::~NinjaDeps() {
+	Release();
+	files.FreeBuffer();
+	targets.FreeBuffer();
+	node_paths.FreeBuffer();
+	node_deps.FreeBuffer();
+	node_files.FreeBuffer();
+	outputs.FreeBuffer();
+	group_offsets.FreeBuffer();
+	group_names.FreeBuffer();
+}
+
+void NinjaDeps::Release() {
+	UnmapFile(mapping);
+	mapping = { nullptr, 0 };
+	files.size = 0;
+	targets.size = 0;
+	node_paths.size = 0;
+	node_deps.size = 0;
+	node_files.size = 0;
+	outputs.size = 0;
+	group_offsets.size = 0;
+	group_names.size = 0;
+	output_count = 0;
+	record_count = 0;
+	is_truncated = false;
+	arena.Clear();
+}
+
+bool NinjaDeps::Load(Stream<char> path, CapacityStream<char>* error_message) {
+	Release();
+	mapping = MapFilePrivate(path);
+	if (mapping.buffer == nullptr) {
+		CORE_FORMAT_STRING(*error_message, "Could not open the Ninja deps log {#}.\n", path);
+		return false;
+	}
+
+	unsigned int version = 0;
+	if (mapping.size < NINJA_DEPS_HEADER_SIZE || memcmp(mapping.buffer, NINJA_DEPS_SIGNATURE, NINJA_DEPS_SIGNATURE_SIZE) != 0) {
+		CORE_FORMAT_STRING(*error_message, "The file {#} is not a Ninja deps log.\n", path);
+		Release();
+		return false;
+	}
+	memcpy(&version, mapping.buffer + NINJA_DEPS_SIGNATURE_SIZE, sizeof(version));
+	if (version != 3 && version != 4) {
+		CORE_FORMAT_STRING(*error_message, "The Ninja deps log {#} has the version {#}, only the versions 3 and 4 are read.\n", path, version);
+		Release();
+		return false;
+	}
+	// The output id and the modification time, which has 64 bits since the version 4
+	unsigned int record_header_count = version == 4 ? 3 : 2;
+
+	// The records are multiples of 4 bytes, the mapping is page aligned, so their words can be read in place
+	size_t offset = NINJA_DEPS_HEADER_SIZE;
+	while (offset + sizeof(unsigned int) <= mapping.size) {
+		unsigned int record_head = *(const unsigned int*)(mapping.buffer + offset);
+		bool is_deps = (record_head & NINJA_DEPS_RECORD_FLAG) != 0;
+		unsigned int record_size = record_head & ~NINJA_DEPS_RECORD_FLAG;
+		const unsigned int* words = (const unsigned int*)(mapping.buffer + offset + sizeof(unsigned int));
+		if (record_size > NINJA_DEPS_MAX_RECORD_SIZE || record_size % 4 != 0 || offset + sizeof(unsigned int) + record_size > mapping.size) {
+			break;
+		}
+
+		unsigned int word_count = record_size / 4;
+		if (is_deps) {
+			if (word_count < record_header_count || words[0] >= node_paths.size) {
+				break;
+			}
+			const unsigned int* ids = words + record_header_count;
+			unsigned int id_count = word_count - record_header_count;
+			bool is_valid = true;
+			for (unsigned int index = 0; index < id_count && is_valid; index++) {
+				is_valid = ids[index] < node_paths.size;
+			}
+			if (!is_valid) {
+				break;
+			}
+			node_deps[words[0]] = { ids, id_count };
+			record_count++;
+		}
+		else {
+			// The path is padded with up to 3 null bytes and followed by the complement of its node id,
+			// which catches two Ninja processes that wrote into the same log
+			if (word_count < 2 || ~words[word_count - 1] != node_paths.size) {
+				break;
+			}
+			Stream<char> node_path = { words, record_size - sizeof(unsigned int) };
+			for (unsigned int index = 0; index < 3 && node_path[node_path.size - 1] == '\0'; index++) {
+				node_path.size--;
+			}
+			node_paths.Add(node_path);
+			node_deps.Add({ nullptr, 0 });
+		}
+		offset += sizeof(unsigned int) + record_size;
+	}
+	is_truncated = offset != mapping.size;
+
+	// The files are numbered in the order in which the outputs first name them
+	Stream<char> build_directory = { path.buffer, 0 };
+	for (size_t index = path.size; index > 0; index--) {
+		if (path[index - 1] == '/') {
+			build_directory.size = index - 1;
+			break;
+		}
+	}
+	NinjaDepsOutput* sorted_outputs = (NinjaDepsOutput*)malloc(sizeof(NinjaDepsOutput) * std::max(node_paths.size, 1u));
+	node_files.Resize(std::max(node_paths.size, 1u));
+	node_files.size = node_paths.size;
+	memset(node_files.buffer, 0xFF, sizeof(unsigned int) * node_paths.size);
+	CORE_STACK_CAPACITY_STREAM(char, normalized, NINJA_DEPS_PATH_CAPACITY);
+	for (unsigned int node = 0; node < node_paths.size; node++) {
+		NodeDeps deps = node_deps[node];
+		if (deps.ids == nullptr) {
+			continue;
+		}
+		sorted_outputs[output_count++] = { GetOutputTarget(node_paths[node]), node };
+		for (unsigned int index = 0; index < deps.count; index++) {
+			unsigned int dependency = deps.ids[index];
+			if (node_files[dependency] == NINJA_DEPS_NO_FILE) {
+				node_files[dependency] = files.size;
+				// A path that can't be normalized is kept as it is
+				Stream<char> file = node_paths[dependency];
+				files.Add(arena.StringCopy(function::JoinPath(build_directory, file, normalized) ? Stream<char>(normalized) : file));
+			}
+		}
+	}
+
+	// The outputs of a target are made contiguous
+	std::sort(sorted_outputs, sorted_outputs + output_count, [](const NinjaDepsOutput& first, const NinjaDepsOutput& second) {
+		if (first.target == second.target) {
+			return first.node < second.node;
+		}
+		return CompareStrings(first.target, second.target);
+	});
+	for (unsigned int index = 0; index < output_count; index++) {
+		if (index == 0 || !(sorted_outputs[index].target == sorted_outputs[index - 1].target)) {
+			group_offsets.Add(index);
+			group_names.Add(sorted_outputs[index].target);
+		}
+		outputs.Add(sorted_outputs[index].node);
+	}
+	group_offsets.Add(output_count);
+	free(sorted_outputs);
+	return true;
+}
+
+void NinjaDeps::ComputeTargets(ThreadPool& thread_pool, const unsigned int* code_lines) {
+	unsigned int thread_count = thread_pool.GetThreadCount();
+	NinjaDepsTargetData data;
+	data.deps = this;
+	data.code_lines = code_lines;
+	data.next_group.store(0, CORE_RELAXED);
+	data.thread_marks = (unsigned int**)malloc(sizeof(unsigned int*) * thread_count);
+	for (unsigned int index = 0; index < thread_count; index++) {
+		data.thread_marks[index] = (unsigned int*)calloc(std::max(files.size, 1u), sizeof(unsigned int));
+	}
+	if (targets.capacity < group_names.size) {
+		targets.Resize(group_names.size);
+	}
+	targets.size = group_names.size;
+	thread_pool.Run(ComputeNinjaDepsTargets, &data);
+
+	std::stable_sort(targets.begin(), targets.end(), [](const NinjaDepsTarget& first, const NinjaDepsTarget& second) {
+		return first.code_lines > second.code_lines;
+	});
+	for (unsigned int index = 0; index < thread_count; index++) {
+		free(data.thread_marks[index]);
+	}
+	free(data.thread_marks);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "Core/Core.h"
+
+using namespace Core;
+
+struct NinjaDepsTarget {
+	// The CMake target, taken from the CMakeFiles/<target>.dir directory of its objects. The outputs
+	// outside of such a directory are targets of their own, named by their path
+	Stream<char> name;
+	// The outputs of the target that have recorded dependencies, usually its object files
+	unsigned int output_count;
+	// The distinct files that the outputs depend on, each translation unit and header once
+	unsigned int file_count;
+	size_t code_lines;
+};
+
+// The header dependencies that Ninja records in the .ninja_deps log of a build directory, versions 3 and 4. The log is
+// mapped and read record by record: the path records give the node ids, in order, and each dependency record gives
+// the nodes that an output depended on when it was last built. A later record of the same output replaces the
+// earlier one, like Ninja does. A record that is torn or doesn't check out ends the read, the rest of the log is
+// ignored. The dependencies are whatever the compiler reported, the translation unit and all its headers, the system
+// ones included, so no preprocessor or include scanner is needed. The relative paths are resolved against the
+// directory of the log
+struct NinjaDeps {
+	NinjaDeps();
+	~NinjaDeps();
+
+	NinjaDeps(const NinjaDeps& other) = delete;
+	NinjaDeps& operator = (const NinjaDeps& other) = delete;
+
+	// Returns false if the log could not be mapped or its header is not a supported Ninja deps log, the error
+	// message says why. The previous files are released
+	bool Load(Stream<char> path, CapacityStream<char>* error_message);
+
+	// The code lines are indexed like the files, from the per file results of counting them. The targets are
+	// sorted by descending code lines
+	void ComputeTargets(ThreadPool& thread_pool, const unsigned int* code_lines);
+
+	void Release();
+
+	// All the dependencies of all the outputs, each node once
+	ResizableStream<Stream<char>> files;
+	ResizableStream<NinjaDepsTarget> targets;
+	// The outputs that have dependencies
+	unsigned int output_count;
+	// The dependency records that were read, the ones that were replaced later included
+	unsigned int record_count;
+	// Set when the read stopped before the end of the log
+	bool is_truncated;
+
+	struct NodeDeps {
+		// Points into the mapping, nullptr if the node is not the output of any record
+		const unsigned int* ids;
+		unsigned int count;
+	};
+
+	Stream<char> mapping;
+	// Indexed by node id, the paths point into the mapping and are not null terminated
+	ResizableStream<Stream<char>> node_paths;
+	ResizableStream<NodeDeps> node_deps;
+	// Indexed by node id, the file of a dependency
+	ResizableStream<unsigned int> node_files;
+	// The output nodes grouped by target, the outputs of the group are [group_offsets[group], group_offsets[group + 1])
+	ResizableStream<unsigned int> outputs;
+	ResizableStream<unsigned int> group_offsets;
+	ResizableStream<Stream<char>> group_names;
+	Arena arena;
+};
@@ -0,0 +1,283 @@
+#include "PartialResult.h"
+
+#include <algorithm>
+
+#define PARTIAL_RESULT_HEADER "LineCounterPartial 1"
+#define PARTIAL_RESULT_WRITE_BUFFER_SIZE (CORE_KB * 64)
+// A line is formatted only when at least this much space is left in the write buffer
+#define PARTIAL_RESULT_LINE_RESERVE (CORE_KB * 8)
+
+// ------------------------------------------------------------------------------------------------------------
+
+static int ComparePaths(Stream<char> first, Stream<char> second) {
+	int result = memcmp(first.buffer, second.buffer, std::min(first.size, second.size));
+	return result != 0 ? result : (first.size < second.size ? -1 : (first.size > second.size ? 1 : 0));
+}
+
+static bool IsLargerFile(const PartialResultFile& first, const PartialResultFile& second) {
+	return first.code_lines != second.code_lines ? first.code_lines > second.code_lines : ComparePaths(first.path, second.path) < 0;
+}
+
+static Stream<char> GetParentDirectory(Stream<char> path) {
+	size_t size = path.size;
+	while (size > 0 && path[size - 1] != '/') {
+		size--;
+	}
+	// The trailing slash is removed, except for the root
+	return size == 0 ? Stream<char>(".") : Stream<char>(path.buffer, size > 1 ? size - 1 : size);
+}
+
+static unsigned int GetHistogramBucket(size_t code_lines) {
+	unsigned int bucket = code_lines == 0 ? 0 : 64 - (unsigned int)__builtin_clzll(code_lines);
+	return std::min(bucket, (unsigned int)PARTIAL_RESULT_HISTOGRAM_BUCKETS - 1);
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+void MakePartialResult(const LineCounterResults& results, PartialResult* partial) {
+	partial->totals = results.totals;
+	partial->error_count = results.error_count;
+	partial->file_count = 0;
+	memset(partial->histogram, 0, sizeof(partial->histogram));
+	partial->directories.size = 0;
+	partial->top_files.size = 0;
+	partial->arena.Clear();
+
+	// The files are grouped by their parent directory and ranked by their sloc
+	const LineCounterFileTable& table = results.files;
+	Stream<PartialResultFile> files = { malloc(sizeof(PartialResultFile) * std::max(table.size, (size_t)1)), 0 };
+	for (size_t index = 0; index < table.size; index++) {
+		if (!table.IsFailed(index)) {
+			files[files.size++] = { table.paths[index], index };
+			partial->histogram[GetHistogramBucket(table.code_lines[index])]++;
+		}
+	}
+	partial->file_count = files.size;
+
+	// The code_lines member holds the index of the file result while grouping
+	std::sort(files.begin(), files.end(), [](const PartialResultFile& first, const PartialResultFile& second) {
+		return ComparePaths(GetParentDirectory(first.path), GetParentDirectory(second.path)) < 0;
+	});
+	for (size_t index = 0; index < files.size; index++) {
+		size_t file_index = files[index].code_lines;
+		Stream<char> directory = GetParentDirectory(table.paths[file_index]);
+		if (partial->directories.size == 0 || !(partial->directories[partial->directories.size - 1].path == directory)) {
+			partial->directories.Add({ partial->arena.StringCopy(directory), {}, 0 });
+		}
+		PartialResultDirectory* aggregate = partial->directories.buffer + partial->directories.size - 1;
+		AddFileCounts(aggregate->counts, table.GetCounts(file_index));
+		aggregate->file_count++;
+	}
+
+	for (size_t index = 0; index < files.size; index++) {
+		files[index].code_lines = table.code_lines[files[index].code_lines];
+	}
+	size_t top_count = std::min(files.size, (size_t)PARTIAL_RESULT_TOP_FILE_COUNT);
+	std::partial_sort(files.begin(), files.begin() + top_count, files.end(), IsLargerFile);
+	for (size_t index = 0; index < top_count; index++) {
+		partial->top_files.Add({ partial->arena.StringCopy(files[index].path), files[index].code_lines });
+	}
+
+	free(files.buffer);
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+void MergePartialResult(PartialResult* destination, const PartialResult* source) {
+	AddFileCounts(destination->totals, source->totals);
+	destination->file_count += source->file_count;
+	destination->error_count += source->error_count;
+	for (size_t index = 0; index < PARTIAL_RESULT_HISTOGRAM_BUCKETS; index++) {
+		destination->histogram[index] += source->histogram[index];
+	}
+
+	// Both directory lists are sorted, they are joined into a new sorted list
+	ResizableStream<PartialResultDirectory> directories;
+	directories.Resize(destination->directories.size + source->directories.size + 1);
+	size_t destination_index = 0;
+	size_t source_index = 0;
+	while (destination_index < destination->directories.size || source_index < source->directories.size) {
+		int order = destination_index == destination->directories.size ? 1 : (source_index == source->directories.size ? -1 :
+			ComparePaths(destination->directories[destination_index].path, source->directories[source_index].path));
+		if (order < 0) {
+			directories.Add(destination->directories[destination_index++]);
+		}
+		else {
+			const PartialResultDirectory* source_directory = source->directories.buffer + source_index++;
+			if (order == 0) {
+				PartialResultDirectory merged = destination->directories[destination_index++];
+				AddFileCounts(merged.counts, source_directory->counts);
+				merged.file_count += source_directory->file_count;
+				directories.Add(merged);
+			}
+			else {
+				directories.Add({ destination->arena.StringCopy(source_directory->path), source_directory->counts, source_directory->file_count });
+			}
+		}
+	}
+	destination->directories.FreeBuffer();
+	destination->directories = directories;
+
+	for (size_t index = 0; index < source->top_files.size; index++) {
+		destination->top_files.Add({ destination->arena.StringCopy(source->top_files[index].path), source->top_files[index].code_lines });
+	}
+	std::sort(destination->top_files.begin(), destination->top_files.end(), IsLargerFile);
+	destination->top_files.size = std::min(destination->top_files.size, (unsigned int)PARTIAL_RESULT_TOP_FILE_COUNT);
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+static bool FlushPartialResultBuffer(FILE_HANDLE file, CapacityStream<char>& buffer, bool force) {
+	if (!force && buffer.capacity - buffer.size >= PARTIAL_RESULT_LINE_RESERVE) {
+		return true;
+	}
+	bool success = WriteFile(file, buffer);
+	buffer.size = 0;
+	return success;
+}
+
+static void FormatCounts(CapacityStream<char>& buffer, const FileCounts& counts) {
+	CORE_FORMAT_STRING(buffer, "{#} {#} {#} {#} {#} {#} {#}", counts.code_lines, counts.comment_lines, counts.blank_lines, counts.total_lines,
+		counts.logical_lines, counts.token_count, counts.code_bytes);
+}
+
+bool WritePartialResult(Stream<char> path, const PartialResult* partial) {
+	FILE_HANDLE file = 0;
+	if (FileCreate(path, &file, FILE_ACCESS_WRITE_ONLY | FILE_ACCESS_TRUNCATE_FILE) != FILE_STATUS_OK) {
+		return false;
+	}
+
+	CapacityStream<char> buffer = { malloc(PARTIAL_RESULT_WRITE_BUFFER_SIZE), 0, PARTIAL_RESULT_WRITE_BUFFER_SIZE };
+	buffer.AddStreamSafe(PARTIAL_RESULT_HEADER "\ntotals ");
+	FormatCounts(buffer, partial->totals);
+	CORE_FORMAT_STRING(buffer, " {#} {#}\nhistogram", partial->file_count, partial->error_count);
+	for (size_t index = 0; index < PARTIAL_RESULT_HISTOGRAM_BUCKETS; index++) {
+		CORE_FORMAT_STRING(buffer, " {#}", partial->histogram[index]);
+	}
+	buffer.AddSafe('\n');
+
+	bool success = true;
+	for (size_t index = 0; index < partial->directories.size && success; index++) {
+		const PartialResultDirectory* directory = partial->directories.buffer + index;
+		buffer.AddStreamSafe("directory ");
+		FormatCounts(buffer, directory->counts);
+		CORE_FORMAT_STRING(buffer, " {#} {#}\n", directory->file_count, directory->path);
+		success = FlushPartialResultBuffer(file, buffer, false);
+	}
+	for (size_t index = 0; index < partial->top_files.size && success; index++) {
+		CORE_FORMAT_STRING(buffer, "file {#} {#}\n", partial->top_files[index].code_lines, partial->top_files[index].path);
+		success = FlushPartialResultBuffer(file, buffer, false);
+	}
+	success = success && FlushPartialResultBuffer(file, buffer, true);
+
+	free(buffer.buffer);
+	CloseFile(file);
+	return success;
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+// Parses a decimal number followed by a space or by the end of the line
+static bool ParseNumber(const char*& pointer, size_t& value) {
+	if (*pointer < '0' || *pointer > '9') {
+		return false;
+	}
+	value = 0;
+	while (*pointer >= '0' && *pointer <= '9') {
+		value = value * 10 + (*pointer - '0');
+		pointer++;
+	}
+	if (*pointer == ' ') {
+		pointer++;
+		return true;
+	}
+	return *pointer == '\n' || *pointer == '\0';
+}
+
+static bool ParseCounts(const char*& pointer, FileCounts& counts) {
+	return ParseNumber(pointer, counts.code_lines) && ParseNumber(pointer, counts.comment_lines) && ParseNumber(pointer, counts.blank_lines)
+		&& ParseNumber(pointer, counts.total_lines) && ParseNumber(pointer, counts.logical_lines) && ParseNumber(pointer, counts.token_count)
+		&& ParseNumber(pointer, counts.code_bytes);
+}
+
+// The rest of the line
+static Stream<char> ParseLinePath(const char* pointer) {
+	const char* end = pointer;
+	while (*end != '\n' && *end != '\0') {
+		end++;
+	}
+	if (end > pointer && end[-1] == '\r') {
+		end--;
+	}
+	return { pointer, (size_t)(end - pointer) };
+}
+
+static bool StartsWith(const char*& pointer, const char* prefix) {
+	size_t size = strlen(prefix);
+	if (strncmp(pointer, prefix, size) == 0) {
+		pointer += size;
+		return true;
+	}
+	return false;
+}
+
+bool ReadPartialResult(Stream<char> path, PartialResult* destination, CapacityStream<char>* error_message) {
+	Stream<char> content = ReadWholeFileText(path);
+	if (content.buffer == nullptr) {
+		CORE_FORMAT_STRING(*error_message, "Could not read the partial result {#}.\n", path);
+		return false;
+	}
+
+	PartialResult partial;
+	const char* line = content.buffer;
+	bool success = StartsWith(line, PARTIAL_RESULT_HEADER);
+	size_t line_number = 1;
+	while (success) {
+		line = strchr(line, '\n');
+		if (line == nullptr || line[1] == '\0') {
+			break;
+		}
+		line++;
+		line_number++;
+
+		const char* pointer = line;
+		if (StartsWith(pointer, "totals ")) {
+			success = ParseCounts(pointer, partial.totals) && ParseNumber(pointer, partial.file_count) && ParseNumber(pointer, partial.error_count);
+		}
+		else if (StartsWith(pointer, "histogram ")) {
+			for (size_t index = 0; index < PARTIAL_RESULT_HISTOGRAM_BUCKETS && success; index++) {
+				success = ParseNumber(pointer, partial.histogram[index]);
+			}
+		}
+		else if (StartsWith(pointer, "directory ")) {
+			PartialResultDirectory directory;
+			success = ParseCounts(pointer, directory.counts) && ParseNumber(pointer, directory.file_count);
+			directory.path = partial.arena.StringCopy(ParseLinePath(pointer));
+			// The directories must stay sorted for the merge
+			success = success && (partial.directories.size == 0 || ComparePaths(partial.directories[partial.directories.size - 1].path, directory.path) < 0);
+			if (success) {
+				partial.directories.Add(directory);
+			}
+		}
+		else if (StartsWith(pointer, "file ")) {
+			PartialResultFile file;
+			success = ParseNumber(pointer, file.code_lines);
+			file.path = partial.arena.StringCopy(ParseLinePath(pointer));
+			if (success) {
+				partial.top_files.Add(file);
+			}
+		}
+		else {
+			success = false;
+		}
+	}
+
+	if (success) {
+		MergePartialResult(destination, &partial);
+	}
+	else {
+		CORE_FORMAT_STRING(*error_message, "The partial result {#} is malformed at line {#}.\n", path, line_number);
+	}
+	free(content.buffer);
+	return success;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "LineCounter.h"
+
+// Files are placed in the bucket of the highest set bit of their sloc, bucket 0 holds the empty files
+#define PARTIAL_RESULT_HISTOGRAM_BUCKETS 32
+#define PARTIAL_RESULT_TOP_FILE_COUNT 32
+
+struct PartialResultDirectory {
+	Stream<char> path;
+	FileCounts counts;
+	size_t file_count;
+};
+
+struct PartialResultFile {
+	Stream<char> path;
+	size_t code_lines;
+};
+
+// The mergeable summary of a count, written by each shard and combined afterwards. Merging is associative
+// and commutative, so the partial results can be merged in any order or in a tree: the counts and the
+// histogram are summed, the directories are joined by path and the top files are cut to the largest ones
+struct PartialResult {
+	PartialResult() = default;
+	PartialResult(const PartialResult& other) = delete;
+	PartialResult& operator = (const PartialResult& other) = delete;
+
+	~PartialResult() {
+		directories.FreeBuffer();
+		top_files.FreeBuffer();
+	}
+
+	FileCounts totals = {};
+	size_t file_count = 0;
+	size_t error_count = 0;
+	size_t histogram[PARTIAL_RESULT_HISTOGRAM_BUCKETS] = {};
+	// Sorted by path. A file is aggregated into its parent directory only
+	ResizableStream<PartialResultDirectory> directories;
+	// Sorted by descending sloc and then by path, at most PARTIAL_RESULT_TOP_FILE_COUNT
+	ResizableStream<PartialResultFile> top_files;
+	// The paths are allocated here
+	Arena arena;
+};
+
+// The results must have the per file results recorded
+void MakePartialResult(const LineCounterResults& results, PartialResult* partial);
+
+void MergePartialResult(PartialResult* destination, const PartialResult* source);
+
+// Returns false if the file could not be written
+bool WritePartialResult(Stream<char> path, const PartialResult* partial);
+
+// The partial result is merged into the destination. Returns false if the file could not be read
+// or if it is not a partial result, in which case the reason is appended to the error message
+bool ReadPartialResult(Stream<char> path, PartialResult* destination, CapacityStream<char>* error_message);
@@ -0,0 +1,126 @@
+#include "PathList.h"
+
+#include <algorithm>
+
+struct PathListSplitData {
+	PathList* list;
+	// The lines that end in a new line, the last line is handled apart
+	Stream<char> content;
+	// The range of each thread is [range_starts[thread], range_starts[thread + 1])
+	size_t* range_starts;
+	size_t* entry_offsets;
+};
+
+// ------------------------------------------------------------------------------------------------------------
+
+// Advances to the next line that is not empty after trimming. Returns false at the end of the range
+static bool NextPathListEntry(const char*& pointer, const char* end, Stream<char>& entry) {
+	while (pointer < end) {
+		const char* line_end = (const char*)memchr(pointer, '\n', end - pointer);
+		line_end = line_end != nullptr ? line_end : end;
+		entry = function::TrimWhitespace({ pointer, (size_t)(line_end - pointer) });
+		pointer = line_end + 1;
+		if (entry.size > 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+CORE_THREAD_TASK(CountPathListEntries) {
+	PathListSplitData* data = (PathListSplitData*)_data;
+	const char* pointer = data->content.buffer + data->range_starts[thread_id];
+	const char* end = data->content.buffer + data->range_starts[thread_id + 1];
+
+	size_t count = 0;
+	Stream<char> entry;
+	while (NextPathListEntry(pointer, end, entry)) {
+		count++;
+	}
+	data->entry_offsets[thread_id] = count;
+}
+
+CORE_THREAD_TASK(FillPathListEntries) {
+	PathListSplitData* data = (PathListSplitData*)_data;
+	const char* pointer = data->content.buffer + data->range_starts[thread_id];
+	const char* end = data->content.buffer + data->range_starts[thread_id + 1];
+
+	Stream<Stream<char>> paths = data->list->paths;
+	size_t offset = data->entry_offsets[thread_id];
+	Stream<char> entry;
+	while (NextPathListEntry(pointer, end, entry)) {
+		// The trimmed entry ends at most at the new line of its line, which is inside the range
+		entry[entry.size] = '\0';
+		paths[offset++] = entry;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+PathList::PathList() : paths({ nullptr, 0 }), mapping({ nullptr, 0 }), last_line(nullptr) {}
+
+PathList::~PathList() {
+	Release();
+}
+
+void PathList::Release() {
+	UnmapFile(mapping);
+	free(paths.buffer);
+	free(last_line);
+	paths = { nullptr, 0 };
+	mapping = { nullptr, 0 };
+	last_line = nullptr;
+}
+
+bool PathList::Load(Stream<char> path, ThreadPool& thread_pool) {
+	Release();
+	mapping = MapFilePrivate(path);
+	if (mapping.buffer == nullptr) {
+		// An empty file can't be mapped, it is a list without entries
+		return IsEmptyFile(path);
+	}
+
+	PathListSplitData data;
+	data.list = this;
+	data.content = mapping;
+	if (mapping[mapping.size - 1] != '\n') {
+		const char* last_new_line = (const char*)memrchr(mapping.buffer, '\n', mapping.size);
+		data.content.size = last_new_line != nullptr ? last_new_line - mapping.buffer + 1 : 0;
+		Stream<char> line = function::TrimWhitespace({ mapping.buffer + data.content.size, mapping.size - data.content.size });
+		if (line.size > 0) {
+			last_line = (char*)malloc(line.size + 1);
+			memcpy(last_line, line.buffer, line.size);
+			last_line[line.size] = '\0';
+		}
+	}
+
+	// The ranges are cut evenly and moved forward past the next new line, such that no line is split
+	unsigned int thread_count = thread_pool.GetThreadCount();
+	data.range_starts = (size_t*)malloc(sizeof(size_t) * (thread_count + 1));
+	data.entry_offsets = (size_t*)malloc(sizeof(size_t) * thread_count);
+	data.range_starts[0] = 0;
+	data.range_starts[thread_count] = data.content.size;
+	for (unsigned int index = 1; index < thread_count; index++) {
+		size_t start = std::max(data.content.size / thread_count * index, data.range_starts[index - 1]);
+		const char* new_line = (const char*)memchr(data.content.buffer + start, '\n', data.content.size - start);
+		data.range_starts[index] = new_line != nullptr ? new_line - data.content.buffer + 1 : data.content.size;
+	}
+	thread_pool.Run(CountPathListEntries, &data);
+
+	size_t entry_count = 0;
+	for (unsigned int index = 0; index < thread_count; index++) {
+		size_t count = data.entry_offsets[index];
+		data.entry_offsets[index] = entry_count;
+		entry_count += count;
+	}
+	size_t path_count = entry_count + (last_line != nullptr ? 1 : 0);
+	paths = { malloc(sizeof(Stream<char>) * std::max(path_count, (size_t)1)), path_count };
+	thread_pool.Run(FillPathListEntries, &data);
+	if (last_line != nullptr) {
+		paths[entry_count] = last_line;
+	}
+
+	free(data.range_starts);
+	free(data.entry_offsets);
+	return true;
+}
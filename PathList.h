@@ -0,0 +1,27 @@
+#pragma once
+#include "Core/Core.h"
+
+using namespace Core;
+
+// A text file with one path on each line, like line_count.in or a file list generated from a build graph.
+// The file is mapped and split by all the threads of a pool. Each thread takes a range of bytes that starts
+// after a new line and counts its entries; the prefix sums of the counts give each thread the position of
+// its entries in the path table, which it fills in a second pass. The paths point into the mapping, they are
+// trimmed and null terminated in place and the empty lines are skipped. Nothing is allocated for each line
+struct PathList {
+	PathList();
+	~PathList();
+
+	PathList(const PathList& other) = delete;
+	PathList& operator = (const PathList& other) = delete;
+
+	// Returns false if the file could not be mapped. An empty file has no paths. The previous paths are released
+	bool Load(Stream<char> path, ThreadPool& thread_pool);
+
+	void Release();
+
+	Stream<Stream<char>> paths;
+	Stream<char> mapping;
+	// A copy of the last line when the file doesn't end in a new line, it can't be terminated in the mapping
+	char* last_line;
+};
@@ -0,0 +1,396 @@
+#include "TreeSnapshot.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define TREE_SNAPSHOT_HEADER "LineCounterTreeSnapshot 1 "
+#define TREE_SNAPSHOT_PATH_CAPACITY 4096
+#define TREE_SNAPSHOT_BATCH_CAPACITY (CORE_MB)
+// A line is formatted only when this much space is left in the batch
+#define TREE_SNAPSHOT_LINE_RESERVE (TREE_SNAPSHOT_PATH_CAPACITY + 256)
+// The time stamps of the file systems can be as coarse as 2 seconds and lag behind the clock
+#define TREE_SNAPSHOT_RACY_INTERVAL_NS 2000000000ull
+#define TREE_SNAPSHOT_HASH_PRIME 1099511628211ull
+#define TREE_SNAPSHOT_HASH_BASIS 14695981039346656037ull
+
+struct TreeSnapshotWalk {
+	const TreeSnapshot* snapshot;
+	TreeSnapshotWriter* writer;
+	Arena* arena;
+	Stream<Stream<char>> extensions;
+	void* data;
+	ForEachFileFunctor functor;
+	DirectoryVisitSet* visited;
+};
+
+// ------------------------------------------------------------------------------------------------------------
+
+static uint64_t GetModificationTime(const struct stat& file_stat) {
+	return (uint64_t)file_stat.st_mtim.tv_sec * 1000000000ull + (uint64_t)file_stat.st_mtim.tv_nsec;
+}
+
+static bool HasExtension(Stream<char> name, Stream<Stream<char>> extensions) {
+	for (size_t index = 0; index < extensions.size; index++) {
+		if (function::EndsWith(name, extensions[index])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// The number must be followed by a space
+static bool ParseNumber(const char*& pointer, uint64_t& value) {
+	char* end = nullptr;
+	if (*pointer < '0' || *pointer > '9') {
+		return false;
+	}
+	value = strtoull(pointer, &end, 10);
+	if (*end != ' ') {
+		return false;
+	}
+	pointer = end + 1;
+	return true;
+}
+
+// The path is null terminated. Adds the subdirectories and the files with one of the extensions to the writer.
+// Returns false if the directory could not be opened
+static bool ReadSnapshotDirectory(TreeSnapshotWalk& walk, CapacityStream<char>& path) {
+	DIR* directory = opendir(path.buffer);
+	if (directory == nullptr) {
+		return false;
+	}
+
+	unsigned int base_size = path.size;
+	struct dirent* entry;
+	while ((entry = readdir(directory)) != nullptr) {
+		const char* name = entry->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+			continue;
+		}
+
+		unsigned char type = entry->d_type;
+		size_t name_size = strlen(name);
+		if (type == DT_UNKNOWN || type == DT_LNK) {
+			// The symlinks are resolved through the full path
+			if (base_size + 1 + name_size + 1 > path.capacity) {
+				continue;
+			}
+			path.size = base_size;
+			if (path.size > 0 && path[path.size - 1] != '/') {
+				path.buffer[path.size++] = '/';
+			}
+			memcpy(path.buffer + path.size, name, name_size + 1);
+			struct stat entry_stat;
+			int status = stat(path.buffer, &entry_stat);
+			path.size = base_size;
+			path.buffer[base_size] = '\0';
+			if (status != 0) {
+				continue;
+			}
+			type = S_ISDIR(entry_stat.st_mode) ? DT_DIR : (S_ISREG(entry_stat.st_mode) ? DT_REG : DT_UNKNOWN);
+		}
+
+		if (type == DT_DIR || (type == DT_REG && HasExtension({ name, name_size }, walk.extensions))) {
+			walk.writer->entries.Add({ walk.arena->StringCopy({ name, name_size }), type == DT_DIR });
+		}
+	}
+	closedir(directory);
+	return true;
+}
+
+// Returns false if the functor stopped the walk. The hash and the file count of the subtree are folded into the
+// ones of the parent
+static bool WalkSnapshotDirectory(TreeSnapshotWalk& walk, CapacityStream<char>& path, bool check_visited, uint64_t& parent_hash, size_t& parent_file_count) {
+	// The identity of the directory, not of the entry, such that the symlinks and the mount points are handled
+	struct stat directory_stat;
+	if (stat(path.buffer, &directory_stat) != 0 || !S_ISDIR(directory_stat.st_mode)) {
+		return true;
+	}
+	FileIdentity identity = { (uint64_t)directory_stat.st_dev, (uint64_t)directory_stat.st_ino };
+	if (check_visited && !walk.visited->Insert(identity)) {
+		return true;
+	}
+
+	TreeSnapshotWriter* writer = walk.writer;
+	unsigned int directory_index = writer->directories.size;
+	unsigned int entry_offset = writer->entries.size;
+	const TreeSnapshotDirectory* previous = walk.snapshot->Find(path);
+	uint64_t modification_time = GetModificationTime(directory_stat);
+	if (previous != nullptr && previous->modification_time == modification_time && previous->identity == identity) {
+		// The entries and the path keep pointing into the previous snapshot
+		for (unsigned int index = 0; index < previous->entry_count; index++) {
+			writer->entries.Add(walk.snapshot->entries[previous->entry_offset + index]);
+		}
+		writer->paths.Add(walk.snapshot->paths[(unsigned int)(previous - walk.snapshot->directories.buffer)]);
+		writer->reused_count++;
+	}
+	else {
+		// A directory that cannot be opened is skipped and it is not recorded
+		if (!ReadSnapshotDirectory(walk, path)) {
+			return true;
+		}
+		writer->paths.Add(walk.arena->StringCopy(path));
+		writer->read_count++;
+	}
+	unsigned int entry_count = writer->entries.size - entry_offset;
+	writer->directories.Add({ modification_time, identity, entry_offset, entry_count, 0, 0 });
+
+	uint64_t hash = TREE_SNAPSHOT_HASH_BASIS;
+	size_t file_count = 0;
+	unsigned int base_size = path.size;
+	bool continue_iteration = true;
+	for (unsigned int index = 0; index < entry_count && continue_iteration; index++) {
+		// The entries can move while the subdirectories are walked
+		TreeSnapshotEntry entry = writer->entries[entry_offset + index];
+		hash = (hash ^ function::HashString(entry.name) ^ (uint64_t)entry.is_directory) * TREE_SNAPSHOT_HASH_PRIME;
+		if (base_size + 1 + entry.name.size + 1 > path.capacity) {
+			continue;
+		}
+
+		path.size = base_size;
+		if (path.size > 0 && path[path.size - 1] != '/') {
+			path.buffer[path.size++] = '/';
+		}
+		memcpy(path.buffer + path.size, entry.name.buffer, entry.name.size);
+		path.size += (unsigned int)entry.name.size;
+		path.buffer[path.size] = '\0';
+
+		if (entry.is_directory) {
+			// Only the functor can stop the iteration
+			continue_iteration = WalkSnapshotDirectory(walk, path, walk.visited != nullptr, hash, file_count);
+		}
+		else {
+			file_count++;
+			continue_iteration = walk.functor({ path.buffer, path.size }, walk.data);
+		}
+	}
+	path.size = base_size;
+	path.buffer[base_size] = '\0';
+
+	TreeSnapshotDirectory* directory = writer->directories.buffer + directory_index;
+	directory->subtree_hash = hash;
+	directory->subtree_file_count = file_count;
+	if (previous != nullptr && previous->subtree_hash == hash && previous->subtree_file_count == file_count) {
+		writer->unchanged_subtree_count++;
+	}
+	parent_hash = (parent_hash ^ hash) * TREE_SNAPSHOT_HASH_PRIME;
+	parent_file_count += file_count;
+	return continue_iteration;
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+TreeSnapshot::TreeSnapshot(unsigned int _thread_count) : content({ nullptr, 0 }), index_buffer(nullptr), thread_count(_thread_count), walk_start_time(0) {
+	index = { nullptr, 0, nullptr };
+	writers = new TreeSnapshotWriter[thread_count];
+	Reset();
+}
+
+TreeSnapshot::~TreeSnapshot() {
+	for (unsigned int index = 0; index < thread_count; index++) {
+		writers[index].paths.FreeBuffer();
+		writers[index].directories.FreeBuffer();
+		writers[index].entries.FreeBuffer();
+	}
+	delete[] writers;
+	paths.FreeBuffer();
+	directories.FreeBuffer();
+	entries.FreeBuffer();
+	free(content.buffer);
+	free(index_buffer);
+}
+
+void TreeSnapshot::Reset() {
+	for (unsigned int index = 0; index < thread_count; index++) {
+		writers[index].paths.size = 0;
+		writers[index].directories.size = 0;
+		writers[index].entries.size = 0;
+		writers[index].reused_count = 0;
+		writers[index].read_count = 0;
+		writers[index].unchanged_subtree_count = 0;
+	}
+}
+
+bool TreeSnapshot::Load(Stream<char> path, uint64_t fingerprint) {
+	Reset();
+	free(content.buffer);
+	paths.size = 0;
+	directories.size = 0;
+	entries.size = 0;
+	timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	walk_start_time = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+
+	content = ReadWholeFileText(path);
+	bool success = content.buffer != nullptr;
+	char* line = content.buffer;
+	char* end = content.buffer + content.size;
+	while (success && line < end) {
+		char* line_end = (char*)memchr(line, '\n', end - line);
+		if (line_end == nullptr) {
+			success = false;
+			break;
+		}
+		// The paths and the names are null terminated in place
+		*line_end = '\0';
+
+		const char* pointer = line;
+		uint64_t values[5];
+		if (line == content.buffer) {
+			size_t header_size = strlen(TREE_SNAPSHOT_HEADER);
+			success = strncmp(line, TREE_SNAPSHOT_HEADER, header_size) == 0 && strtoull(line + header_size, nullptr, 10) == fingerprint;
+		}
+		else if (line[0] == 'd' && line[1] == ' ') {
+			pointer += 2;
+			for (size_t index = 0; index < std::size(values) && success; index++) {
+				success = ParseNumber(pointer, values[index]);
+			}
+			if (success) {
+				paths.Add({ pointer, (size_t)(line_end - pointer) });
+				directories.Add({ values[0], { values[1], values[2] }, entries.size, 0, values[4], values[3] });
+			}
+		}
+		else if ((line[0] == 'f' || line[0] == 's') && line[1] == ' ' && directories.size > 0) {
+			entries.Add({ { line + 2, (size_t)(line_end - line - 2) }, line[0] == 's' });
+			directories[directories.size - 1].entry_count++;
+		}
+		else {
+			success = false;
+		}
+		line = line_end + 1;
+	}
+
+	if (!success) {
+		free(content.buffer);
+		content = { nullptr, 0 };
+		paths.size = 0;
+		directories.size = 0;
+		entries.size = 0;
+	}
+	free(index_buffer);
+	index_buffer = malloc(ConcurrentHashTable::MemoryOf(paths.size));
+	index.Initialize(index_buffer, paths.size, paths.buffer);
+	for (unsigned int index_value = 0; index_value < paths.size; index_value++) {
+		index.Insert(index_value);
+	}
+	return success;
+}
+
+bool TreeSnapshot::Save(Stream<char> path, uint64_t fingerprint) const {
+	CORE_STACK_CAPACITY_STREAM(char, temporary_path, TREE_SNAPSHOT_PATH_CAPACITY);
+	CORE_FORMAT_STRING(temporary_path, "{#}.tmp", path);
+	if (!temporary_path.AddSafe('\0')) {
+		return false;
+	}
+	FILE_HANDLE file = -1;
+	if (FileCreate(temporary_path, &file, FILE_ACCESS_WRITE_ONLY | FILE_ACCESS_TRUNCATE_FILE) != FILE_STATUS_OK) {
+		return false;
+	}
+
+	CapacityStream<char> batch = { malloc(TREE_SNAPSHOT_BATCH_CAPACITY), 0, TREE_SNAPSHOT_BATCH_CAPACITY };
+	bool success = true;
+	CORE_FORMAT_STRING(batch, TREE_SNAPSHOT_HEADER "{#}\n", fingerprint);
+	for (unsigned int thread_index = 0; thread_index < thread_count; thread_index++) {
+		const TreeSnapshotWriter* writer = writers + thread_index;
+		for (unsigned int directory_index = 0; directory_index < writer->directories.size; directory_index++) {
+			const TreeSnapshotDirectory* directory = writer->directories.buffer + directory_index;
+			Stream<char> directory_path = writer->paths[directory_index];
+			if (memchr(directory_path.buffer, '\n', directory_path.size) != nullptr || directory_path.size > TREE_SNAPSHOT_PATH_CAPACITY) {
+				continue;
+			}
+
+			// A directory that changed while it was listed, or an entry that can't be written, make it be read again
+			bool is_racy = directory->modification_time + TREE_SNAPSHOT_RACY_INTERVAL_NS >= walk_start_time;
+			for (unsigned int index = 0; index < directory->entry_count && !is_racy; index++) {
+				Stream<char> name = writer->entries[directory->entry_offset + index].name;
+				is_racy = memchr(name.buffer, '\n', name.size) != nullptr;
+			}
+			CORE_FORMAT_STRING(batch, "d {#} {#} {#} {#} {#} {#}\n", is_racy ? 0 : directory->modification_time, directory->identity.device,
+				directory->identity.inode, directory->subtree_file_count, directory->subtree_hash, directory_path);
+			for (unsigned int index = 0; index < directory->entry_count; index++) {
+				const TreeSnapshotEntry* entry = writer->entries.buffer + directory->entry_offset + index;
+				if (memchr(entry->name.buffer, '\n', entry->name.size) == nullptr) {
+					CORE_FORMAT_STRING(batch, "{#} {#}\n", entry->is_directory ? "s" : "f", entry->name);
+				}
+				if (batch.capacity - batch.size < TREE_SNAPSHOT_LINE_RESERVE) {
+					success &= WriteFile(file, batch);
+					batch.size = 0;
+				}
+			}
+			if (batch.capacity - batch.size < TREE_SNAPSHOT_LINE_RESERVE) {
+				success &= WriteFile(file, batch);
+				batch.size = 0;
+			}
+		}
+	}
+	success &= WriteFile(file, batch);
+	free(batch.buffer);
+	CloseFile(file);
+
+	// The old snapshot is replaced only by a complete one
+	CORE_STACK_CAPACITY_STREAM(char, final_path, TREE_SNAPSHOT_PATH_CAPACITY);
+	final_path.AddStreamSafe(path);
+	success = success && final_path.AddSafe('\0') && rename(temporary_path.buffer, final_path.buffer) == 0;
+	if (!success) {
+		remove(temporary_path.buffer);
+	}
+	return success;
+}
+
+bool TreeSnapshot::Walk(
+	unsigned int thread_id,
+	Stream<char> directory,
+	Stream<Stream<char>> extensions,
+	void* data,
+	ForEachFileFunctor functor,
+	DirectoryVisitSet* visited,
+	Arena* arena
+) {
+	CORE_STACK_CAPACITY_STREAM(char, path, TREE_SNAPSHOT_PATH_CAPACITY);
+	if (directory.size + 1 > path.capacity) {
+		return false;
+	}
+	path.AddStream(directory);
+	path.buffer[path.size] = '\0';
+
+	TreeSnapshotWalk walk = { this, writers + thread_id, arena, extensions, data, functor, visited };
+	uint64_t root_hash = TREE_SNAPSHOT_HASH_BASIS;
+	size_t root_file_count = 0;
+	return WalkSnapshotDirectory(walk, path, false, root_hash, root_file_count);
+}
+
+const TreeSnapshotDirectory* TreeSnapshot::Find(Stream<char> path) const {
+	if (paths.size == 0) {
+		return nullptr;
+	}
+	unsigned int directory_index = index.Find(path);
+	return directory_index != CORE_HASH_TABLE_NOT_FOUND ? directories.buffer + directory_index : nullptr;
+}
+
+size_t TreeSnapshot::GetReusedCount() const {
+	size_t count = 0;
+	for (unsigned int index = 0; index < thread_count; index++) {
+		count += writers[index].reused_count;
+	}
+	return count;
+}
+
+size_t TreeSnapshot::GetReadCount() const {
+	size_t count = 0;
+	for (unsigned int index = 0; index < thread_count; index++) {
+		count += writers[index].read_count;
+	}
+	return count;
+}
+
+size_t TreeSnapshot::GetUnchangedSubtreeCount() const {
+	size_t count = 0;
+	for (unsigned int index = 0; index < thread_count; index++) {
+		count += writers[index].unchanged_subtree_count;
+	}
+	return count;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include "Core/Core.h"
+
+using namespace Core;
+
+struct TreeSnapshotEntry {
+	Stream<char> name;
+	bool is_directory;
+};
+
+struct TreeSnapshotDirectory {
+	// In nanoseconds. A directory that changed while it was walked is saved with 0, such that it is read again
+	uint64_t modification_time;
+	FileIdentity identity;
+	// The entries are [entry_offset, entry_offset + entry_count), in the order of the listing. Only the files
+	// with one of the extensions are kept, next to all the subdirectories
+	unsigned int entry_offset;
+	unsigned int entry_count;
+	// The Merkle aggregates of the subtree: the hash of the entries of the directory combined with the hashes
+	// of its subdirectories, and the number of files below it
+	uint64_t subtree_hash;
+	size_t subtree_file_count;
+};
+
+// The directories that one discovery thread walked, in preorder
+struct TreeSnapshotWriter {
+	ResizableStream<Stream<char>> paths;
+	ResizableStream<TreeSnapshotDirectory> directories;
+	ResizableStream<TreeSnapshotEntry> entries;
+	// The directories that were listed from the previous snapshot and the ones that were read
+	size_t reused_count;
+	size_t read_count;
+	// The directories whose subtree has the same hash as in the previous snapshot
+	size_t unchanged_subtree_count;
+};
+
+// The directory tree of the last discovery, persisted between runs. A directory's modification time changes
+// when an entry is added, removed or renamed in it, so a directory whose time and identity are the same as in
+// the snapshot is listed from there, without opening it: a run over an unchanged tree costs one stat per
+// directory and no directory reads. The time doesn't change when a file is edited or when something changes
+// deeper in the tree, so every directory is still checked and the files are still counted. The hash of each
+// subtree is stored with it, Merkle style, such that an unchanged subtree is recognized from its root alone.
+// The snapshot depends on the extensions, another set of extensions starts over. The file is written to a
+// temporary path and renamed over the old one, an interrupted run leaves the previous snapshot
+struct TreeSnapshot {
+	TreeSnapshot(unsigned int thread_count);
+	~TreeSnapshot();
+
+	TreeSnapshot(const TreeSnapshot& other) = delete;
+	TreeSnapshot& operator = (const TreeSnapshot& other) = delete;
+
+	// Reads the snapshot of the previous run and clears the writers. Returns false if there is none or it was
+	// taken with another fingerprint, all the directories are read then
+	bool Load(Stream<char> path, uint64_t fingerprint);
+
+	// Writes the directories that the walks recorded. Returns false if the file could not be written
+	bool Save(Stream<char> path, uint64_t fingerprint) const;
+
+	// Clears the writers, the previous snapshot is kept
+	void Reset();
+
+	// The same walk as ForEachFileInDirectoryRecursiveWithExtension, which records the directories into the
+	// writer of the thread. Called from the discovery threads, the previous snapshot is only read. The names
+	// of the directories that are read are copied into the arena
+	bool Walk(
+		unsigned int thread_id,
+		Stream<char> directory,
+		Stream<Stream<char>> extensions,
+		void* data,
+		ForEachFileFunctor functor,
+		DirectoryVisitSet* visited,
+		Arena* arena
+	);
+
+	// Returns nullptr if the previous snapshot doesn't have the directory
+	const TreeSnapshotDirectory* Find(Stream<char> path) const;
+
+	size_t GetReusedCount() const;
+	size_t GetReadCount() const;
+	size_t GetUnchangedSubtreeCount() const;
+
+	// The previous snapshot, the paths and the names point into the content
+	Stream<char> content;
+	ResizableStream<Stream<char>> paths;
+	ResizableStream<TreeSnapshotDirectory> directories;
+	ResizableStream<TreeSnapshotEntry> entries;
+	ConcurrentHashTable index;
+	void* index_buffer;
+
+	unsigned int thread_count;
+	TreeSnapshotWriter* writers;
+	// The directories modified after this time, in nanoseconds, may have changed during the walk
+	uint64_t walk_start_time;
+};
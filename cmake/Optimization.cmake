@@ -0,0 +1,69 @@
+# Link time optimization and profile guided optimization settings.
+#
+# LINE_COUNTER_LTO            Enables interprocedural optimization for all the targets
+# LINE_COUNTER_PGO            OFF, GENERATE (instrumented build) or USE (optimized with the recorded profile)
+# LINE_COUNTER_PGO_PROFILE_DIR Where the instrumented binary writes its profile and where USE reads it from
+
+option(LINE_COUNTER_LTO "Enable link time optimization" OFF)
+set(LINE_COUNTER_PGO "OFF" CACHE STRING "Profile guided optimization mode: OFF, GENERATE or USE")
+set_property(CACHE LINE_COUNTER_PGO PROPERTY STRINGS OFF GENERATE USE)
+set(LINE_COUNTER_PGO_PROFILE_DIR "${CMAKE_BINARY_DIR}/pgo-profile" CACHE PATH "Directory of the PGO profile data")
+
+if(LINE_COUNTER_LTO)
+	include(CheckIPOSupported)
+	check_ipo_supported(RESULT LINE_COUNTER_IPO_SUPPORTED OUTPUT LINE_COUNTER_IPO_ERROR LANGUAGES CXX)
+	if(LINE_COUNTER_IPO_SUPPORTED)
+		set(CMAKE_INTERPROCEDURAL_OPTIMIZATION ON)
+	else()
+		message(WARNING "LTO is not supported by this toolchain: ${LINE_COUNTER_IPO_ERROR}")
+	endif()
+endif()
+
+if(LINE_COUNTER_PGO STREQUAL "GENERATE")
+	if(CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+		# The worker threads update the counters concurrently
+		add_compile_options(-fprofile-generate=${LINE_COUNTER_PGO_PROFILE_DIR} -fprofile-update=atomic)
+		add_link_options(-fprofile-generate=${LINE_COUNTER_PGO_PROFILE_DIR})
+	elseif(CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+		add_compile_options(-fprofile-instr-generate=${LINE_COUNTER_PGO_PROFILE_DIR}/%m-%p.profraw)
+		add_link_options(-fprofile-instr-generate=${LINE_COUNTER_PGO_PROFILE_DIR}/%m-%p.profraw)
+	else()
+		message(FATAL_ERROR "PGO is only supported with GCC and Clang")
+	endif()
+elseif(LINE_COUNTER_PGO STREQUAL "USE")
+	if(CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+		# The profile of a multithreaded run can have small inconsistencies, let GCC smooth them out
+		add_compile_options(-fprofile-use=${LINE_COUNTER_PGO_PROFILE_DIR} -fprofile-correction -Wno-missing-profile)
+		add_link_options(-fprofile-use=${LINE_COUNTER_PGO_PROFILE_DIR})
+	elseif(CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+		add_compile_options(-fprofile-instr-use=${LINE_COUNTER_PGO_PROFILE_DIR}/merged.profdata)
+		add_link_options(-fprofile-instr-use=${LINE_COUNTER_PGO_PROFILE_DIR}/merged.profdata)
+	else()
+		message(FATAL_ERROR "PGO is only supported with GCC and Clang")
+	endif()
+elseif(NOT LINE_COUNTER_PGO STREQUAL "OFF")
+	message(FATAL_ERROR "LINE_COUNTER_PGO must be OFF, GENERATE or USE")
+endif()
+
+# The release pipeline: builds an instrumented binary, trains it on the corpus and then rebuilds
+# with the profile and LTO. Both binaries end up in the pgo directory of the build tree
+set(LINE_COUNTER_PGO_CORPUS "${CMAKE_SOURCE_DIR}" CACHE STRING "Semicolon separated root paths used as the PGO training workload")
+set(LINE_COUNTER_PGO_TRAINING_RUNS 3 CACHE STRING "How many times the training workload is run")
+
+# The corpus list is passed with | separators, since the semicolons would split the argument
+string(REPLACE ";" "|" LINE_COUNTER_PGO_CORPUS_ARGUMENT "${LINE_COUNTER_PGO_CORPUS}")
+
+add_custom_target(pgo
+	COMMAND ${CMAKE_COMMAND}
+		-DSOURCE_DIR=${CMAKE_SOURCE_DIR}
+		-DPIPELINE_DIR=${CMAKE_BINARY_DIR}/pgo
+		"-DGENERATOR=${CMAKE_GENERATOR}"
+		-DCXX_COMPILER=${CMAKE_CXX_COMPILER}
+		-DCXX_COMPILER_ID=${CMAKE_CXX_COMPILER_ID}
+		"-DCORPUS=${LINE_COUNTER_PGO_CORPUS_ARGUMENT}"
+		-DTRAINING_RUNS=${LINE_COUNTER_PGO_TRAINING_RUNS}
+		-P ${CMAKE_SOURCE_DIR}/cmake/PGOPipeline.cmake
+	USES_TERMINAL
+	VERBATIM
+	COMMENT "Building the instrumented and the profile optimized LineCounter"
+)
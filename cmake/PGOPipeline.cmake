@@ -0,0 +1,58 @@
+# Run with cmake -P, normally through the pgo target.
+# The instrumented and the optimized builds share the same build directory, since GCC
+# names the profile files after the object paths.
+
+foreach(variable SOURCE_DIR PIPELINE_DIR GENERATOR CXX_COMPILER CXX_COMPILER_ID CORPUS TRAINING_RUNS)
+	if(NOT DEFINED ${variable})
+		message(FATAL_ERROR "${variable} must be defined")
+	endif()
+endforeach()
+
+string(REPLACE "|" ";" CORPUS "${CORPUS}")
+
+set(BUILD_DIR "${PIPELINE_DIR}/build")
+set(PROFILE_DIR "${PIPELINE_DIR}/profile")
+set(TRAINING_DIR "${PIPELINE_DIR}/training")
+
+function(run_step description)
+	message(STATUS "PGO: ${description}")
+	execute_process(COMMAND ${ARGN} RESULT_VARIABLE result)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "PGO: ${description} failed with ${result}")
+	endif()
+endfunction()
+
+function(configure_and_build mode)
+	run_step("configuring the ${mode} build"
+		${CMAKE_COMMAND} -S ${SOURCE_DIR} -B ${BUILD_DIR} -G ${GENERATOR}
+		-DCMAKE_BUILD_TYPE=Release
+		-DCMAKE_CXX_COMPILER=${CXX_COMPILER}
+		-DLINE_COUNTER_LTO=ON
+		-DLINE_COUNTER_PGO=${mode}
+		-DLINE_COUNTER_PGO_PROFILE_DIR=${PROFILE_DIR}
+	)
+	run_step("building the ${mode} build" ${CMAKE_COMMAND} --build ${BUILD_DIR} --target LineCounter --parallel)
+endfunction()
+
+file(REMOVE_RECURSE ${PROFILE_DIR} ${TRAINING_DIR})
+file(MAKE_DIRECTORY ${PROFILE_DIR} ${TRAINING_DIR})
+
+configure_and_build(GENERATE)
+run_step("saving the instrumented binary" ${CMAKE_COMMAND} -E copy ${BUILD_DIR}/LineCounter ${PIPELINE_DIR}/LineCounter-instrumented)
+
+# The training runs happen in their own directory, such that line_count.out doesn't end up in the sources
+foreach(run RANGE 1 ${TRAINING_RUNS})
+	run_step("training run ${run} of ${TRAINING_RUNS}" ${PIPELINE_DIR}/LineCounter-instrumented ${CORPUS}
+		WORKING_DIRECTORY ${TRAINING_DIR} OUTPUT_QUIET)
+endforeach()
+
+if(CXX_COMPILER_ID MATCHES "Clang")
+	find_program(LLVM_PROFDATA NAMES llvm-profdata REQUIRED)
+	file(GLOB RAW_PROFILES ${PROFILE_DIR}/*.profraw)
+	run_step("merging the profiles" ${LLVM_PROFDATA} merge -output=${PROFILE_DIR}/merged.profdata ${RAW_PROFILES})
+endif()
+
+configure_and_build(USE)
+run_step("saving the optimized binary" ${CMAKE_COMMAND} -E copy ${BUILD_DIR}/LineCounter ${PIPELINE_DIR}/LineCounter-pgo)
+
+message(STATUS "PGO: ${PIPELINE_DIR}/LineCounter-instrumented and ${PIPELINE_DIR}/LineCounter-pgo are ready")
@@ -1,404 +1,615 @@
-#include "ECSEngineUtilities.h"
-#include "ECSEngineMultithreading.h"
-#include "ECSEngineWorld.h"
-
-#define SEARCH_PATH_FILE L"line_count.in"
-#define OUTPUT_FILE L"line_count.out"
-#define MAX_FILES (ECS_KB * 256)
+#include "LineCounter.h"
+#include "PartialResult.h"
+#include "MultiProcessCounter.h"
+#include "PathList.h"
+#include "CompileCommands.h"
+#include "NinjaDeps.h"
+
+#define SEARCH_PATH_FILE "line_count.in"
+#define OUTPUT_FILE "line_count.out"
+// How many headers the include report lists
+#define INCLUDE_REPORT_HEADER_COUNT 20
+// The per file report is formatted and written in pieces of this many files
+#define REPORT_CHUNK_FILE_COUNT 4096
+
+// Merges the partial results of the shards, prints the combined summary and, if an output path
+// is given, writes the merged partial result such that it can be merged again
+static int MergePartialResults(Stream<Stream<char>> partial_paths, Stream<char> output_path) {
+	Timer timer;
+	PartialResult merged;
+	CORE_STACK_CAPACITY_STREAM(char, error_message, 4096);
+	for (size_t index = 0; index < partial_paths.size; index++) {
+		if (!ReadPartialResult(partial_paths[index], &merged, &error_message)) {
+			printf("%.*s", (int)error_message.size, error_message.buffer);
+			return 1;
+		}
+	}
 
-#define MAX_NEW_LINES_PER_FILE ECS_KB * 128
+	CORE_STACK_CAPACITY_STREAM(char, message, 512);
+	CORE_FORMAT_STRING(message, "Merged {#} partial results with {#} files and {#} errors.\nThere are {#} lines.\nComment lines: {#}, blank lines: {#}, total lines: {#}.\n"
+		"Logical lines: {#}.\nTokens: {#}, code bytes: {#}.\nDirectories: {#}.\nMerge time: {#} us\n", partial_paths.size, merged.file_count, merged.error_count,
+		merged.totals.code_lines, merged.totals.comment_lines, merged.totals.blank_lines, merged.totals.total_lines, merged.totals.logical_lines,
+		merged.totals.token_count, merged.totals.code_bytes, merged.directories.size, timer.GetDurationSinceMarker(TIMER_DURATION_US));
+	printf("%s", message.buffer);
+
+	printf("\nFiles by sloc:\n");
+	for (size_t index = 0; index < PARTIAL_RESULT_HISTOGRAM_BUCKETS; index++) {
+		if (merged.histogram[index] > 0) {
+			size_t bucket_start = index == 0 ? 0 : 1ull << (index - 1);
+			printf("[%zu, %zu): %zu\n", bucket_start, index == 0 ? 1 : bucket_start * 2, merged.histogram[index]);
+		}
+	}
 
-#define PER_THREAD_ADDITIONAL_MESSAGE_CAPACITY ECS_MB * 2
+	printf("\nLargest files:\n");
+	for (size_t index = 0; index < merged.top_files.size; index++) {
+		printf("File %.*s has %zu sloc.\n", (int)merged.top_files[index].path.size, merged.top_files[index].path.buffer, merged.top_files[index].code_lines);
+	}
 
-#define MAIN_THREAD_SLEEP_TICK 15
+	if (output_path.size > 0 && !WritePartialResult(output_path, &merged)) {
+		printf("Could not write the partial result %s.\n", output_path.buffer);
+		return 1;
+	}
+	return 0;
+}
 
-using namespace ECSEngine;
+// A range of the files of one thread partition. The per file report is formatted and written in these
+// pieces, such that it is spread over all the threads even when a partition holds most of the files
+struct FileReportChunk {
+	unsigned int thread_index;
+	unsigned int offset;
+	unsigned int size;
+	// The first chunk of a partition has its header, the last one its total
+	bool is_first;
+	bool is_last;
+	CapacityStream<char> text;
+	// Where the text goes in the output file
+	size_t file_offset;
+};
 
-// Returns true if there are any sloc characters
-bool AreSlocCharacters(const char* first, const char* end) {
-	const char* initial_end = end;
+struct FileReportData {
+	const LineCounterResults* results;
+	Stream<FileReportChunk> chunks;
+	// The sloc of each thread partition
+	const size_t* thread_sloc;
+	std::atomic<unsigned int> next_chunk;
+	FILE_HANDLE output_file;
+	std::atomic<bool> write_failed;
+};
 
-	first = function::SkipWhitespace(first);
-	if (first > end) {
-		return false;
+// The counting threads only record the numbers, the text is made here. Each message is sized for its chunk
+// up front, such that nothing is cut and each record is formatted once, in place
+static void FormatFileReportChunk(const LineCounterResults& results, FileReportChunk* chunk, size_t thread_sloc) {
+	// The fixed text of a record with its numbers at their widest
+	const size_t RECORD_RESERVE = 128;
+	const LineCounterFileTable& files = results.files;
+
+	size_t capacity = RECORD_RESERVE * 2;
+	for (unsigned int file_index = chunk->offset; file_index < chunk->offset + chunk->size; file_index++) {
+		capacity += RECORD_RESERVE + files.paths[file_index].size;
+		Stream<FunctionMetrics> functions = files.functions != nullptr ? files.functions[file_index] : Stream<FunctionMetrics>();
+		for (size_t function_index = 0; function_index < functions.size; function_index++) {
+			capacity += RECORD_RESERVE + functions[function_index].name.size;
+		}
 	}
-	Stream<char> line_contents = { first, function::PointerDifference(end, first) };
 
-	while (first < end) {
-		if (function::IsCodeIdentifierCharacter(first[0])) {
-			return true;
+	CapacityStream<char>& message = chunk->text;
+	message = { malloc(capacity), 0, (unsigned int)capacity };
+	if (chunk->is_first) {
+		CORE_FORMAT_STRING(message, "\nThread {#} additional information:\n", chunk->thread_index);
+	}
+	for (unsigned int file_index = chunk->offset; file_index < chunk->offset + chunk->size; file_index++) {
+		if (!files.IsFailed(file_index)) {
+			CORE_FORMAT_STRING(message, "File {#} has {#} sloc.\n", files.paths[file_index], files.code_lines[file_index]);
+
+			Stream<FunctionMetrics> functions = files.functions != nullptr ? files.functions[file_index] : Stream<FunctionMetrics>();
+			for (size_t function_index = 0; function_index < functions.size; function_index++) {
+				const FunctionMetrics* metrics = functions.buffer + function_index;
+				CORE_FORMAT_STRING(message, "\tFunction {#} at line {#} has {#} lines and complexity {#}.\n", metrics->name,
+					metrics->start_line, metrics->line_count, metrics->complexity);
+			}
 		}
-		first++;
 	}
-
-	return false;
+	if (chunk->is_last) {
+		CORE_FORMAT_STRING(message, "Total line count for thread {#}.\n", thread_sloc);
+	}
 }
 
-// Returns -1 if there is a parsing error
-size_t GetSloc(Stream<char> content, CapacityStream<unsigned int> new_line_positions) {
-	// Get the new line count
-	function::FindToken(content, '\n', new_line_positions);
-	ECS_ASSERT(new_line_positions.size < MAX_NEW_LINES_PER_FILE, "Too many lines for a file.");
-
-	size_t sloc_count = new_line_positions.size + 1;
-
-	// For each line, verify its content
-	unsigned int current_character = 0;
-	unsigned int last_line_character_offset = 0;
+CORE_THREAD_TASK(FormatFileReportChunks) {
+	FileReportData* data = (FileReportData*)_data;
+	unsigned int chunk_index = data->next_chunk.fetch_add(1, CORE_RELAXED);
+	while (chunk_index < data->chunks.size) {
+		FileReportChunk* chunk = data->chunks.buffer + chunk_index;
+		FormatFileReportChunk(*data->results, chunk, data->thread_sloc[chunk->thread_index]);
+		chunk_index = data->next_chunk.fetch_add(1, CORE_RELAXED);
+	}
+}
 
-	// Returns true if a parsing error has occured
-	auto verify_line = [&]() {
-		const char* last_line_character = content.buffer + last_line_character_offset;
-		const char* first_char_non_space = function::SkipWhitespace(content.buffer + current_character);
-		// If the first non space character is the same as the end of the line, then skip
-		if (first_char_non_space == last_line_character) {
-			sloc_count--;
-			current_character = last_line_character_offset + 1;
-			return;
+// The offsets don't overlap, the chunks are written concurrently
+CORE_THREAD_TASK(WriteFileReportChunks) {
+	FileReportData* data = (FileReportData*)_data;
+	unsigned int chunk_index = data->next_chunk.fetch_add(1, CORE_RELAXED);
+	while (chunk_index < data->chunks.size) {
+		const FileReportChunk* chunk = data->chunks.buffer + chunk_index;
+		if (!WriteFileAt(data->output_file, chunk->text, chunk->file_offset)) {
+			data->write_failed.store(true, CORE_RELAXED);
 		}
-
-		// Check for non parenthese line
-		bool has_sloc = AreSlocCharacters(first_char_non_space, last_line_character);
-		sloc_count -= !has_sloc;
-		current_character = last_line_character_offset + 1;
-	};
-
-	for (unsigned int index = 0; index < new_line_positions.size; index++) {
-		last_line_character_offset = new_line_positions[index];
-		verify_line();
+		chunk_index = data->next_chunk.fetch_add(1, CORE_RELAXED);
 	}
-
-	last_line_character_offset = content.size;
-	// The last line must be manually verified
-	verify_line();
-
-	return sloc_count;
 }
 
-struct LineCountThreadTaskData {
-	AtomicStream<Stream<wchar_t>>* files;
-	Stream<ThreadPartition> thread_partitions;
-	std::atomic<size_t>* total_line_count;
-	Semaphore* semaphore;
-	// Per thread
-	CapacityStream<char>** error_message;
-	// Per thread
-	CapacityStream<char>** additional_display_message;
-	bool display_per_file_count;
-};
-
-ECS_THREAD_TASK(LineCountThreadTask) {
-	LineCountThreadTaskData* data = (LineCountThreadTaskData*)_data;
-
-	const size_t DEFAULT_BUFFER_SIZE = ECS_MB * 10;
-
-	const unsigned int signal_initialization_finished = -2;
-	unsigned int enter_index = data->semaphore->Exit();
-	if (enter_index == world->task_manager->GetThreadCount() + 1 && data->semaphore->target.load(ECS_RELAXED) != signal_initialization_finished) {
-		// Initialize the partitioning
-		unsigned int partitioning_thread_count = ThreadPartitionStream(data->thread_partitions, data->files->size.load(ECS_RELAXED));
-		// Signal all the other threads that it is done
-		data->semaphore->target.store(signal_initialization_finished, ECS_RELAXED);
-		data->semaphore->Enter(partitioning_thread_count - 1);
-	}
-	else {
-		data->semaphore->SpinWait(-1, signal_initialization_finished);
+// A root can be labeled as label=path, the label being made of letters, digits, '_', '-' and '.'.
+// The root is changed to the path and the label is returned, empty if there is none
+static Stream<char> SplitRootLabel(Stream<char>& root) {
+	for (size_t index = 0; index < root.size; index++) {
+		char character = root[index];
+		if (character == '=' && index > 0) {
+			Stream<char> label = { root.buffer, index };
+			root = function::TrimWhitespace({ root.buffer + index + 1, root.size - index - 1 });
+			return function::TrimWhitespace(label);
+		}
+		if (!function::IsCodeIdentifierCharacter(character) && character != '-' && character != '.' && !function::IsWhitespace(character)) {
+			break;
+		}
 	}
+	return {};
+}
 
-	if (data->thread_partitions[thread_id].size > 0) {
-		// Allocate a default chunk of memory to read the whole file into memory
-		Stream<char> file_buffer;
-		file_buffer.buffer = (char*)malloc(sizeof(char) * DEFAULT_BUFFER_SIZE);
-		file_buffer.size = DEFAULT_BUFFER_SIZE;
-		CapacityStream<unsigned int> file_new_line_positions = { malloc(sizeof(unsigned int) * MAX_NEW_LINES_PER_FILE), 0, MAX_NEW_LINES_PER_FILE };
-
-		ECS_FILE_HANDLE file_handle = 0;
-		unsigned int offset = data->thread_partitions[thread_id].offset;
-
-		ECS_FORMAT_STRING(*data->error_message[thread_id], "\nThread {#} errors:\n", thread_id);
-		size_t errors = 0;
+int main(int argc, char** argv) {
+	Timer timer;
 
-		size_t thread_sloc = 0;
+	Stream<Stream<char>> search_paths;
+	Stream<Stream<char>> root_labels;
 
-		if (data->display_per_file_count) {
-			ECS_FORMAT_STRING(*data->additional_display_message[thread_id], "\nThread {#} additional information:\n", thread_id);
+	bool display_per_file_sloc = true;
+	bool display_functions = false;
+	bool display_includes = false;
+	Stream<Stream<char>> include_directories = { malloc(sizeof(Stream<char>) * argc), 0 };
+	unsigned int shard_index = 0;
+	unsigned int shard_count = 1;
+	bool shard_by_directory = false;
+	bool merge_partial_results = false;
+	unsigned int process_count = 1;
+	Stream<char> partial_path;
+	Stream<char> checkpoint_path;
+	Stream<char> file_list_path;
+	Stream<char> compile_commands_path;
+	Stream<char> ninja_deps_path;
+	Stream<char> tree_snapshot_path;
+	bool resolve_headers = false;
+	bool resume = false;
+
+	// The arguments that start with -- are options, the rest are search paths
+	search_paths = { malloc(sizeof(Stream<char>) * argc), 0 };
+	root_labels = { malloc(sizeof(Stream<char>) * argc), 0 };
+	for (int index = 1; index < argc; index++) {
+		Stream<char> argument = argv[index];
+		if (argument == "--functions") {
+			display_functions = true;
 		}
-
-		for (unsigned int index = 0; index < data->thread_partitions[thread_id].size; index++) {
-			Stream<wchar_t> current_path = data->files->buffer[offset + index];
-			ECS_FILE_STATUS_FLAGS file_status = OpenFile(current_path, &file_handle, ECS_FILE_ACCESS_READ_ONLY | ECS_FILE_ACCESS_OPTIMIZE_SEQUENTIAL
-				| ECS_FILE_ACCESS_TEXT, data->error_message[thread_id]);
-			// If the opening succeded, try to read the whole file into a memory buffer
-			if (file_status == ECS_FILE_STATUS_OK) {
-				file_buffer.size = DEFAULT_BUFFER_SIZE;
-				unsigned int bytes_read = ReadFromFile(file_handle, file_buffer);
-				if (bytes_read == -1) {
-					ECS_FORMAT_TEMP_STRING(temp_message, "Reading from {#} failed.\n", current_path);
-					data->error_message[thread_id]->AddStreamSafe(temp_message);
-					errors++;
-				}
-				else {
-					file_buffer[bytes_read] = '\0';
-					file_buffer.size = bytes_read;
-
-					// Remove single and multi line comments
-					file_buffer = function::RemoveSingleLineComment(file_buffer, ECS_C_FILE_SINGLE_LINE_COMMENT_TOKEN);
-					file_buffer = function::RemoveMultiLineComments(file_buffer, ECS_C_FILE_MULTI_LINE_COMMENT_OPENED_TOKEN, ECS_C_FILE_MULTI_LINE_COMMENT_CLOSED_TOKEN);
-
-					size_t sloc = GetSloc(file_buffer, file_new_line_positions);
-					if (sloc == -1) {
-						ECS_FORMAT_TEMP_STRING(temp_message, "Parsing {#} failed. Possible problems: invalid multi-line comments.\n", current_path);
-						data->error_message[thread_id]->AddStreamSafe(temp_message);
-					}
-					else {
-						thread_sloc += sloc;
-						if (data->display_per_file_count) {
-							ECS_FORMAT_TEMP_STRING(temp_message, "File {#} has {#} sloc.\n", current_path, sloc);
-							data->additional_display_message[thread_id]->AddStreamSafe(temp_message);
-						}
-					}
-				}
-
-				// Close the file
-				CloseFile(file_handle);
+		else if (argument == "--includes") {
+			display_includes = true;
+		}
+		else if (argument.size > 14 && memcmp(argument.buffer, "--include-dir=", 14) == 0) {
+			// An include directory implies the include report
+			display_includes = true;
+			include_directories[include_directories.size++] = { argument.buffer + 14, argument.size - 14 };
+		}
+		else if (argument.size > 8 && memcmp(argument.buffer, "--shard=", 8) == 0) {
+			if (sscanf(argument.buffer + 8, "%u/%u", &shard_index, &shard_count) != 2 || shard_count == 0 || shard_index >= shard_count) {
+				printf("The shard must be given as index/count, with the index smaller than the count.\n");
+				exit(1);
 			}
-			else {
-				data->error_message[thread_id]->AddSafe('\n');
-				errors++;
+		}
+		else if (argument == "--shard-by-directory") {
+			shard_by_directory = true;
+		}
+		else if (argument.size > 10 && memcmp(argument.buffer, "--partial=", 10) == 0) {
+			partial_path = { argument.buffer + 10, argument.size - 10 };
+		}
+		else if (argument.size > 12 && memcmp(argument.buffer, "--processes=", 12) == 0) {
+			process_count = (unsigned int)atoi(argument.buffer + 12);
+			if (process_count == 0) {
+				printf("The process count must be at least 1.\n");
+				exit(1);
 			}
 		}
-	
-		if (errors == 0) {
-			data->error_message[thread_id]->size = 0;
+		else if (argument.size > 13 && memcmp(argument.buffer, "--checkpoint=", 13) == 0) {
+			checkpoint_path = { argument.buffer + 13, argument.size - 13 };
 		}
-
-		if (data->display_per_file_count) {
-			ECS_FORMAT_STRING(*data->additional_display_message[thread_id], "Total line count for thread {#}.\n", thread_sloc);
+		else if (argument.size > 8 && memcmp(argument.buffer, "--files=", 8) == 0) {
+			file_list_path = { argument.buffer + 8, argument.size - 8 };
 		}
+		else if (argument.size > 19 && memcmp(argument.buffer, "--compile-commands=", 19) == 0) {
+			compile_commands_path = { argument.buffer + 19, argument.size - 19 };
+		}
+		else if (argument.size > 13 && memcmp(argument.buffer, "--ninja-deps=", 13) == 0) {
+			ninja_deps_path = { argument.buffer + 13, argument.size - 13 };
+		}
+		else if (argument.size > 16 && memcmp(argument.buffer, "--tree-snapshot=", 16) == 0) {
+			tree_snapshot_path = { argument.buffer + 16, argument.size - 16 };
+		}
+		else if (argument == "--resolve-headers") {
+			resolve_headers = true;
+		}
+		else if (argument == "--resume") {
+			resume = true;
+		}
+		else if (argument == "--summary") {
+			display_per_file_sloc = false;
+		}
+		else if (argument == "--merge") {
+			merge_partial_results = true;
+		}
+		else if (argument.size >= 2 && argument[0] == '-' && argument[1] == '-') {
+			printf("Unknown option %s.\n", argv[index]);
+			exit(1);
+		}
+		else {
+			root_labels[search_paths.size] = SplitRootLabel(argument);
+			search_paths[search_paths.size++] = argument;
+			root_labels.size = search_paths.size;
+		}
+	}
 
-		free(file_buffer.buffer);
-		free(file_new_line_positions.buffer);
-
-		// Erroneous files will be excluded from the thread_sloc
-		data->total_line_count->fetch_add(thread_sloc, ECS_RELAXED);
-		data->semaphore->Exit();
+	if (process_count > 1 && (display_functions || display_includes)) {
+		printf("The function metrics and the include report are not available with multiple processes.\n");
+		exit(1);
+	}
+	if (process_count > 1 && checkpoint_path.size > 0) {
+		printf("The checkpoint is not available with multiple processes.\n");
+		exit(1);
+	}
+	unsigned int listed_file_source_count = (file_list_path.size > 0) + (compile_commands_path.size > 0) + (ninja_deps_path.size > 0);
+	if (listed_file_source_count > 0 && (search_paths.size > 0 || process_count > 1 || checkpoint_path.size > 0)) {
+		printf("A file list, a compilation database or a Ninja deps log is counted as it is, without search paths, worker processes or a checkpoint.\n");
+		exit(1);
+	}
+	if (listed_file_source_count > 0 && tree_snapshot_path.size > 0) {
+		printf("The tree snapshot keeps the directories of the search paths, a listed set of files has none.\n");
+		exit(1);
+	}
+	if (listed_file_source_count > 1) {
+		printf("Only one of the file list, the compilation database and the Ninja deps log can be given.\n");
+		exit(1);
+	}
+	if (resolve_headers && compile_commands_path.size == 0) {
+		printf("The headers are resolved from the compilation database, given with --compile-commands=<path>.\n");
+		exit(1);
+	}
+	if (resume && checkpoint_path.size == 0) {
+		printf("Resuming needs the checkpoint path, given with --checkpoint=<path>.\n");
+		exit(1);
 	}
 
-	ExitThread(0);
-}
+	// In merge mode the arguments are the partial result files
+	if (merge_partial_results) {
+		return MergePartialResults(search_paths, partial_path);
+	}
 
-struct ListAllFilesInsidePathsData {
-	AtomicStream<Stream<wchar_t>>* source_files;
-	Stream<Stream<wchar_t>> search_paths;
-	Stream<ThreadPartition> thread_partitions;
-	Semaphore* semaphore;
-};
+	// The path lists are split by the threads of the counter. The supervisor of the worker processes must fork
+	// from a single threaded process, so it gets a pool of its own which is gone before the count
+	MultiProcessCounter* process_counter = nullptr;
+	LineCounter* line_counter = nullptr;
+	ThreadPool* list_pool = nullptr;
+	if (process_count > 1) {
+		process_counter = new MultiProcessCounter(process_count);
+		list_pool = new ThreadPool();
+	}
+	else {
+		line_counter = new LineCounter();
+		list_pool = &line_counter->thread_pool;
+	}
 
-ECS_THREAD_TASK(ListAllFilesInsidePaths) {
-	ListAllFilesInsidePathsData* data = (ListAllFilesInsidePathsData*)_data;
-
-	if (data->thread_partitions[thread_id].size > 0) {
-		Stream<wchar_t> valid_extensions[] = {
-			L".cpp",
-			L".c",
-			L".hpp",
-			L".h"
-		};
-		
-		struct FunctorData {
-			ListAllFilesInsidePathsData* data;
-			TaskManager* task_manager;
-			unsigned int thread_id;
-		};
-
-		FunctorData functor_data = { data, world->task_manager, thread_id };
-
-		for (size_t index = 0; index < data->thread_partitions[thread_id].size; index++) {
-			ForEachFileInDirectoryRecursiveWithExtension(
-				data->search_paths[data->thread_partitions[thread_id].offset + index],
-				{ valid_extensions, std::size(valid_extensions) },
-				&functor_data,
-				[](Stream<wchar_t> path, void* _data) {
-					FunctorData* data = (FunctorData*)_data;
-					unsigned int position = data->data->source_files->RequestInt(1);
-					data->data->source_files->buffer[position] = function::StringCopy(data->task_manager->GetThreadTempAllocator(data->thread_id), path);
-					
-					data->data->source_files->FinishRequest(1);
-
-					return true;
-				}
-			);
+	// The lists stay mapped until the end, the paths point into them
+	PathList file_list;
+	PathList search_path_list;
+	CompileCommands compile_commands;
+	NinjaDeps ninja_deps;
+	if (ninja_deps_path.size > 0) {
+		CORE_STACK_CAPACITY_STREAM(char, error_message, 1024);
+		if (!ninja_deps.Load(ninja_deps_path, &error_message)) {
+			printf("%.*s", (int)error_message.size, error_message.buffer);
+			exit(1);
+		}
+		if (ninja_deps.is_truncated) {
+			printf("The Ninja deps log %s ends with a damaged record, the records before it are used.\n", ninja_deps_path.buffer);
 		}
 	}
-	data->semaphore->Exit();
-	data->semaphore->target.fetch_add(1, ECS_RELAXED);
-	// We could use a tick wait, but a spin wait will provide the best results, plus this shouldn't take a lot of time
-	SpinWait<'<'>(data->semaphore->target, world->task_manager->GetThreadCount());
-}
-
-int main(int argc, char** argv) {
-	Timer timer;
-	const size_t MAIN_THREAD_TICK_WAIT = 10;
-
-	unsigned int thread_count = std::thread::hardware_concurrency();
-
-	unsigned int search_paths_count = 0;
-	Stream<Stream<wchar_t>> search_paths;
-	GlobalMemoryManager global_memory(ECS_MB * thread_count + ECS_MB * 16, 1024, ECS_MB);
-
-	bool display_per_file_sloc = true;
-
-	// No command line arguments
-	if (argc == 1) {
-		// Use just the search path file
-		Stream<char> file_content = ReadWholeFileText(SEARCH_PATH_FILE);
-		if (file_content.buffer == nullptr) {
+	else if (compile_commands_path.size > 0) {
+		CORE_STACK_CAPACITY_STREAM(char, error_message, 1024);
+		if (!compile_commands.Load(compile_commands_path, &error_message)) {
+			printf("%.*s", (int)error_message.size, error_message.buffer);
+			exit(1);
+		}
+		printf("The compilation database lists %u translation units.\n", compile_commands.translation_unit_count);
+		if (resolve_headers) {
+			compile_commands.ResolveIncludes(*list_pool);
+			printf("They include %u files, %zu includes name no file that was found.\n",
+				compile_commands.files.size - compile_commands.translation_unit_count, compile_commands.unresolved_count);
+		}
+	}
+	else if (file_list_path.size > 0) {
+		if (!file_list.Load(file_list_path, *list_pool)) {
+			printf("Could not open the file list %s.\n", file_list_path.buffer);
+			exit(1);
+		}
+	}
+	else if (search_paths.size == 0) {
+		// No search paths on the command line, use just the search path file
+		if (!search_path_list.Load(SEARCH_PATH_FILE, *list_pool)) {
 			printf("Could not open search file.\n");
 			exit(1);
 		}
 
-		// Read each relative path
-		ECS_STACK_CAPACITY_STREAM(unsigned int, new_line_positions, 1024);
-		function::FindToken(file_content.buffer, '\n', new_line_positions);
-
-		search_paths_count = new_line_positions.size;
-		search_paths = { global_memory.Allocate(sizeof(Stream<wchar_t>) * search_paths_count), 0 };
-
-		size_t starting_position = 0;
-		for (size_t index = 0; index < search_paths_count; index++) {
-			const char* whitespace = function::SkipWhitespace(file_content.buffer + starting_position + 1);
-			if (whitespace == file_content.buffer + new_line_positions[index]) {
-				starting_position = new_line_positions[index] + 1;
+		free(search_paths.buffer);
+		free(root_labels.buffer);
+		search_paths = { malloc(sizeof(Stream<char>) * std::max(search_path_list.paths.size, (size_t)1)), 0 };
+		root_labels = { malloc(sizeof(Stream<char>) * std::max(search_path_list.paths.size, (size_t)1)), 0 };
+		for (size_t index = 0; index < search_path_list.paths.size; index++) {
+			// The end of the path doesn't move, it stays null terminated
+			Stream<char> line = search_path_list.paths[index];
+			Stream<char> label = SplitRootLabel(line);
+			if (line.size == 0) {
 				continue;
 			}
-
-			// Make the new line '\0' and the transform into wchar_t
-			file_content[new_line_positions[index]] = '\0';
-
-			size_t character_count = new_line_positions[index] - starting_position + 1;
-			void* allocation = global_memory.Allocate(sizeof(wchar_t) * character_count);
-			CapacityStream<wchar_t> temp_stream(allocation, 0, character_count);
-
-			function::ConvertASCIIToWide(temp_stream, { file_content.buffer + starting_position, (unsigned int)character_count, (unsigned int)character_count });
-			search_paths.Add({ allocation, character_count });
-			starting_position = new_line_positions[index] + 1;
+			root_labels[search_paths.size] = label;
+			search_paths[search_paths.size++] = line;
+			root_labels.size = search_paths.size;
 		}
 	}
-	else {
-		// Use the command line arguments
+	if (line_counter == nullptr) {
+		delete list_pool;
 	}
 
-	// Spawn a task manager
-	TaskManager task_manager(thread_count, &global_memory, ECS_MB, 100);
+	LineCounterOptions options;
+	// Without the per file report the workers don't fill the file table, unless another report reads it
+	options.record_per_file_results = display_per_file_sloc || display_functions || partial_path.size > 0 || ninja_deps_path.size > 0;
+	options.record_functions = display_functions;
+	options.record_includes = display_includes;
+	options.include_directories = include_directories;
+	options.shard_index = shard_index;
+	options.shard_count = shard_count;
+	options.shard_by_directory = shard_by_directory;
+	options.root_labels = root_labels;
+	options.checkpoint_path = checkpoint_path;
+	options.resume = resume;
+	options.tree_snapshot_path = tree_snapshot_path;
+
+	// The counter owns the memory of the results, it stays alive until the end
+	LineCounterResults results;
+	if (process_counter != nullptr) {
+		results = process_counter->Count(search_paths, options);
+	}
+	else if (file_list_path.size > 0) {
+		results = line_counter->CountFiles(file_list.paths, options);
+	}
+	else if (compile_commands_path.size > 0) {
+		results = line_counter->CountFiles(compile_commands.files, options);
+	}
+	else if (ninja_deps_path.size > 0) {
+		results = line_counter->CountFiles(ninja_deps.files, options);
+	}
+	else {
+		results = line_counter->Count(search_paths, options);
+	}
 
-	void* total_file_allocation = global_memory.Allocate(sizeof(Stream<wchar_t>) * MAX_FILES);
-	AtomicStream<Stream<wchar_t>> source_files = AtomicStream<Stream<wchar_t>>(total_file_allocation, 0, MAX_FILES);;
+	unsigned int thread_count = (unsigned int)results.thread_partitions.size;
+	size_t function_count = 0;
+	size_t function_lines = 0;
+	size_t function_complexity = 0;
+	const FunctionMetrics* most_complex = nullptr;
+	if (display_functions) {
+		for (size_t index = 0; index < results.files.size; index++) {
+			for (size_t subindex = 0; subindex < results.files.functions[index].size; subindex++) {
+				const FunctionMetrics* metrics = results.files.functions[index].buffer + subindex;
+				function_count++;
+				function_lines += metrics->line_count;
+				function_complexity += metrics->complexity;
+				if (most_complex == nullptr || metrics->complexity > most_complex->complexity) {
+					most_complex = metrics;
+				}
+			}
+		}
+	}
 
-	Semaphore semaphore_barrier;
+	// The fixed lines fit in the reserve, the name of the most complex function is the only unbounded part
+	const size_t LINE_MESSAGE_RESERVE = 2048;
+	size_t line_message_capacity = LINE_MESSAGE_RESERVE + (most_complex != nullptr ? most_complex->name.size : 0);
+	CapacityStream<char> line_message = { malloc(line_message_capacity), 0, (unsigned int)line_message_capacity };
 
-	ListAllFilesInsidePathsData list_data;
-	list_data.source_files = &source_files;
-	list_data.thread_partitions = { global_memory.Allocate(sizeof(uint2) * thread_count), thread_count };
-	list_data.search_paths = search_paths;
-	list_data.semaphore = &semaphore_barrier;
+	size_t microseconds_needed = timer.GetDurationSinceMarker(TIMER_DURATION_US);
+	size_t milliseconds_needed = microseconds_needed / 1000;
+	size_t seconds_needed = milliseconds_needed / 1000;
+	CORE_FORMAT_STRING(line_message, "There are {#} lines.\nComment lines: {#}, blank lines: {#}, total lines: {#}.\nLogical lines: {#}.\nTokens: {#}, code bytes: {#}.\nExecution time: {#} us - {#} ms - {#} s\n",
+		results.totals.code_lines, results.totals.comment_lines, results.totals.blank_lines, results.totals.total_lines, results.totals.logical_lines,
+		results.totals.token_count, results.totals.code_bytes,
+		microseconds_needed, milliseconds_needed, seconds_needed);
+	if (results.repeated_directory_count > 0) {
+		CORE_FORMAT_STRING(line_message, "Directories reached again through a symlink or an overlapping root, skipped: {#}.\n", results.repeated_directory_count);
+	}
+	if (checkpoint_path.size > 0) {
+		CORE_FORMAT_STRING(line_message, "Files resumed from the checkpoint: {#}.\n", results.resumed_file_count);
+	}
+	if (tree_snapshot_path.size > 0) {
+		CORE_FORMAT_STRING(line_message, "Directories listed from the tree snapshot: {#}, read: {#}, unchanged subtrees: {#}.\n",
+			results.snapshot_reused_directory_count, results.snapshot_read_directory_count, results.snapshot_unchanged_subtree_count);
+	}
+	if (process_counter != nullptr) {
+		CORE_FORMAT_STRING(line_message, "Worker processes: {#}, restarted after a crash: {#}, files that crashed a worker: {#}.\n",
+			process_counter->process_count, process_counter->restart_count, process_counter->crashed_files.size);
+	}
 
-	ThreadPartitionStream(list_data.thread_partitions, search_paths_count);
-	semaphore_barrier.Enter(thread_count * 2 + 1);
-	semaphore_barrier.ClearTarget();
+	if (function_count > 0) {
+		CORE_FORMAT_STRING(line_message, "Functions: {#}, average length: {#}, average complexity: {#}, highest complexity: {#} in {#}.\n",
+			function_count, (double)function_lines / function_count, (double)function_complexity / function_count,
+			most_complex->complexity, most_complex->name);
+	}
+	printf("%.*s", (int)line_message.size, line_message.buffer);
 
-	// Add the search tasks and then the count tasks
-	ThreadTask list_task = ECS_THREAD_TASK_NAME(ListAllFilesInsidePaths, &list_data, sizeof(list_data));
+	if (partial_path.size > 0) {
+		PartialResult partial;
+		MakePartialResult(results, &partial);
+		if (!WritePartialResult(partial_path, &partial)) {
+			printf("Could not write the partial result %s.\n", partial_path.buffer);
+		}
+	}
 
-	const size_t COUNT_ERROR_MESSAGE_CAPACITY = ECS_KB * 16;
-	const size_t ADDITIONAL_MESSAGE_ALLOCATION_CAPACITY = ECS_KB * 64;
+	// The per root totals, only when there is more than one root
+	const size_t ROOT_MESSAGE_ENTRY_RESERVE = 256;
+	size_t root_message_capacity = ROOT_MESSAGE_ENTRY_RESERVE * (results.roots.size + 1);
+	for (size_t index = 0; index < results.roots.size; index++) {
+		root_message_capacity += results.roots[index].label.size + results.roots[index].path.size;
+	}
+	CapacityStream<char> root_message = { malloc(root_message_capacity), 0, (unsigned int)root_message_capacity };
+	if (results.roots.size > 1) {
+		root_message.AddStreamSafe("\nRoots:\n");
+		for (size_t index = 0; index < results.roots.size; index++) {
+			const LineCounterRootResult* root = results.roots.buffer + index;
+			CORE_FORMAT_STRING(root_message, "Root {#} ({#}) has {#} lines in {#} files, {#} errors. Comment lines: {#}, blank lines: {#}.\n",
+				root->label, root->path, root->totals.code_lines, root->file_count, root->error_count, root->totals.comment_lines, root->totals.blank_lines);
+		}
+		printf("%.*s", (int)root_message.size, root_message.buffer);
+	}
 
-	// Allocate the capacity streams separately in order to avoid false sharing
-	void* message_allocation = ECS_STACK_ALLOC(ECS_CACHE_LINE_SIZE * thread_count * 2 + ECS_CACHE_LINE_SIZE);
-	message_allocation = function::AlignPointer(message_allocation, ECS_CACHE_LINE_SIZE);
-	ECS_STACK_CAPACITY_STREAM_DYNAMIC(CapacityStream<char>*, per_thread_error_message, thread_count);
-	ECS_STACK_CAPACITY_STREAM_DYNAMIC(CapacityStream<char>*, per_thread_additional_message, thread_count);
+	// The headers that cost the most, by the lines that all the translation units parse because of them
+	const size_t INCLUDE_MESSAGE_CAPACITY = CORE_KB * 16;
+	CapacityStream<char> include_message = { malloc(INCLUDE_MESSAGE_CAPACITY), 0, INCLUDE_MESSAGE_CAPACITY };
+	if (display_includes) {
+		CORE_FORMAT_STRING(include_message, "\nIncludes: {#}, unresolved: {#}, included headers: {#}.\n", results.includes.include_count,
+			results.includes.unresolved_count, results.includes.headers.size);
+		size_t header_count = results.includes.headers.size < INCLUDE_REPORT_HEADER_COUNT ? results.includes.headers.size : INCLUDE_REPORT_HEADER_COUNT;
+		for (size_t index = 0; index < header_count; index++) {
+			const IncludeGraphHeader* header = results.includes.headers.buffer + index;
+			CORE_FORMAT_TEMP_STRING(header_message, "Header {#} has {#} sloc, {#} direct includers and {#} translation units, cost {#}.\n",
+				header->path, header->code_lines, header->direct_fan_in, header->transitive_fan_in, header->cost);
+			include_message.AddStreamSafe(header_message);
+		}
+		printf("%.*s", (int)include_message.size, include_message.buffer);
+	}
 
-	for (unsigned int index = 0; index < thread_count; index++) {
-		per_thread_error_message[index] = (CapacityStream<char>*)message_allocation;
-		message_allocation = function::OffsetPointer(message_allocation, ECS_CACHE_LINE_SIZE);
-		*per_thread_error_message[index] = { task_manager.AllocateTempBuffer(index, COUNT_ERROR_MESSAGE_CAPACITY), 0, COUNT_ERROR_MESSAGE_CAPACITY };
+	// The lines that each target compiles, its translation units and their headers, each file once per target
+	if (ninja_deps_path.size > 0) {
+		ninja_deps.ComputeTargets(line_counter->thread_pool, results.files.code_lines);
+	}
+	size_t target_message_capacity = ROOT_MESSAGE_ENTRY_RESERVE * (ninja_deps.targets.size + 1);
+	for (size_t index = 0; index < ninja_deps.targets.size; index++) {
+		target_message_capacity += ninja_deps.targets[index].name.size;
+	}
+	CapacityStream<char> target_message = { malloc(target_message_capacity), 0, (unsigned int)target_message_capacity };
+	if (ninja_deps_path.size > 0) {
+		CORE_FORMAT_STRING(target_message, "\nTargets: {#}, outputs with dependencies: {#}, dependency records: {#}, dependency files: {#}.\n",
+			ninja_deps.targets.size, ninja_deps.output_count, ninja_deps.record_count, ninja_deps.files.size);
+		for (size_t index = 0; index < ninja_deps.targets.size; index++) {
+			const NinjaDepsTarget* target = ninja_deps.targets.buffer + index;
+			CORE_FORMAT_STRING(target_message, "Target {#} compiles {#} sloc in {#} files from {#} outputs.\n",
+				target->name, target->code_lines, target->file_count, target->output_count);
+		}
+		printf("%.*s", (int)target_message.size, target_message.buffer);
+	}
 
-		per_thread_additional_message[index] = (CapacityStream<char>*)message_allocation;
-		message_allocation = function::OffsetPointer(message_allocation, ECS_CACHE_LINE_SIZE);
-		if (display_per_file_sloc) {
-			*per_thread_additional_message[index] = { task_manager.AllocateTempBuffer(index, ADDITIONAL_MESSAGE_ALLOCATION_CAPACITY), 0, ADDITIONAL_MESSAGE_ALLOCATION_CAPACITY };
+	// The error table is bounded, so is this message. Each entry needs its path and a short description
+	const size_t ERROR_MESSAGE_ENTRY_RESERVE = 256;
+	size_t error_message_capacity = ERROR_MESSAGE_ENTRY_RESERVE * (results.errors.size + 1);
+	for (size_t index = 0; index < results.errors.size; index++) {
+		error_message_capacity += results.errors[index].path.size;
+	}
+	CapacityStream<char> error_message = { malloc(error_message_capacity), 0, (unsigned int)error_message_capacity };
+	if (results.errors.size > 0) {
+		CORE_FORMAT_STRING(error_message, "\nErrors: {#} files could not be counted, {#} files are not valid UTF-8.\n", results.error_count,
+			results.error_kind_counts[LINE_COUNTER_FILE_ERROR_INVALID_ENCODING]);
+		for (size_t index = 0; index < results.errors.size; index++) {
+			const LineCounterFileError* error = results.errors.buffer + index;
+			CORE_FORMAT_STRING(error_message, "File {#} {#}", error->path, GetFileErrorDescription(error->error));
+			if (error->system_error != 0) {
+				CORE_FORMAT_STRING(error_message, ": {#}", strerror(error->system_error));
+			}
+			error_message.AddSafe('\n');
 		}
-		else {
-			*per_thread_additional_message[index] = { nullptr, 0, 0 };
+		if (results.dropped_error_count > 0) {
+			CORE_FORMAT_STRING(error_message, "{#} more errors are not listed.\n", results.dropped_error_count);
 		}
+		printf("%.*s", (int)error_message.size, error_message.buffer);
 	}
 
-	std::atomic<size_t> total_line_count = 0;
-
-	LineCountThreadTaskData count_data;
-	count_data.files = &source_files;
-	count_data.thread_partitions = { malloc(sizeof(uint2) * thread_count), thread_count };
-	count_data.total_line_count = &total_line_count;
-	count_data.semaphore = &semaphore_barrier;
-	count_data.error_message = per_thread_error_message.buffer;
-	count_data.additional_display_message = per_thread_additional_message.buffer;
-	count_data.display_per_file_count = display_per_file_sloc;
-
-	ThreadTask count_task = ECS_THREAD_TASK_NAME(LineCountThreadTask, &count_data, sizeof(count_data));
-	World world;
-	world.task_manager = &task_manager;
-
-	task_manager.SetWorld(&world);
-
-	task_manager.AddDynamicTaskGroup(list_task.function, list_task.name.buffer, &list_data, thread_count, sizeof(list_data));
-	task_manager.AddDynamicTaskGroup(count_task.function, count_task.name.buffer, &count_data, thread_count, sizeof(count_data));
-
-	task_manager.CreateThreads();
-
-	// use a small tick wait for the signaling of the worked that has finished
-	count_data.semaphore->TickWait(MAIN_THREAD_SLEEP_TICK, 0);
-	ECS_STACK_CAPACITY_STREAM(char, line_message, 512);
-
-	size_t microseconds_needed = timer.GetDurationSinceMarker(ECS_TIMER_DURATION_US);
-	size_t milliseconds_needed = microseconds_needed / 1000;
-	size_t seconds_needed = milliseconds_needed / 1000;
-	ECS_FORMAT_STRING(line_message, "There are {#} lines.\nExecution time: {#} us - {#} ms - {#} s\n", count_data.total_line_count->load(ECS_RELAXED),
-		microseconds_needed, milliseconds_needed, seconds_needed);
-	printf("%s", line_message.buffer);
+	// The per file information grouped by the thread that counted it, formatted only when it is displayed. The
+	// partitions are cut into chunks which are formatted in parallel by the counter threads
+	FileReportData report_data;
+	report_data.results = &results;
+	report_data.chunks = { nullptr, 0 };
+	size_t* thread_sloc = (size_t*)calloc(std::max(thread_count, 1u), sizeof(size_t));
+	report_data.thread_sloc = thread_sloc;
+	if (display_per_file_sloc) {
+		size_t chunk_capacity = thread_count;
+		for (unsigned int index = 0; index < thread_count; index++) {
+			chunk_capacity += results.thread_partitions[index].size / REPORT_CHUNK_FILE_COUNT;
+		}
+		report_data.chunks = { malloc(sizeof(FileReportChunk) * std::max(chunk_capacity, (size_t)1)), 0 };
+		for (unsigned int index = 0; index < thread_count; index++) {
+			ThreadPartition partition = results.thread_partitions[index];
+			for (unsigned int file_index = partition.offset; file_index < partition.offset + partition.size; file_index++) {
+				thread_sloc[index] += results.files.code_lines[file_index];
+			}
+			for (unsigned int offset = 0; offset < partition.size; offset += REPORT_CHUNK_FILE_COUNT) {
+				unsigned int size = std::min(partition.size - offset, (unsigned int)REPORT_CHUNK_FILE_COUNT);
+				report_data.chunks[report_data.chunks.size++] = { index, partition.offset + offset, size, offset == 0, offset + size == partition.size, {}, 0 };
+			}
+		}
 
-	for (unsigned int index = 0; index < thread_count; index++) {
-		if (per_thread_error_message[index]->size > 0) {
-			per_thread_error_message[index]->buffer[per_thread_error_message[index]->size] = '\0';
-			printf("%s\n\n", per_thread_error_message[index]->buffer);
+		ThreadPool* report_pool = line_counter != nullptr ? &line_counter->thread_pool : new ThreadPool();
+		report_data.next_chunk.store(0, CORE_RELAXED);
+		report_pool->Run(FormatFileReportChunks, &report_data);
+		if (line_counter == nullptr) {
+			delete report_pool;
 		}
 
-		if (per_thread_additional_message[index]->size > 0) {
-			per_thread_additional_message[index]->buffer[per_thread_additional_message[index]->size] = '\0';
-			printf("%s\n\n", per_thread_additional_message[index]->buffer);
+		for (size_t index = 0; index < report_data.chunks.size; index++) {
+			const FileReportChunk* chunk = report_data.chunks.buffer + index;
+			fwrite(chunk->text.buffer, 1, chunk->text.size, stdout);
+			if (chunk->is_last) {
+				printf("\n\n");
+			}
 		}
 	}
 
-	ECS_FILE_HANDLE output_file = 0;
-	ECS_FILE_STATUS_FLAGS output_status = FileCreate(OUTPUT_FILE, &output_file, ECS_FILE_ACCESS_WRITE_ONLY | ECS_FILE_ACCESS_TRUNCATE_FILE | ECS_FILE_ACCESS_TEXT);
-	if (output_status != ECS_FILE_STATUS_OK) {
+	FILE_HANDLE output_file = 0;
+	FILE_STATUS_FLAGS output_status = FileCreate(OUTPUT_FILE, &output_file, FILE_ACCESS_WRITE_ONLY | FILE_ACCESS_TRUNCATE_FILE);
+	if (output_status != FILE_STATUS_OK) {
 		printf("Could not create output file.");
 	}
 	else {
 		if (!WriteFile(output_file, line_message)) {
 			printf("Writing into output file line message failed.\n");
 		}
+		if (!WriteFile(output_file, root_message)) {
+			printf("Writing into output file root message failed.\n");
+		}
+		if (!WriteFile(output_file, include_message)) {
+			printf("Writing into output file include message failed.\n");
+		}
+		if (!WriteFile(output_file, target_message)) {
+			printf("Writing into output file target message failed.\n");
+		}
+		if (!WriteFile(output_file, error_message)) {
+			printf("Writing into output file error message failed.\n");
+		}
 
-		for (unsigned int index = 0; index < thread_count; index++) {
-			if (per_thread_error_message[index]->size > 0) {
-				if (!WriteFile(output_file, *per_thread_error_message[index])) {
-					printf("Writing into output file error message failed.\n");
-				}
+		// The chunks follow the summary messages. With their offsets known, each one is written in place
+		size_t file_offset = line_message.size + root_message.size + include_message.size + target_message.size + error_message.size;
+		for (size_t index = 0; index < report_data.chunks.size; index++) {
+			report_data.chunks[index].file_offset = file_offset;
+			file_offset += report_data.chunks[index].text.size;
+		}
+		if (report_data.chunks.size > 0) {
+			report_data.output_file = output_file;
+			report_data.write_failed.store(!ResizeFile(output_file, file_offset), CORE_RELAXED);
+			report_data.next_chunk.store(0, CORE_RELAXED);
+			ThreadPool* report_pool = line_counter != nullptr ? &line_counter->thread_pool : new ThreadPool();
+			report_pool->Run(WriteFileReportChunks, &report_data);
+			if (line_counter == nullptr) {
+				delete report_pool;
 			}
-
-			if (per_thread_additional_message[index]->size > 0) {
-				if (!WriteFile(output_file, { *per_thread_additional_message[index] })) {
-					printf("Writing into output file additional thread messages failed.\n");
-				}
+			if (report_data.write_failed.load(CORE_RELAXED)) {
+				printf("Writing into output file additional thread messages failed.\n");
 			}
 		}
 
@@ -406,4 +617,4 @@ int main(int argc, char** argv) {
 	}
 
 	return 0;
-}
\ No newline at end of file
+}
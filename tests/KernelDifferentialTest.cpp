@@ -0,0 +1,228 @@
+// Runs every counting kernel variant that the host supports against the scalar reference lexer, which is
+// compiled into this test on its own. The inputs are placed at every offset of a 64 byte block, such that the
+// strings, escapes and comments cross the block boundaries, and each one is tried with CRLF line endings and
+// without the final new line as well
+#include "Kernel/CountingKernel.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace CountingKernelScalar {
+	bool CountFile(Core::Stream<char> content, FileCounts* counts, Core::CapacityStream<FunctionMetrics>* functions);
+}
+
+#define KERNEL_TEST_MAX_FUNCTIONS 1024
+#define KERNEL_TEST_RANDOM_CASES 4000
+
+using namespace Core;
+
+struct KernelRun {
+	FileCounts counts;
+	bool has_special_bytes;
+	std::vector<FunctionMetrics> functions;
+};
+
+struct KernelTest {
+	const CountingKernel* kernels[COUNTING_KERNEL_TARGET_COUNT];
+	unsigned int kernel_count;
+	size_t case_count;
+	size_t failure_count;
+};
+
+// ------------------------------------------------------------------------------------------------------------
+
+static KernelRun RunKernel(CountFileFunction count_file, const std::string& content, bool record_functions) {
+	KernelRun run;
+	FunctionMetrics function_buffer[KERNEL_TEST_MAX_FUNCTIONS];
+	CapacityStream<FunctionMetrics> functions = { function_buffer, 0, KERNEL_TEST_MAX_FUNCTIONS };
+	// The string keeps the null terminator that the kernels expect after the content
+	Stream<char> text = { (char*)content.data(), content.size() };
+	run.has_special_bytes = count_file(text, &run.counts, record_functions ? &functions : nullptr);
+	run.functions.assign(functions.buffer, functions.buffer + functions.size);
+	return run;
+}
+
+static bool AreCountsEqual(const FileCounts& first, const FileCounts& second) {
+	return first.code_lines == second.code_lines && first.comment_lines == second.comment_lines && first.blank_lines == second.blank_lines
+		&& first.total_lines == second.total_lines && first.logical_lines == second.logical_lines && first.token_count == second.token_count
+		&& first.code_bytes == second.code_bytes;
+}
+
+static bool AreRunsEqual(const KernelRun& first, const KernelRun& second) {
+	if (!AreCountsEqual(first.counts, second.counts) || first.has_special_bytes != second.has_special_bytes
+		|| first.functions.size() != second.functions.size()) {
+		return false;
+	}
+	for (size_t index = 0; index < first.functions.size(); index++) {
+		const FunctionMetrics& first_function = first.functions[index];
+		const FunctionMetrics& second_function = second.functions[index];
+		if (!(first_function.name == second_function.name) || first_function.start_line != second_function.start_line
+			|| first_function.line_count != second_function.line_count || first_function.complexity != second_function.complexity) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void PrintRun(const char* name, const KernelRun& run) {
+	const FileCounts& counts = run.counts;
+	printf("  %-10s code %zu, comment %zu, blank %zu, total %zu, logical %zu, tokens %zu, code bytes %zu, special %d, functions %zu\n",
+		name, counts.code_lines, counts.comment_lines, counts.blank_lines, counts.total_lines, counts.logical_lines, counts.token_count,
+		counts.code_bytes, run.has_special_bytes, run.functions.size());
+}
+
+static void PrintContent(const std::string& content) {
+	printf("  content (%zu bytes): \"", content.size());
+	for (unsigned char character : content) {
+		if (character == '\n') {
+			printf("\\n");
+		}
+		else if (character == '\r') {
+			printf("\\r");
+		}
+		else if (character == '\\' || character == '"') {
+			printf("\\%c", character);
+		}
+		else if (character < 0x20 || character >= 0x7F) {
+			printf("\\x%02X", character);
+		}
+		else {
+			putchar(character);
+		}
+	}
+	printf("\"\n");
+}
+
+static void CheckContent(KernelTest& test, const std::string& content) {
+	for (unsigned int functions = 0; functions < 2; functions++) {
+		KernelRun reference = RunKernel(CountingKernelScalar::CountFile, content, functions != 0);
+		for (unsigned int index = 0; index < test.kernel_count; index++) {
+			KernelRun run = RunKernel(test.kernels[index]->count_file, content, functions != 0);
+			test.case_count++;
+			if (!AreRunsEqual(reference, run)) {
+				// Only the first failures are printed, the rest are counted
+				if (test.failure_count < 8) {
+					printf("The %s kernel disagrees with the scalar reference%s.\n", test.kernels[index]->name, functions != 0 ? " with the functions" : "");
+					PrintContent(content);
+					PrintRun("scalar", reference);
+					PrintRun(test.kernels[index]->name, run);
+				}
+				test.failure_count++;
+			}
+		}
+	}
+}
+
+static std::string ToCrlf(const std::string& content) {
+	std::string result;
+	for (char character : content) {
+		if (character == '\n') {
+			result += '\r';
+		}
+		result += character;
+	}
+	return result;
+}
+
+// The content is checked as it is, with CRLF line endings and without its final new line, each of them
+// shifted across the first block boundary
+static void CheckShifted(KernelTest& test, const std::string& content) {
+	std::string variants[3] = { content, ToCrlf(content), content };
+	while (variants[2].size() > 0 && (variants[2].back() == '\n' || variants[2].back() == '\r')) {
+		variants[2].pop_back();
+	}
+
+	for (const std::string& variant : variants) {
+		for (size_t shift = 0; shift <= 70; shift++) {
+			// The padding is a code line that ends just before the shifted content
+			std::string padding = shift == 0 ? std::string() : std::string(shift - 1, 'x') + "\n";
+			CheckContent(test, padding + variant);
+			// And without a new line, such that the content continues the line of the padding
+			CheckContent(test, std::string(shift, ' ') + variant);
+		}
+	}
+}
+
+// xorshift64, such that the random cases are the same on every run
+static uint64_t NextRandom(uint64_t& state) {
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+static std::string MakeRandomContent(uint64_t& state) {
+	static const char* PIECES[] = {
+		"\"", "'", "\\", "\\\\", "\\\"", "\\'", "\\\n", "/", "*", "//", "/*", "*/", "\n", "\r\n", " ", "\t", ";", "{", "}",
+		"(", ")", "#", "#include <a.h>\n", "&&", "||", "&", "|", "?", "if", "else", "for", "while", "do", "switch", "case",
+		"default", "try", "catch", "namespace", "int", "x", "_a1", "42", "3.14", "void f() {", "\xC3\xA9", "\xFF", ",", "a.b"
+	};
+	const size_t PIECE_COUNT = sizeof(PIECES) / sizeof(PIECES[0]);
+
+	std::string content;
+	size_t piece_count = NextRandom(state) % 96;
+	for (size_t index = 0; index < piece_count; index++) {
+		content += PIECES[NextRandom(state) % PIECE_COUNT];
+	}
+	return content;
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+int main() {
+	KernelTest test = {};
+	for (unsigned int target = 0; target < COUNTING_KERNEL_TARGET_COUNT; target++) {
+		const CountingKernel* kernel = GetCountingKernel((COUNTING_KERNEL_TARGET)target);
+		if (kernel != nullptr) {
+			test.kernels[test.kernel_count++] = kernel;
+		}
+	}
+
+	const char* CASES[] = {
+		"",
+		"\n",
+		"int a;\n",
+		"int a; // comment\n// only a comment\n\n",
+		"/* a block\n   comment over\n   several lines */ int b;\n",
+		"const char* s = \"a string with // no comment and /* none */ inside\";\n",
+		"const char* s = \"an escaped \\\" quote and a \\\\ backslash\";\n",
+		"char c = '\\''; char d = '\"'; char e = '\\\\';\n",
+		"const char* s = \"a string that continues \\\n on the next line\";\n",
+		"// a line comment that continues \\\n on the next line\nint c;\n",
+		"#define MACRO(x) \\\n\tdo { if (x) { f(); } } while (0)\nint d;\n",
+		"int f(int a) {\n\tif (a && b || c) {\n\t\treturn a ? 1 : 2;\n\t}\n\tfor (;;) {}\n\treturn 0;\n}\n",
+		"namespace n {\nstruct s {\n\tvoid g() const { switch (x) { case 1: break; default: break; } }\n};\n}\n",
+		"void h() try { throw 1; } catch (...) { }\n",
+		"/**/ /***/ /*/ still a comment */ int e;\n",
+		"\"unterminated string\nint f;\n'unterminated character\nint g;\n",
+		"/* an unterminated block comment\nint h;\n",
+		"int \xC3\xA9 = 1; // UTF-8 outside of a comment, then \xFF in a comment\n",
+		"int i = \"\\\xC3\xA9\";\n",
+		"\t   \t\n  ;\n  {\n  }\n",
+	};
+
+	for (const char* content : CASES) {
+		CheckShifted(test, content);
+	}
+	// Long literals and comments that span several blocks
+	CheckShifted(test, "const char* s = \"" + std::string(150, 'a') + "\\\"" + std::string(90, 'b') + "\";\n");
+	CheckShifted(test, "/*" + std::string(200, '*') + "*/ int j;\n// " + std::string(130, '/') + "\nint k;\n");
+	CheckShifted(test, std::string(63, '\\') + "\"\n" + std::string(64, '\\') + "\"x\"\n");
+
+	uint64_t random_state = 0x9E3779B97F4A7C15ull;
+	for (unsigned int index = 0; index < KERNEL_TEST_RANDOM_CASES; index++) {
+		std::string content = MakeRandomContent(random_state);
+		CheckContent(test, content);
+		CheckContent(test, ToCrlf(content));
+		CheckContent(test, std::string(NextRandom(random_state) % 64, ' ') + content);
+	}
+
+	printf("Kernels compared with the scalar reference:");
+	for (unsigned int index = 0; index < test.kernel_count; index++) {
+		printf(" %s", test.kernels[index]->name);
+	}
+	printf(". Cases: %zu, failures: %zu.\n", test.case_count, test.failure_count);
+	return test.failure_count == 0 && test.kernel_count > 0 ? 0 : 1;
+}